@@ -30,6 +30,7 @@ namespace logid {
     namespace defaults {
         static constexpr double io_timeout = 500;
         static constexpr int workers = 4;
+        static constexpr int io_threads = 1;
         static constexpr int gesture_threshold = 50;
     }
 
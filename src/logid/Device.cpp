@@ -18,6 +18,7 @@
 
 #include <Device.h>
 #include <DeviceManager.h>
+#include <InputDevice.h>
 #include <features/SmartShift.h>
 #include <features/DPI.h>
 #include <features/RemapButton.h>
@@ -66,6 +67,7 @@ std::shared_ptr<Device> Device::make(
     ret->_self = ret;
     ret->_ipc_node->manage(ret);
     ret->_ipc_interface = ret->_ipc_node->make_interface<IPC>(ret.get());
+    ret->_latency_interface = ret->_ipc_node->make_interface<LatencyIPC>(ret.get());
     return ret;
 }
 
@@ -79,6 +81,7 @@ std::shared_ptr<Device> Device::make(
     ret->_self = ret;
     ret->_ipc_node->manage(ret);
     ret->_ipc_interface = ret->_ipc_node->make_interface<IPC>(ret.get());
+    ret->_latency_interface = ret->_ipc_node->make_interface<LatencyIPC>(ret.get());
     return ret;
 }
 
@@ -89,6 +92,7 @@ std::shared_ptr<Device> Device::make(
     ret->_self = ret;
     ret->_ipc_node->manage(ret);
     ret->_ipc_interface = ret->_ipc_node->make_interface<IPC>(ret.get());
+    ret->_latency_interface = ret->_ipc_node->make_interface<LatencyIPC>(ret.get());
     return ret;
 }
 
@@ -163,6 +167,9 @@ void Device::_init() {
         feature.second->configure();
         feature.second->listen();
     }
+
+    _hidpp20->setTransaction(hidpp::Transaction::Runtime);
+    _hidpp20->saveCapabilities();
 }
 
 std::string Device::name() {
@@ -212,7 +219,21 @@ void Device::reset() {
 
 std::shared_ptr<InputDevice> Device::virtualInput() const {
     if (auto manager = _manager.lock()) {
-        return manager->virtualInput();
+        if (!manager->perDeviceInput())
+            return manager->virtualInput();
+
+        std::call_once(_input_once, [this, &manager]() {
+            auto name = manager->virtualInput()->name() + " (" + _hidpp20->name() + ")";
+            try {
+                _virtual_input = std::make_shared<InputDevice>(
+                        name.c_str(), InputDevice::capabilitiesOf(*manager->config()));
+            } catch (std::system_error& e) {
+                logPrintf(WARN, "Could not create input device %s, using the shared one: %s",
+                          name.c_str(), e.what());
+                _virtual_input = manager->virtualInput();
+            }
+        });
+        return _virtual_input;
     } else {
         logPrintf(ERROR, "Device manager lost");
         logPrintf(ERROR,
@@ -237,6 +258,43 @@ std::vector<std::string> Device::getProfiles() const {
     return ret;
 }
 
+std::tuple<double, double, double, uint64_t, uint64_t, uint64_t>
+Device::getTiming() const {
+    using ms = std::chrono::duration<double, std::milli>;
+    auto stats = _hidpp20->timingStats();
+    return {ms(stats.srtt).count(), ms(stats.rttvar).count(),
+            ms(stats.timeout).count(), stats.samples, stats.timeouts,
+            stats.retries};
+}
+
+std::tuple<uint64_t, uint64_t, uint64_t, uint64_t, uint64_t>
+Device::getWriteStats() const {
+    auto stats = _hidpp20->rawDevice()->writeStats();
+    return {stats.depth, stats.max_depth, stats.written, stats.dropped, stats.failed};
+}
+
+std::tuple<double, double, double, uint64_t>
+Device::getLatency(const std::string& stage) {
+    using ms = std::chrono::duration<double, std::milli>;
+    latency_stage id;
+    if (stage == "dispatch")
+        id = latency_stage::dispatch;
+    else if (stage == "feature")
+        id = latency_stage::feature;
+    else if (stage == "output")
+        id = latency_stage::output;
+    else
+        throw std::invalid_argument("unknown latency stage");
+
+    auto stats = _hidpp20->latency().summary(id);
+    return {ms(stats.p50).count(), ms(stats.p99).count(), ms(stats.max).count(),
+            stats.samples};
+}
+
+void Device::resetLatency() {
+    _hidpp20->latency().reset();
+}
+
 void Device::setProfile(const std::string& profile) {
     std::unique_lock lock(_profile_mutex);
 
@@ -252,7 +310,7 @@ void Device::setProfile(const std::string& profile) {
 }
 
 void Device::setProfileDelayed(const std::string& profile) {
-    run_task([self_weak = _self, profile](){
+    _strand.run([self_weak = _self, profile](){
         if (auto self = self_weak.lock())
             self->setProfile(profile);
     });
@@ -298,7 +356,15 @@ hidpp20::Device& Device::hidpp20() {
     return *_hidpp20;
 }
 
+logid::strand& Device::strand() {
+    return _strand;
+}
+
 void Device::_makeResetMechanism() {
+    if (_hidpp20->hasFeatureTable() &&
+        !_hidpp20->hasFeature(hidpp20::Reset::ID))
+        return;
+
     try {
         hidpp20::Reset reset(_hidpp20.get());
         _reset_mechanism = std::make_unique<std::function<void()>>(
@@ -318,7 +384,13 @@ Device::IPC::IPC(Device* device) :
                         {"GetProfiles", {device, &Device::getProfiles, {"profiles"}}},
                         {"SetProfile", {device, &Device::setProfile, {"profile"}}},
                         {"RemoveProfile", {device, &Device::removeProfile, {"profile"}}},
-                        {"ClearProfile", {device, &Device::clearProfile, {"profile"}}}
+                        {"ClearProfile", {device, &Device::clearProfile, {"profile"}}},
+                        {"GetTiming", {device, &Device::getTiming,
+                                       {"srtt", "rttvar", "timeout",
+                                        "samples", "timeouts", "retries"}}},
+                        {"GetWriteStats", {device, &Device::getWriteStats,
+                                           {"depth", "max_depth", "written",
+                                            "dropped", "failed"}}}
                 },
                 {
                         {"Name",           ipcgull::property<std::string>(
@@ -333,6 +405,16 @@ Device::IPC::IPC(Device* device) :
                 }), _device(*device) {
 }
 
+Device::LatencyIPC::LatencyIPC(Device* device) :
+        ipcgull::interface(
+                SERVICE_ROOT_NAME ".Latency",
+                {
+                        {"Get", {device, &Device::getLatency, {"stage"},
+                                 {"p50", "p99", "max", "samples"}}},
+                        {"Reset", {device, &Device::resetLatency}}
+                }, {}, {}) {
+}
+
 void Device::IPC::notifyStatus() const {
     emit_signal("StatusChanged", (bool) (_device._awake));
 }
@@ -25,6 +25,8 @@
 #include <ipcgull/node.h>
 #include <ipcgull/interface.h>
 #include <Configuration.h>
+#include <mutex>
+#include <util/task.h>
 
 namespace logid {
     class DeviceManager;
@@ -74,8 +76,30 @@ namespace logid {
 
         void clearProfile(const std::string& profile);
 
+        /* Smoothed RTT, RTT variance and timeout (in ms), then the number
+         * of measured round trips, timeouts and retries */
+        [[nodiscard]] std::tuple<double, double, double, uint64_t, uint64_t, uint64_t>
+        getTiming() const;
+
+        /* Reports waiting to be sent and the most there have been, then the
+         * number written, dropped on a full queue and failed. These count
+         * the whole hidraw node, which a receiver shares with its devices. */
+        [[nodiscard]] std::tuple<uint64_t, uint64_t, uint64_t, uint64_t, uint64_t>
+        getWriteStats() const;
+
+        /* Median, 99th percentile and worst latency (in ms) from reading an
+         * input report to reaching a stage (dispatch, feature or output),
+         * then the number of reports measured */
+        [[nodiscard]] std::tuple<double, double, double, uint64_t>
+        getLatency(const std::string& stage);
+
+        void resetLatency();
+
         backend::hidpp20::Device& hidpp20();
 
+        /* Work that touches this device should run here, one task at a time */
+        [[nodiscard]] logid::strand& strand();
+
         static std::shared_ptr<Device> make(
                 std::string path,
                 backend::hidpp::DeviceIndex index,
@@ -99,6 +123,8 @@ namespace logid {
 
         void reset();
 
+        /* The device's own virtual input device if the configuration asks
+         * for one per device, created on first use. Otherwise, the shared one. */
         [[nodiscard]] std::shared_ptr<InputDevice> virtualInput() const;
 
         [[nodiscard]] std::shared_ptr<ipcgull::node> ipcNode() const;
@@ -175,12 +201,23 @@ namespace logid {
             void notifyStatus() const;
         };
 
+        class LatencyIPC : public ipcgull::interface {
+        public:
+            explicit LatencyIPC(Device* device);
+        };
+
         ipcgull::property<bool> _awake;
         std::mutex _state_lock;
 
+        logid::strand _strand;
+
+        mutable std::once_flag _input_once;
+        mutable std::shared_ptr<InputDevice> _virtual_input;
+
         std::weak_ptr<Device> _self;
 
         std::shared_ptr<IPC> _ipc_interface;
+        std::shared_ptr<LatencyIPC> _latency_interface;
     };
 }
 
@@ -18,7 +18,10 @@
 
 #include <DeviceManager.h>
 #include <backend/Error.h>
+#include <backend/raw/IOMonitor.h>
+#include <backend/raw/ReportTrace.h>
 #include <util/log.h>
+#include <algorithm>
 #include <thread>
 #include <sstream>
 #include <utility>
@@ -27,18 +30,46 @@
 using namespace logid;
 using namespace logid::backend;
 
+static raw::IOBackend get_io_backend(const Configuration& config) {
+    if (!config.io_backend.has_value() || config.io_backend.value() == "epoll")
+        return raw::IOBackend::Epoll;
+    if (config.io_backend.value() == "io_uring")
+        return raw::IOBackend::IOUring;
+
+    logPrintf(WARN, "Unknown io_backend %s, using epoll", config.io_backend->c_str());
+    return raw::IOBackend::Epoll;
+}
+
+static bool get_per_device_input(const Configuration& config) {
+    if (!config.virtual_input.has_value() || config.virtual_input.value() == "shared")
+        return false;
+    if (config.virtual_input.value() == "per_device")
+        return true;
+
+    logPrintf(WARN, "Unknown virtual_input %s, using shared", config.virtual_input->c_str());
+    return false;
+}
+
 DeviceManager::DeviceManager(std::shared_ptr<Configuration> config,
                              std::shared_ptr<InputDevice> virtual_input,
-                             std::shared_ptr<ipcgull::server> server) :
-        backend::raw::DeviceMonitor(),
+                             std::shared_ptr<ipcgull::server> server,
+                             std::shared_ptr<raw::VirtualTransport> transport) :
+        backend::raw::DeviceMonitor(
+                std::max(config->io_threads.value_or(defaults::io_threads), 1),
+                config->io_cpus.has_value() ?
+                std::vector<int>(config->io_cpus->begin(), config->io_cpus->end()) :
+                std::vector<int>(),
+                get_io_backend(*config), std::move(transport)),
         _server(std::move(server)), _config(std::move(config)),
         _virtual_input(std::move(virtual_input)),
+        _per_device_input(get_per_device_input(*_config)),
         _root_node(ipcgull::node::make_root("")),
         _device_node(ipcgull::node::make_root("devices")),
         _receiver_node(ipcgull::node::make_root("receivers")) {
     _ipc_devices = _root_node->make_interface<DevicesIPC>(this);
     _ipc_receivers = _root_node->make_interface<ReceiversIPC>(this);
     _ipc_config = _root_node->make_interface<Configuration::IPC>(_config.get());
+    _ipc_trace = _root_node->make_interface<TraceIPC>(this);
     _device_node->add_server(_server);
     _receiver_node->add_server(_server);
     _root_node->add_server(_server);
@@ -52,6 +83,10 @@ std::shared_ptr<InputDevice> DeviceManager::virtualInput() const {
     return _virtual_input;
 }
 
+bool DeviceManager::perDeviceInput() const {
+    return _per_device_input;
+}
+
 std::shared_ptr<const ipcgull::node> DeviceManager::devicesNode() const {
     return _device_node;
 }
@@ -250,6 +285,31 @@ void DeviceManager::ReceiversIPC::receiverRemoved(
     emit_signal("ReceiverRemoved", r);
 }
 
+DeviceManager::TraceIPC::TraceIPC(DeviceManager* manager) :
+        ipcgull::interface(
+                SERVICE_ROOT_NAME ".Trace",
+                {
+                        {"Start", {manager, &DeviceManager::startTrace, {"path", "records"}}},
+                        {"Stop", {manager, &DeviceManager::stopTrace}},
+                        {"Active", {manager, &DeviceManager::tracing, {"active"}}}
+                }, {}, {}) {
+}
+
+void DeviceManager::startTrace(const std::string& path, uint32_t records) {
+    raw::startTrace(path, records);
+    logPrintf(INFO, "Capturing raw reports to %s", path.c_str());
+}
+
+void DeviceManager::stopTrace() {
+    if (raw::tracing())
+        logPrintf(INFO, "Stopped capturing raw reports");
+    raw::stopTrace();
+}
+
+bool DeviceManager::tracing() const {
+    return raw::tracing();
+}
+
 int DeviceManager::newDeviceNickname() {
     std::lock_guard<std::mutex> lock(_nick_lock);
 
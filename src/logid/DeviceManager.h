@@ -35,6 +35,9 @@ namespace logid {
 
         [[nodiscard]] std::shared_ptr<InputDevice> virtualInput() const;
 
+        /* Whether each device gets its own virtual input device */
+        [[nodiscard]] bool perDeviceInput() const;
+
         [[nodiscard]] std::shared_ptr<const ipcgull::node> devicesNode() const;
 
         [[nodiscard]] std::shared_ptr<const ipcgull::node>
@@ -44,12 +47,17 @@ namespace logid {
 
         void removeExternalDevice(const std::shared_ptr<Device>& d);
 
+        /* Every device, including the ones connected to receivers */
+        [[nodiscard]]
+        std::vector<std::shared_ptr<Device>> listDevices() const;
+
         std::mutex& mutex() const;
 
     protected:
         DeviceManager(std::shared_ptr<Configuration> config,
                       std::shared_ptr<InputDevice> virtual_input,
-                      std::shared_ptr<ipcgull::server> server);
+                      std::shared_ptr<ipcgull::server> server,
+                      std::shared_ptr<backend::raw::VirtualTransport> transport = {});
 
         void addDevice(std::string path) final;
 
@@ -65,9 +73,6 @@ namespace logid {
             void deviceRemoved(const std::shared_ptr<Device>& d);
         };
 
-        [[nodiscard]]
-        std::vector<std::shared_ptr<Device>> listDevices() const;
-
         class ReceiversIPC : public ipcgull::interface {
         public:
             explicit ReceiversIPC(DeviceManager* manager);
@@ -80,9 +85,21 @@ namespace logid {
         [[nodiscard]]
         std::vector<std::shared_ptr<Receiver>> listReceivers() const;
 
+        class TraceIPC : public ipcgull::interface {
+        public:
+            explicit TraceIPC(DeviceManager* manager);
+        };
+
+        void startTrace(const std::string& path, uint32_t records);
+
+        void stopTrace();
+
+        [[nodiscard]] bool tracing() const;
+
         std::shared_ptr<ipcgull::server> _server;
         std::shared_ptr<Configuration> _config;
         std::shared_ptr<InputDevice> _virtual_input;
+        const bool _per_device_input;
 
         std::shared_ptr<ipcgull::node> _root_node;
 
@@ -92,6 +109,7 @@ namespace logid {
         std::shared_ptr<Configuration::IPC> _ipc_config;
         std::shared_ptr<DevicesIPC> _ipc_devices;
         std::shared_ptr<ReceiversIPC> _ipc_receivers;
+        std::shared_ptr<TraceIPC> _ipc_trace;
 
         std::map<std::string, std::shared_ptr<Device>> _devices;
         std::map<std::string, std::shared_ptr<Receiver>> _receivers;
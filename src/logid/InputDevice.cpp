@@ -17,13 +17,18 @@
  */
 
 #include <InputDevice.h>
+#include <config/schema.h>
+#include <util/latency.h>
 #include <system_error>
+#include <algorithm>
 #include <mutex>
+#include <cerrno>
 
 extern "C"
 {
 #include <libevdev/libevdev.h>
 #include <libevdev/libevdev-uinput.h>
+#include <unistd.h>
 }
 
 using namespace logid;
@@ -40,27 +45,150 @@ const char* InputDevice::InvalidEventCode::what() const noexcept {
     return _what.c_str();
 }
 
-InputDevice::InputDevice(const char* name) {
+namespace {
+    typedef InputDevice::Capabilities Capabilities;
+
+    void addKeys(const config::KeypressAction& action, Capabilities& capabilities) {
+        if (!action.keys.has_value())
+            return;
+
+        auto add = [&capabilities](const auto& key) {
+            try {
+                if constexpr (std::is_same_v<std::decay_t<decltype(key)>, std::string>)
+                    capabilities.keys.insert(InputDevice::toKeyCode(key));
+                else
+                    capabilities.keys.insert(key);
+            } catch (InputDevice::InvalidEventCode& e) {
+                // The action warns about it when it is created
+            }
+        };
+
+        std::visit([&add](const auto& keys) {
+            if constexpr (std::is_same_v<std::decay_t<decltype(keys)>,
+                    std::list<std::variant<uint, std::string>>>) {
+                for (const auto& key: keys)
+                    std::visit(add, key);
+            } else {
+                add(keys);
+            }
+        }, action.keys.value());
+    }
+
+    void addGesture(const config::Gesture& gesture, Capabilities& capabilities);
+
+    /* Works for both config::Action and config::BasicAction */
+    template <typename T>
+    void addAction(const T& action, Capabilities& capabilities) {
+        std::visit([&capabilities](const auto& a) {
+            using A = std::decay_t<decltype(a)>;
+            if constexpr (std::is_same_v<A, config::KeypressAction>) {
+                addKeys(a, capabilities);
+            } else if constexpr (std::is_same_v<A, config::GestureAction>) {
+                if (a.gestures.has_value()) {
+                    for (const auto& g: a.gestures.value())
+                        addGesture(g.second, capabilities);
+                }
+            }
+        }, action);
+    }
+
+    void addGesture(const config::Gesture& gesture, Capabilities& capabilities) {
+        std::visit([&capabilities](const auto& g) {
+            using G = std::decay_t<decltype(g)>;
+            if constexpr (std::is_same_v<G, config::AxisGesture>) {
+                if (!g.axis.has_value())
+                    return;
+                try {
+                    if (auto name = std::get_if<std::string>(&g.axis.value()))
+                        capabilities.axes.insert(InputDevice::toAxisCode(*name));
+                    else
+                        capabilities.axes.insert(std::get<uint>(g.axis.value()));
+                } catch (InputDevice::InvalidEventCode& e) {
+                    // The gesture warns about it when it is created
+                }
+            } else if constexpr (requires { g.action; }) {
+                if (g.action.has_value())
+                    addAction(g.action.value(), capabilities);
+            }
+        }, gesture);
+    }
+
+    void addProfile(const config::Profile& profile, Capabilities& capabilities) {
+        if (profile.buttons.has_value()) {
+            for (const auto& button: profile.buttons.value()) {
+                if (button.second.action.has_value())
+                    addAction(button.second.action.value(), capabilities);
+            }
+        }
+
+        if (profile.hiresscroll.has_value()) {
+            if (auto hires = std::get_if<config::HiresScroll>(&profile.hiresscroll.value())) {
+                for (const auto& gesture: {hires->up, hires->down}) {
+                    if (gesture.has_value())
+                        addGesture(gesture.value(), capabilities);
+                }
+            }
+        }
+
+        if (profile.thumbwheel.has_value()) {
+            const auto& wheel = profile.thumbwheel.value();
+            for (const auto& gesture: {wheel.left, wheel.right}) {
+                if (gesture.has_value())
+                    addGesture(gesture.value(), capabilities);
+            }
+            for (const auto& action: {wheel.proxy, wheel.touch, wheel.tap}) {
+                if (action.has_value())
+                    addAction(action.value(), capabilities);
+            }
+        }
+    }
+}
+
+InputDevice::Capabilities InputDevice::capabilitiesOf(const config::Config& config) {
+    Capabilities capabilities;
+    if (!config.devices.has_value())
+        return capabilities;
+
+    for (const auto& device: config.devices.value()) {
+        if (auto profile = std::get_if<config::Profile>(&device.second)) {
+            addProfile(*profile, capabilities);
+        } else {
+            for (const auto& p: std::get<config::Device>(device.second).profiles)
+                addProfile(p.second, capabilities);
+        }
+    }
+
+    return capabilities;
+}
+
+InputDevice::InputDevice(const char* name, const Capabilities& capabilities) : _name(name) {
     device = libevdev_new();
     libevdev_set_name(device, name);
 
+    /* Changing a uinput device's capabilities means recreating it, which
+     * drops held keys and makes clients probe it again. Enable the codes
+     * that the configuration uses up front instead. */
     libevdev_enable_event_type(device, EV_KEY);
     for (unsigned int i = 0; i < KEY_CNT; i++) {
-        // Enable some keys which a normal keyboard should have
-        // by default, i.e. a-z, modifier keys and so on, see:
-        // /usr/include/linux/input-event-codes.h
-        if (i < 128) {
-            registered_keys[i] = true;
+        if (_isReservedKey(i))
             libevdev_enable_event_code(device, EV_KEY, i, nullptr);
-        } else {
-            registered_keys[i] = false;
-        }
     }
-
-    for (bool& axis: registered_axis)
-        axis = false;
+    for (auto key: capabilities.keys) {
+        if (key != KEY_RESERVED && key < KEY_CNT)
+            libevdev_enable_event_code(device, EV_KEY, key, nullptr);
+    }
 
     libevdev_enable_event_type(device, EV_REL);
+    for (auto axis: capabilities.axes) {
+        if (axis >= REL_CNT)
+            continue;
+        libevdev_enable_event_code(device, EV_REL, axis, nullptr);
+
+        // Hi-res axes are sent along with their low-res counterpart
+        int low_res_axis = getLowResAxis(axis);
+        if (low_res_axis != -1)
+            libevdev_enable_event_code(device, EV_REL, low_res_axis, nullptr);
+    }
 
     int err = libevdev_uinput_create_from_device(device,
                                                  LIBEVDEV_UINPUT_OPEN_MANAGED, &ui_device);
@@ -72,30 +200,44 @@ InputDevice::InputDevice(const char* name) {
 }
 
 InputDevice::~InputDevice() {
+    if (extra_ui_device)
+        libevdev_uinput_destroy(extra_ui_device);
+    if (extra_device)
+        libevdev_free(extra_device);
+
     libevdev_uinput_destroy(ui_device);
     libevdev_free(device);
 }
 
+const std::string& InputDevice::name() const {
+    return _name;
+}
+
 void InputDevice::registerKey(uint code) {
     // TODO: Maybe print error message, if wrong code is passed?
-    if (code >= KEY_CNT || registered_keys[code]) {
+    if (code == KEY_RESERVED || code >= KEY_CNT ||
+        libevdev_has_event_code(device, EV_KEY, code))
         return;
-    }
-
-    _enableEvent(EV_KEY, code);
 
-    registered_keys[code] = true;
+    std::unique_lock lock(_input_mutex);
+    if (!extra_keys[code])
+        _enableExtraEvent(EV_KEY, code);
 }
 
 void InputDevice::registerAxis(uint axis) {
-    // TODO: Maybe print error message, if wrong code is passed?
-    if (axis >= REL_CNT || registered_axis[axis]) {
+    if (axis >= REL_CNT)
         return;
-    }
 
-    _enableEvent(EV_REL, axis);
+    int low_res_axis = getLowResAxis(axis);
+    if (low_res_axis != -1)
+        registerAxis(low_res_axis);
 
-    registered_axis[axis] = true;
+    if (libevdev_has_event_code(device, EV_REL, axis))
+        return;
+
+    std::unique_lock lock(_input_mutex);
+    if (!extra_axes[axis])
+        _enableExtraEvent(EV_REL, axis);
 }
 
 void InputDevice::moveAxis(uint axis, int movement) {
@@ -110,6 +252,47 @@ void InputDevice::releaseKey(uint code) {
     _sendEvent(EV_KEY, code, 0);
 }
 
+InputDevice::Frame InputDevice::frame() {
+    return Frame(*this);
+}
+
+InputDevice::Frame::Frame(InputDevice& device) : _device(device) {
+}
+
+InputDevice::Frame::~Frame() noexcept {
+    commit();
+}
+
+void InputDevice::Frame::moveAxis(uint axis, int movement) {
+    _add(EV_REL, axis, movement);
+}
+
+void InputDevice::Frame::pressKey(uint code) {
+    _add(EV_KEY, code, 1);
+}
+
+void InputDevice::Frame::releaseKey(uint code) {
+    _add(EV_KEY, code, 0);
+}
+
+void InputDevice::Frame::commit() {
+    if (_size == 0)
+        return;
+
+    _device._sendFrame(_events.data(), _size);
+    _size = 0;
+}
+
+void InputDevice::Frame::_add(uint type, uint code, int value) {
+    if (_size == max_events)
+        commit();
+
+    auto& event = _events[_size++];
+    event.type = type;
+    event.code = code;
+    event.value = value;
+}
+
 std::string InputDevice::toKeyName(uint code) {
     return _toEventName(EV_KEY, code);
 }
@@ -159,25 +342,93 @@ uint InputDevice::_toEventCode(uint type, const std::string& name) {
     return code;
 }
 
-void InputDevice::_enableEvent(const uint type, const uint code) {
-    std::unique_lock lock(_input_mutex);
-    libevdev_uinput_destroy(ui_device);
+bool InputDevice::_isReservedKey(uint code) {
+    // Leaves out the BTN_* ranges: mouse, joystick, gamepad, digitizer and so on
+    return (code > KEY_RESERVED && code < BTN_MISC) ||
+           (code >= KEY_OK && code < BTN_DPAD_UP) ||
+           (code > BTN_DPAD_RIGHT && code < BTN_TRIGGER_HAPPY);
+}
 
-    libevdev_enable_event_code(device, type, code, nullptr);
+void InputDevice::_enableExtraEvent(uint type, uint code) {
+    if (extra_ui_device) {
+        libevdev_uinput_destroy(extra_ui_device);
+        extra_ui_device = nullptr;
+    }
 
-    int err = libevdev_uinput_create_from_device(device,
-                                                 LIBEVDEV_UINPUT_OPEN_MANAGED, &ui_device);
+    if (!extra_device) {
+        extra_device = libevdev_new();
+        libevdev_set_name(extra_device, (_name + " Extra").c_str());
+    }
+
+    libevdev_enable_event_type(extra_device, type);
+    libevdev_enable_event_code(extra_device, type, code, nullptr);
+
+    int err = libevdev_uinput_create_from_device(extra_device,
+                                                 LIBEVDEV_UINPUT_OPEN_MANAGED,
+                                                 &extra_ui_device);
 
     if (err != 0) {
-        libevdev_free(device);
-        device = nullptr;
-        ui_device = nullptr;
+        extra_ui_device = nullptr;
         throw std::system_error(-err, std::generic_category());
     }
+
+    if (type == EV_KEY)
+        extra_keys[code] = true;
+    else
+        extra_axes[code] = true;
 }
 
 void InputDevice::_sendEvent(uint type, uint code, int value) {
-    std::unique_lock lock(_input_mutex);
-    libevdev_uinput_write_event(ui_device, type, code, value);
-    libevdev_uinput_write_event(ui_device, EV_SYN, SYN_REPORT, 0);
+    input_event events[2]{};
+    events[0].type = type;
+    events[0].code = code;
+    events[0].value = value;
+    _sendFrame(events, 1);
+}
+
+void InputDevice::_sendFrame(input_event* events, std::size_t size) {
+    auto is_extra = [this](const input_event& event) {
+        return (event.type == EV_KEY && event.code < KEY_CNT && extra_keys[event.code]) ||
+               (event.type == EV_REL && event.code < REL_CNT && extra_axes[event.code]);
+    };
+
+    /* The main device never changes and each write is a whole frame, so
+     * frames for it can't interleave and don't need the lock */
+    if (std::none_of(events, events + size, is_extra)) {
+        _write(ui_device, events, size);
+    } else {
+        std::unique_lock lock(_input_mutex);
+
+        // Each device gets its own frame
+        input_event main_events[Frame::max_events + 1];
+        input_event extra_events[Frame::max_events + 1];
+        std::size_t main_size = 0, extra_size = 0;
+        for (std::size_t i = 0; i < size; ++i) {
+            if (is_extra(events[i]))
+                extra_events[extra_size++] = events[i];
+            else
+                main_events[main_size++] = events[i];
+        }
+
+        if (main_size)
+            _write(ui_device, main_events, main_size);
+        if (extra_size && extra_ui_device)
+            _write(extra_ui_device, extra_events, extra_size);
+    }
+
+    latency_mark(latency_stage::output);
+}
+
+void InputDevice::_write(libevdev_uinput* target, input_event* events, std::size_t size) {
+    // uinput timestamps events itself
+    auto& syn = events[size++];
+    syn = {};
+    syn.type = EV_SYN;
+    syn.code = SYN_REPORT;
+
+    const int fd = libevdev_uinput_get_fd(target);
+    ssize_t ret;
+    do {
+        ret = ::write(fd, events, size * sizeof(input_event));
+    } while (ret == -1 && errno == EINTR);
 }
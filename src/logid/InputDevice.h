@@ -19,9 +19,12 @@
 #ifndef LOGID_INPUTDEVICE_H
 #define LOGID_INPUTDEVICE_H
 
+#include <array>
 #include <memory>
 #include <string>
 #include <mutex>
+#include <atomic>
+#include <set>
 
 extern "C"
 {
@@ -29,6 +32,10 @@ extern "C"
 #include <libevdev/libevdev-uinput.h>
 }
 
+namespace logid::config {
+    struct Config;
+}
+
 namespace logid {
     class InputDevice {
     public:
@@ -44,10 +51,52 @@ namespace logid {
             const std::string _what;
         };
 
-        explicit InputDevice(const char* name);
+        /* Events added to a frame are written, followed by a single
+         * SYN_REPORT, in one write when it is committed or destroyed. */
+        class Frame {
+        public:
+            explicit Frame(InputDevice& device);
+
+            Frame(const Frame&) = delete;
+
+            Frame& operator=(const Frame&) = delete;
+
+            ~Frame() noexcept;
+
+            void moveAxis(uint axis, int movement);
+
+            void pressKey(uint code);
+
+            void releaseKey(uint code);
+
+            void commit();
+
+            // Larger frames are split, each part ending with its own SYN_REPORT
+            static constexpr std::size_t max_events = 16;
+
+        private:
+            void _add(uint type, uint code, int value);
+
+            InputDevice& _device;
+            std::array<input_event, max_events + 1> _events{};
+            std::size_t _size = 0;
+        };
+
+        struct Capabilities {
+            std::set<uint> keys;
+            std::set<uint> axes;
+        };
+
+        /* The keys and axes that the actions in any profile may send */
+        static Capabilities capabilitiesOf(const config::Config& config);
+
+        /* Keyboard keys are always enabled, along with capabilities */
+        explicit InputDevice(const char* name, const Capabilities& capabilities = {});
 
         ~InputDevice();
 
+        [[nodiscard]] const std::string& name() const;
+
         void registerKey(uint code);
 
         void registerAxis(uint axis);
@@ -58,6 +107,8 @@ namespace logid {
 
         void releaseKey(uint code);
 
+        [[nodiscard]] Frame frame();
+
         static std::string toKeyName(uint code);
 
         static uint toKeyCode(const std::string& name);
@@ -71,17 +122,37 @@ namespace logid {
     private:
         void _sendEvent(uint type, uint code, int value);
 
-        void _enableEvent(uint type, uint name);
+        /* Appends a SYN_REPORT to events, which must have room for it */
+        void _sendFrame(input_event* events, std::size_t size);
+
+        /* Must hold _input_mutex when writing to the extra device */
+        void _write(libevdev_uinput* target, input_event* events, std::size_t size);
+
+        /* Adds a key or axis to the extra device, must hold _input_mutex */
+        void _enableExtraEvent(uint type, uint code);
+
+        /* Whether the main device is always created with a key. Buttons
+         * that would make it look like a mouse, joystick or tablet are
+         * left out. */
+        static bool _isReservedKey(uint code);
 
         static std::string _toEventName(uint type, uint code);
 
         static uint _toEventCode(uint type, const std::string& name);
 
-        bool registered_keys[KEY_CNT]{};
-        bool registered_axis[REL_CNT]{};
+        const std::string _name;
+
+        /* Created once with the reserved keys and the capabilities */
         libevdev* device;
         libevdev_uinput* ui_device{};
 
+        /* Other keys and axes go to a second device, which is recreated as
+         * they are registered so that the main one never has to be */
+        std::array<std::atomic_bool, KEY_CNT> extra_keys{};
+        std::array<std::atomic_bool, REL_CNT> extra_axes{};
+        libevdev* extra_device{};
+        libevdev_uinput* extra_ui_device{};
+
         std::mutex _input_mutex;
     };
 }
@@ -45,6 +45,7 @@ std::shared_ptr<Receiver> Receiver::make(
         const std::string& path,
         const std::shared_ptr<DeviceManager>& manager) {
     auto ret = ReceiverMonitor::make<Receiver>(path, manager);
+    ret->receiver()->setTransaction(hidpp::Transaction::Runtime);
     ret->_ipc_node->manage(ret);
     return ret;
 }
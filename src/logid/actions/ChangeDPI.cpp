@@ -18,7 +18,7 @@
 #include <actions/ChangeDPI.h>
 #include <Device.h>
 #include <backend/hidpp20/features/ReprogControls.h>
-#include <util/task.h>
+#include <util/async_task.h>
 #include <util/log.h>
 
 using namespace logid::actions;
@@ -47,22 +47,27 @@ void ChangeDPI::press() {
     _pressed = true;
     std::shared_lock lock(_config_mutex);
     if (_dpi && _config.inc.has_value()) {
-        run_task([self_weak = self<ChangeDPI>(),
-                sensor = _config.sensor.value_or(0), inc = _config.inc.value()] {
-            if (auto self = self_weak.lock()) {
-                try {
-                    uint16_t last_dpi = self->_dpi->getDPI(sensor);
-                    self->_dpi->setDPI(last_dpi + inc, sensor);
-                } catch (backend::hidpp20::Error& e) {
-                    if (e.code() == backend::hidpp20::Error::InvalidArgument)
-                        logPrintf(WARN, "%s:%d: Could not get/set DPI for sensor %d",
-                                  self->_device->hidpp20().devicePath().c_str(),
-                                  self->_device->hidpp20().deviceIndex(), sensor);
-                    else
-                        throw e;
-                }
-            }
-        });
+        spawn(_changeDPI(self<ChangeDPI>(), _config.sensor.value_or(0),
+                         _config.inc.value()));
+    }
+}
+
+logid::async_task<void> ChangeDPI::_changeDPI(std::weak_ptr<ChangeDPI> self_weak,
+                                              int sensor, int inc) {
+    auto self = self_weak.lock();
+    if (!self)
+        co_return;
+
+    try {
+        uint16_t last_dpi = co_await self->_dpi->getDPIAsync(sensor);
+        co_await self->_dpi->setDPIAsync(last_dpi + inc, sensor);
+    } catch (backend::hidpp20::Error& e) {
+        if (e.code() == backend::hidpp20::Error::InvalidArgument)
+            logPrintf(WARN, "%s:%d: Could not get/set DPI for sensor %d",
+                      self->_device->hidpp20().devicePath().c_str(),
+                      self->_device->hidpp20().deviceIndex(), sensor);
+        else
+            throw e;
     }
 }
 
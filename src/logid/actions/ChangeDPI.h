@@ -42,6 +42,9 @@ namespace logid::actions {
         [[nodiscard]] uint8_t reprogFlags() const final;
 
     protected:
+        static async_task<void> _changeDPI(std::weak_ptr<ChangeDPI> self_weak,
+                                           int sensor, int inc);
+
         config::ChangeDPI& _config;
         std::shared_ptr<features::DPI> _dpi;
     };
@@ -45,13 +45,19 @@ ChangeHostAction::ChangeHostAction(
                            host.begin(), ::tolower);
         }
     }
-    try {
-        _change_host = std::make_shared<hidpp20::ChangeHost>(&device->hidpp20());
-    } catch (hidpp20::UnsupportedFeature& e) {
-        logPrintf(WARN, "%s:%d: ChangeHost feature not supported, "
-                        "ChangeHostAction will not work.", device->hidpp20()
-                          .devicePath().c_str(), device->hidpp20().deviceIndex());
+    auto& hidpp20_dev = device->hidpp20();
+    if (!hidpp20_dev.hasFeatureTable() ||
+        hidpp20_dev.hasFeature(hidpp20::ChangeHost::ID)) {
+        try {
+            _change_host = std::make_shared<hidpp20::ChangeHost>(&hidpp20_dev);
+        } catch (hidpp20::UnsupportedFeature& e) {
+        }
     }
+
+    if (!_change_host)
+        logPrintf(WARN, "%s:%d: ChangeHost feature not supported, "
+                        "ChangeHostAction will not work.",
+                  hidpp20_dev.devicePath().c_str(), hidpp20_dev.deviceIndex());
 }
 
 std::string ChangeHostAction::getHost() const {
@@ -84,7 +90,7 @@ void ChangeHostAction::press() {
 void ChangeHostAction::release() {
     std::shared_lock lock(_config_mutex);
     if (_change_host && _config.host.has_value()) {
-        run_task([self_weak = self<ChangeHostAction>(), host = _config.host.value()] {
+        _device->strand().run([self_weak = self<ChangeHostAction>(), host = _config.host.value()] {
             if (auto self = self_weak.lock()) {
                 auto host_info = self->_change_host->getHostInfo();
                 int next_host;
@@ -18,7 +18,7 @@
 #include <actions/CycleDPI.h>
 #include <Device.h>
 #include <backend/hidpp20/features/ReprogControls.h>
-#include <util/task.h>
+#include <util/async_task.h>
 #include <util/log.h>
 
 using namespace logid::actions;
@@ -70,22 +70,26 @@ void CycleDPI::press() {
         if (_current_dpi == _config.dpis.value().end())
             _current_dpi = _config.dpis.value().begin();
 
-        run_task([self_weak = self<CycleDPI>(), dpi = *_current_dpi] {
-            if (auto self = self_weak.lock()) {
-                try {
-                    self->_dpi->setDPI(dpi, self->_config.sensor.value_or(0));
-                } catch (backend::hidpp20::Error& e) {
-                    if (e.code() == backend::hidpp20::Error::InvalidArgument)
-                        logPrintf(WARN, "%s:%d: Could not set DPI to %d for "
-                                        "sensor %d",
-                                        self->_device->hidpp20().devicePath().c_str(),
-                                        self->_device->hidpp20().deviceIndex(), dpi,
-                                        self->_config.sensor.value_or(0));
-                    else
-                        throw e;
-                }
-            }
-        });
+        spawn(_setDPI(self<CycleDPI>(), *_current_dpi));
+    }
+}
+
+logid::async_task<void> CycleDPI::_setDPI(std::weak_ptr<CycleDPI> self_weak, int dpi) {
+    auto self = self_weak.lock();
+    if (!self)
+        co_return;
+
+    try {
+        co_await self->_dpi->setDPIAsync(dpi, self->_config.sensor.value_or(0));
+    } catch (backend::hidpp20::Error& e) {
+        if (e.code() == backend::hidpp20::Error::InvalidArgument)
+            logPrintf(WARN, "%s:%d: Could not set DPI to %d for "
+                            "sensor %d",
+                      self->_device->hidpp20().devicePath().c_str(),
+                      self->_device->hidpp20().deviceIndex(), dpi,
+                      self->_config.sensor.value_or(0));
+        else
+            throw e;
     }
 }
 
@@ -40,6 +40,8 @@ namespace logid::actions {
         [[nodiscard]] uint8_t reprogFlags() const final;
 
     protected:
+        static async_task<void> _setDPI(std::weak_ptr<CycleDPI> self_weak, int dpi);
+
         std::mutex _dpi_mutex;
         config::CycleDPI& _config;
         std::shared_ptr<features::DPI> _dpi;
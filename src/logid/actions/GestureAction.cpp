@@ -88,10 +88,10 @@ GestureAction::GestureAction(Device* dev, config::GestureAction& config,
         for (auto&& x: gestures) {
             try {
                 auto direction = toDirection(x.first);
-                _gestures.emplace(
-                        direction,Gesture::makeGesture(
-                                dev, x.second,
-                                _node->make_child(fromDirection(direction))));
+                if (!_gestures[direction])
+                    _setGesture(direction, Gesture::makeGesture(
+                            dev, x.second,
+                            _node->make_child(fromDirection(direction))));
                 if (direction == None) {
                     auto& gesture = x.second;
                     std::visit([](auto&& x) {
@@ -111,7 +111,8 @@ void GestureAction::press() {
     _pressed = true;
     _x = 0, _y = 0;
     for (auto& gesture: _gestures)
-        gesture.second->press(false);
+        if (gesture)
+            gesture->press(false);
 }
 
 void GestureAction::release() {
@@ -121,100 +122,71 @@ void GestureAction::release() {
     bool threshold_met = false;
 
     auto d = toDirection(_x, _y);
-    auto primary_gesture = _gestures.find(d);
-    if (primary_gesture != _gestures.end()) {
-        threshold_met = primary_gesture->second->metThreshold();
-        primary_gesture->second->release(true);
+    if (auto& primary_gesture = _gestures[d]) {
+        threshold_met = primary_gesture->metThreshold();
+        primary_gesture->release(true);
     }
 
-    for (auto& gesture: _gestures) {
-        if (gesture.first == d || gesture.first == None)
+    for (std::size_t i = Up; i < direction_count; ++i) {
+        auto& gesture = _gestures[i];
+        if (i == d || !gesture)
             continue;
         if (!threshold_met) {
-            if (gesture.second->metThreshold()) {
+            if (gesture->metThreshold()) {
                 // If the primary gesture did not meet its threshold, use the
                 // secondary one.
                 threshold_met = true;
-                gesture.second->release(true);
+                gesture->release(true);
             }
         } else {
-            gesture.second->release(false);
+            gesture->release(false);
         }
     }
 
-    auto none_gesture = _gestures.find(None);
-    if (none_gesture != _gestures.end()) {
-        none_gesture->second->release(!threshold_met);
-    }
+    if (auto& none_gesture = _gestures[None])
+        none_gesture->release(!threshold_met);
 }
 
 void GestureAction::move(int16_t x, int16_t y) {
     std::shared_lock lock(_config_mutex);
 
-    int32_t new_x = _x + x, new_y = _y + y;
+    // Positive y is down, as in toDirection()
+    _moveAxis(Left, Right, _x, x);
+    _moveAxis(Up, Down, _y, y);
+}
 
-    if (abs(x) > 0) {
-        if (_x < 0 && new_x >= 0) { // Left -> Origin/Right
-            auto left = _gestures.find(Left);
-            if (left != _gestures.end() && left->second)
-                left->second->move((int16_t) _x);
-            if (new_x) { // Ignore to origin
-                auto right = _gestures.find(Right);
-                if (right != _gestures.end() && right->second)
-                    right->second->move((int16_t) new_x);
-            }
-        } else if (_x > 0 && new_x <= 0) { // Right -> Origin/Left
-            auto right = _gestures.find(Right);
-            if (right != _gestures.end() && right->second)
-                right->second->move((int16_t) -_x);
-            if (new_x) { // Ignore to origin
-                auto left = _gestures.find(Left);
-                if (left != _gestures.end() && left->second)
-                    left->second->move((int16_t) -new_x);
-            }
-        } else if (new_x < 0) { // Origin/Left to Left
-            auto left = _gestures.find(Left);
-            if (left != _gestures.end() && left->second)
-                left->second->move((int16_t) -x);
-        } else if (new_x > 0) { // Origin/Right to Right
-            auto right = _gestures.find(Right);
-            if (right != _gestures.end() && right->second)
-                right->second->move(x);
-        }
+void GestureAction::_moveAxis(Direction negative, Direction positive,
+                              int32_t& axis, int16_t delta) {
+    const int32_t old_axis = axis;
+    axis += delta;
+
+    /* Branches on the side the axis is on rather than on the sign of the
+     * delta, which stays the same across events and predicts well */
+    if (old_axis < 0 && axis >= 0) { // Negative -> Origin/Positive
+        _moveGesture(negative, old_axis);
+        _moveGesture(positive, axis);
+    } else if (old_axis > 0 && axis <= 0) { // Positive -> Origin/Negative
+        _moveGesture(positive, -old_axis);
+        _moveGesture(negative, -axis);
+    } else if (axis < 0) { // Origin/Negative -> Negative
+        _moveGesture(negative, -delta);
+    } else if (axis > 0) { // Origin/Positive -> Positive
+        _moveGesture(positive, delta);
     }
+}
 
-    if (abs(y) > 0) {
-        if (_y > 0 && new_y <= 0) { // Up -> Origin/Down
-            auto up = _gestures.find(Up);
-            if (up != _gestures.end() && up->second)
-                up->second->move((int16_t) _y);
-            if (new_y) { // Ignore to origin
-                auto down = _gestures.find(Down);
-                if (down != _gestures.end() && down->second)
-                    down->second->move((int16_t) new_y);
-            }
-        } else if (_y < 0 && new_y >= 0) { // Down -> Origin/Up
-            auto down = _gestures.find(Down);
-            if (down != _gestures.end() && down->second)
-                down->second->move((int16_t) -_y);
-            if (new_y) { // Ignore to origin
-                auto up = _gestures.find(Up);
-                if (up != _gestures.end() && up->second)
-                    up->second->move((int16_t) -new_y);
-            }
-        } else if (new_y < 0) { // Origin/Up to Up
-            auto up = _gestures.find(Up);
-            if (up != _gestures.end() && up->second)
-                up->second->move((int16_t) -y);
-        } else if (new_y > 0) {// Origin/Down to Down
-            auto down = _gestures.find(Down);
-            if (down != _gestures.end() && down->second)
-                down->second->move(y);
-        }
-    }
+void GestureAction::_moveGesture(Direction direction, int32_t move) {
+    // Moves to the origin are ignored
+    if (move && (_bound & (1 << direction)))
+        _gestures[direction]->move((int16_t) move);
+}
 
-    _x = new_x;
-    _y = new_y;
+void GestureAction::_setGesture(Direction direction, std::shared_ptr<Gesture> gesture) {
+    if (gesture)
+        _bound |= 1 << direction;
+    else
+        _bound &= ~(1 << direction);
+    _gestures[direction] = std::move(gesture);
 }
 
 uint8_t GestureAction::reprogFlags() const {
@@ -227,29 +199,24 @@ void GestureAction::setGesture(const std::string& direction, const std::string&
 
     Direction d = toDirection(direction);
 
-    auto it = _gestures.find(d);
-
-    if (it != _gestures.end()) {
-        if (pressed()) {
-            auto current = toDirection(_x, _y);
-            if (it->second)
-                it->second->release(current == d);
-        }
+    if (_gestures[d] && pressed()) {
+        auto current = toDirection(_x, _y);
+        _gestures[d]->release(current == d);
     }
 
     auto dir_name = fromDirection(d);
 
     auto& gesture = _config.gestures.value()[dir_name];
 
-    _gestures[d].reset();
+    _setGesture(d, nullptr);
     try {
-        _gestures[d] = Gesture::makeGesture(
+        _setGesture(d, Gesture::makeGesture(
                 _device, type, gesture,
-                _node->make_child(dir_name));
+                _node->make_child(dir_name)));
     } catch (InvalidGesture& e) {
-        _gestures[d] = Gesture::makeGesture(
+        _setGesture(d, Gesture::makeGesture(
                 _device, gesture,
-                _node->make_child(dir_name));
+                _node->make_child(dir_name)));
         throw std::invalid_argument("Invalid gesture type");
     }
 
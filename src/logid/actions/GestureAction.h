@@ -18,7 +18,7 @@
 #ifndef LOGID_ACTION_GESTUREACTION_H
 #define LOGID_ACTION_GESTUREACTION_H
 
-#include <map>
+#include <array>
 #include <actions/Action.h>
 #include <actions/gesture/Gesture.h>
 
@@ -35,6 +35,8 @@ namespace logid::actions {
             Right
         };
 
+        static constexpr std::size_t direction_count = Right + 1;
+
         static Direction toDirection(std::string direction);
 
         static std::string fromDirection(Direction direction);
@@ -56,9 +58,19 @@ namespace logid::actions {
                         const std::string& type);
 
     protected:
+        /* Moves the gestures on either side of one axis, must hold _config_mutex */
+        void _moveAxis(Direction negative, Direction positive, int32_t& axis, int16_t delta);
+
+        void _moveGesture(Direction direction, int32_t move);
+
+        void _setGesture(Direction direction, std::shared_ptr<Gesture> gesture);
+
         int32_t _x{}, _y{};
         std::shared_ptr<ipcgull::node> _node;
-        std::map<Direction, std::shared_ptr<Gesture>> _gestures;
+
+        /* Indexed by direction, _bound has a bit set for each one in use */
+        std::array<std::shared_ptr<Gesture>, direction_count> _gestures;
+        uint8_t _bound{};
         config::GestureAction& _config;
     };
 }
@@ -43,15 +43,17 @@ KeypressAction::KeypressAction(
 void KeypressAction::press() {
     std::shared_lock lock(_config_mutex);
     _pressed = true;
+    auto frame = _device->virtualInput()->frame();
     for (auto& key: _keys)
-        _device->virtualInput()->pressKey(key);
+        frame.pressKey(key);
 }
 
 void KeypressAction::release() {
     std::shared_lock lock(_config_mutex);
     _pressed = false;
+    auto frame = _device->virtualInput()->frame();
     for (auto& key: _keys)
-        _device->virtualInput()->releaseKey(key);
+        frame.releaseKey(key);
 }
 
 void KeypressAction::_setConfig() {
@@ -114,9 +116,11 @@ std::vector<std::string> KeypressAction::getKeys() const {
 
 void KeypressAction::setKeys(const std::vector<std::string>& keys) {
     std::unique_lock lock(_config_mutex);
-    if (_pressed)
+    if (_pressed) {
+        auto frame = _device->virtualInput()->frame();
         for (auto& key: _keys)
-            _device->virtualInput()->releaseKey(key);
+            frame.releaseKey(key);
+    }
     _config.keys = std::list<std::variant<uint, std::string>>();
     auto& config = std::get<std::list<std::variant<uint, std::string>>>(
             _config.keys.value());
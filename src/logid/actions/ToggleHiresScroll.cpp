@@ -41,7 +41,7 @@ ToggleHiresScroll::ToggleHiresScroll(
 void ToggleHiresScroll::press() {
     _pressed = true;
     if (_hires_scroll) {
-        run_task([self_weak = self<ToggleHiresScroll>()]() {
+        _device->strand().run([self_weak = self<ToggleHiresScroll>()]() {
             if (auto self = self_weak.lock()) {
                 auto mode = self->_hires_scroll->getMode();
                 mode ^= backend::hidpp20::HiresScroll::HiRes;
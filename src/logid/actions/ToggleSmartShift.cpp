@@ -19,7 +19,7 @@
 #include <actions/ToggleSmartShift.h>
 #include <Device.h>
 #include <backend/hidpp20/features/ReprogControls.h>
-#include <util/task.h>
+#include <util/async_task.h>
 #include <util/log.h>
 
 using namespace logid::actions;
@@ -41,16 +41,19 @@ ToggleSmartShift::ToggleSmartShift(
 
 void ToggleSmartShift::press() {
     _pressed = true;
-    if (_smartshift) {
-        run_task([self_weak = self<ToggleSmartShift>()]() {
-            if (auto self = self_weak.lock()) {
-                auto status = self->_smartshift->getStatus();
-                status.setActive = true;
-                status.active = !status.active;
-                self->_smartshift->setStatus(status);
-            }
-        });
-    }
+    if (_smartshift)
+        spawn(_toggle(self<ToggleSmartShift>()));
+}
+
+logid::async_task<void> ToggleSmartShift::_toggle(std::weak_ptr<ToggleSmartShift> self_weak) {
+    auto self = self_weak.lock();
+    if (!self)
+        co_return;
+
+    auto status = co_await self->_smartshift->getStatusAsync();
+    status.setActive = true;
+    status.active = !status.active;
+    co_await self->_smartshift->setStatusAsync(status);
 }
 
 void ToggleSmartShift::release() {
@@ -41,6 +41,8 @@ namespace logid::actions {
         [[nodiscard]] uint8_t reprogFlags() const final;
 
     protected:
+        static async_task<void> _toggle(std::weak_ptr<ToggleSmartShift> self_weak);
+
         std::shared_ptr<features::SmartShift> _smartshift;
     };
 }
@@ -107,14 +107,16 @@ void AxisGesture::move(int16_t axis) {
 
         if (low_res_axis != -1) {
             int lowres_movement, hires_movement = (int) move_floor;
-            _device->virtualInput()->moveAxis(_input_axis.value(), hires_movement);
+            // Both axes move in the same frame
+            auto frame = _device->virtualInput()->frame();
+            frame.moveAxis(_input_axis.value(), hires_movement);
             hires_remainder += hires_movement;
             if (abs(hires_remainder) >= 60) {
                 lowres_movement = hires_remainder / 120;
                 if (lowres_movement == 0)
                     lowres_movement = hires_remainder > 0 ? 1 : -1;
                 hires_remainder -= lowres_movement * 120;
-                _device->virtualInput()->moveAxis(low_res_axis, lowres_movement);
+                frame.moveAxis(low_res_axis, lowres_movement);
             }
 
             _hires_remainder = hires_remainder;
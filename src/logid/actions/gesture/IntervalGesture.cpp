@@ -71,7 +71,8 @@ void IntervalGesture::move(int16_t axis) {
         return;
 
     int32_t new_interval_count = (_axis - threshold) / _config.interval.value();
-    if (new_interval_count > _interval_pass_count) {
+    // A single large move may pass several intervals
+    for (auto i = _interval_pass_count; i < new_interval_count; ++i) {
         if (_action) {
             _action->press();
             _action->release();
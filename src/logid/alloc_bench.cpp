@@ -0,0 +1,355 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Counts heap allocations per inbound report, from the transport handing
+ * RawDevice a diverted raw XY report to the feature handler it is meant
+ * for. The same reports also go through a copy of the path as it was when
+ * every stage copied the report into a std::vector.
+ */
+
+#include <backend/hidpp20/Device.h>
+#include <backend/hidpp20/features/ReprogControls.h>
+#include <backend/hidpp/Simulator.h>
+#include <backend/raw/DeviceMonitor.h>
+#include <Configuration.h>
+#include <util/task.h>
+#include <util/log.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <list>
+#include <map>
+#include <new>
+#include <shared_mutex>
+
+using namespace logid;
+using namespace logid::backend;
+using namespace std::chrono;
+
+LogLevel logid::global_loglevel = WARN;
+
+static constexpr std::size_t default_reports = 1000000;
+
+/* Only allocations made by the thread dispatching reports are counted */
+static thread_local bool counting = false;
+static std::size_t allocations = 0;
+
+void* operator new(std::size_t size) {
+    if (counting)
+        ++allocations;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+    /* The simulator, but handing out the handlers RawDevice attaches */
+    class BenchTransport : public hidpp::Simulator {
+    public:
+        void attach(const std::string& path, Handler handler) override {
+            {
+                std::lock_guard lock(_mutex);
+                _handlers[path] = handler;
+            }
+            Simulator::attach(path, std::move(handler));
+        }
+
+        Handler handler(const std::string& path) {
+            std::lock_guard lock(_mutex);
+            return _handlers.at(path);
+        }
+
+    private:
+        std::mutex _mutex;
+        std::map<std::string, Handler> _handlers;
+    };
+
+    class BenchMonitor : public raw::DeviceMonitor {
+    public:
+        explicit BenchMonitor(std::shared_ptr<raw::VirtualTransport> transport) :
+                DeviceMonitor(1, {}, raw::IOBackend::Epoll, std::move(transport)) {
+        }
+
+    protected:
+        void addDevice(std::string) final { }
+
+        void removeDevice(std::string) final { }
+    };
+
+    /* The inbound path as it was, with reports passed around as vectors */
+    namespace baseline {
+        template <class T>
+        class EventHandlerList {
+            typedef std::list<std::pair<typename T::EventHandler, std::atomic_bool>> list_t;
+
+            list_t list;
+            std::shared_mutex mutex;
+            std::shared_mutex add_mutex;
+
+            void cleanup() {
+                std::unique_lock lock(mutex, std::try_to_lock);
+                if (lock.owns_lock()) {
+                    std::list<typename list_t::iterator> to_remove;
+                    for (auto it = list.begin(); it != list.end(); ++it) {
+                        if (!it->second)
+                            to_remove.push_back(it);
+                    }
+
+                    for (auto& it: to_remove)
+                        list.erase(it);
+                }
+            }
+
+        public:
+            void add(typename T::EventHandler handler) {
+                std::unique_lock add_lock(add_mutex);
+                list.emplace_front(std::move(handler), true);
+            }
+
+            template <typename Arg>
+            void run_all(Arg arg) {
+                cleanup();
+                std::shared_lock lock(mutex);
+                std::shared_lock add_lock(add_mutex);
+                for (auto& handler: list) {
+                    add_lock.unlock();
+                    if (handler.second) {
+                        if (handler.first.condition(arg))
+                            handler.first.callback(arg);
+                    }
+                    add_lock.lock();
+                }
+            }
+        };
+
+        class Report {
+        public:
+            explicit Report(const std::vector<uint8_t>& data) : _data(data) {
+                _data.resize(hidpp::Report::HeaderLength + hidpp::LongParamLength);
+
+                switch (_data[hidpp::Offset::Type]) {
+                    case hidpp::Report::Type::Short:
+                        _data.resize(hidpp::Report::HeaderLength +
+                                     hidpp::ShortParamLength);
+                        break;
+                    case hidpp::Report::Type::Long:
+                        _data.resize(hidpp::Report::HeaderLength +
+                                     hidpp::LongParamLength);
+                        break;
+                    default:
+                        throw hidpp::Report::InvalidReportID();
+                }
+            }
+
+            [[nodiscard]] uint8_t feature() const { return _data[hidpp::Offset::Feature]; }
+
+            [[nodiscard]] uint8_t function() const {
+                return (_data[hidpp::Offset::Function] >> 4) & 0x0f;
+            }
+
+            [[nodiscard]] uint8_t swId() const {
+                return _data[hidpp::Offset::Function] & 0x0f;
+            }
+
+            [[nodiscard]] std::vector<uint8_t>::const_iterator paramBegin() const {
+                return _data.begin() + hidpp::Offset::Parameters;
+            }
+
+        private:
+            std::vector<uint8_t> _data;
+        };
+
+        class Device {
+        public:
+            struct EventHandler {
+                std::function<bool(Report&)> condition;
+                std::function<void(Report&)> callback;
+            };
+
+            struct RawEventHandler {
+                std::function<bool(const std::vector<uint8_t>&)> condition;
+                std::function<void(const std::vector<uint8_t>&)> callback;
+            };
+
+            /* Stands in for RawDevice, which kept its own handler list */
+            struct Raw {
+                typedef RawEventHandler EventHandler;
+            };
+
+            explicit Device(hidpp::DeviceIndex index) {
+                _raw_handlers.add(
+                        {[index](const std::vector<uint8_t>& report) -> bool {
+                            return (report[hidpp::Offset::Type] == hidpp::Report::Type::Short ||
+                                    report[hidpp::Offset::Type] == hidpp::Report::Type::Long) &&
+                                   (report[hidpp::Offset::DeviceIndex] == index);
+                        },
+                         [this](const std::vector<uint8_t>& report) {
+                             Report _report(report);
+                             handleEvent(_report);
+                         }});
+            }
+
+            void addEventHandler(EventHandler handler) {
+                _event_handlers.add(std::move(handler));
+            }
+
+            /* RawDevice::_readReports() and _handleEvent() */
+            void readReport(std::span<const uint8_t> buf) {
+                std::vector<uint8_t> report(buf.begin(), buf.end());
+                _raw_handlers.run_all(report);
+            }
+
+        private:
+            void handleEvent(Report& report) {
+                if (responseReport(report))
+                    return;
+
+                _event_handlers.run_all(report);
+            }
+
+            /* Nothing is ever in flight here */
+            bool responseReport(const Report& report) {
+                std::lock_guard lock(_response_mutex);
+                return _sent_sw_id && _sent_sw_id.value() == report.swId();
+            }
+
+            EventHandlerList<Raw> _raw_handlers;
+            EventHandlerList<Device> _event_handlers;
+            std::mutex _response_mutex;
+            std::optional<uint8_t> _sent_sw_id;
+        };
+    }
+
+    struct Result {
+        double allocations;
+        double ns;
+    };
+
+    template <typename Dispatch>
+    Result perReport(const std::vector<hidpp::Report>& reports, Dispatch&& dispatch) {
+        allocations = 0;
+        counting = true;
+        auto start = steady_clock::now();
+        for (auto& report: reports)
+            dispatch(report.rawReport());
+        auto elapsed = duration<double, std::nano>(steady_clock::now() - start);
+        counting = false;
+
+        return {(double) allocations / (double) reports.size(),
+                elapsed.count() / (double) reports.size()};
+    }
+}
+
+int main(int argc, char** argv) {
+    std::size_t report_count = default_reports;
+    if (argc > 1) {
+        try {
+            report_count = std::stoul(argv[1]);
+        } catch (std::exception& e) {
+            fprintf(stderr, "Usage: %s [reports]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    init_workers(defaults::workers);
+
+    auto transport = std::make_shared<BenchTransport>();
+    const auto path = transport->addDevice();
+    auto monitor = raw::DeviceMonitor::make<BenchMonitor>(transport);
+
+    std::shared_ptr<hidpp20::Device> device;
+    try {
+        device = hidpp20::Device::make(path, hidpp::DefaultDevice, monitor,
+                                       defaults::io_timeout);
+    } catch (std::exception& e) {
+        logPrintf(ERROR, "Could not set up the simulated device: %s", e.what());
+        return EXIT_FAILURE;
+    }
+
+    auto reprog = device->findFeature(hidpp20::ReprogControlsV4::ID);
+    if (!reprog) {
+        logPrintf(ERROR, "The simulated device has no ReprogControlsV4");
+        return EXIT_FAILURE;
+    }
+    const uint8_t feature = reprog->index;
+    const uint8_t function = hidpp20::ReprogControls::DivertedRawXYEvent;
+
+    // What a gesture button's handler reads from each report
+    int32_t sum = 0;
+    auto readXY = [&sum](auto params) {
+        sum += (int16_t) (params[0] << 8 | params[1]);
+        sum += (int16_t) (params[2] << 8 | params[3]);
+    };
+
+    auto handler_lock = device->addEventHandler(
+            {{}, [&readXY](hidpp::Report& report) { readXY(report.paramBegin()); },
+             hidpp::Device::eventKey(feature, function)});
+    auto handle = transport->handler(path);
+
+    baseline::Device old_device(hidpp::DefaultDevice);
+    old_device.addEventHandler(
+            {[feature, function](baseline::Report& report) -> bool {
+                return report.feature() == feature && report.function() == function;
+            },
+             [&readXY](baseline::Report& report) { readXY(report.paramBegin()); }});
+
+    std::vector<hidpp::Report> reports;
+    reports.reserve(report_count);
+    for (std::size_t i = 0; i < report_count; ++i) {
+        hidpp::Report report(hidpp::Report::Type::Long, hidpp::DefaultDevice,
+                             feature, function, 0);
+        auto x = (int16_t) (i % 41 - 20), y = (int16_t) (i % 37 - 18);
+        auto params = report.paramBegin();
+        params[0] = x >> 8, params[1] = x & 0xff;
+        params[2] = y >> 8, params[3] = y & 0xff;
+        reports.push_back(report);
+    }
+
+    // Once each to warm up, then the measured runs
+    for (int i = 0; i < 2; ++i) {
+        auto before = perReport(reports, [&old_device](std::span<const uint8_t> report) {
+            old_device.readReport(report);
+        });
+        auto after = perReport(reports, [&handle](std::span<const uint8_t> report) {
+            handle(report);
+        });
+        if (i > 0) {
+            printf("%zu reports (checksum %d)\n", reports.size(), sum);
+            printf("before (vectors): %.2f allocations/report, %.2f ns/report\n",
+                   before.allocations, before.ns);
+            printf("after (spans):    %.2f allocations/report, %.2f ns/report\n",
+                   after.allocations, after.ns);
+        }
+    }
+
+    handler_lock = {};
+    device.reset();
+
+    return EXIT_SUCCESS;
+}
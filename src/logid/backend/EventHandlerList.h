@@ -22,88 +22,160 @@
 
 #include <memory>
 #include <mutex>
-#include <shared_mutex>
-#include <list>
+#include <vector>
 #include <atomic>
+#include <cstdint>
+#include <unordered_map>
 
 template <class T>
 class EventHandlerLock;
 
+/* Handlers with a key only see events that T::eventKey maps to the same
+ * key, found with a single lookup. Handlers without one are checked
+ * against every event. A keyed handler's condition may be empty.
+ *
+ * Handlers are published as immutable snapshots: dispatch loads the
+ * current one and runs it without locking, add and remove copy it.
+ * Replaced snapshots are freed by the first write that finds no dispatch
+ * in progress, so handlers may add or remove handlers themselves. */
 template <class T>
 class EventHandlerList {
+    struct Entry {
+        explicit Entry(typename T::EventHandler h) : handler(std::move(h)) { }
+
+        const typename T::EventHandler handler;
+
+        /* Cleared on removal, for dispatches still on an older snapshot */
+        std::atomic_bool active = true;
+    };
 public:
-    typedef std::list<std::pair<typename T::EventHandler, std::atomic_bool>> list_t;
-    typedef typename list_t::iterator iterator_t;
+    typedef std::shared_ptr<Entry> handle_t;
 private:
-    list_t list;
-    std::shared_mutex mutex;
-    std::shared_mutex add_mutex;
-
-    void cleanup() {
-        std::unique_lock lock(mutex, std::try_to_lock);
-        if (lock.owns_lock()) {
-            std::list<iterator_t> to_remove;
-            for (auto it = list.begin(); it != list.end(); ++it) {
-                if (!it->second)
-                    to_remove.push_back(it);
-            }
+    typedef std::vector<handle_t> bucket_t;
+
+    struct Snapshot {
+        std::unordered_map<uint16_t, bucket_t> keyed;
+        bucket_t unkeyed;
+    };
+
+    class ReadGuard {
+        std::atomic<std::size_t>& _readers;
+    public:
+        explicit ReadGuard(std::atomic<std::size_t>& readers) : _readers(readers) {
+            ++_readers;
+        }
+
+        ReadGuard(const ReadGuard&) = delete;
+
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+        ~ReadGuard() {
+            --_readers;
+        }
+    };
+
+    std::atomic<const Snapshot*> snapshot = new Snapshot();
+    std::atomic<std::size_t> readers = 0;
+
+    std::mutex write_mutex;
+    std::vector<std::unique_ptr<const Snapshot>> retired;
+
+    // Must hold write_mutex
+    void publish(std::unique_ptr<const Snapshot> next) {
+        retired.emplace_back(snapshot.exchange(next.release()));
+
+        // Any dispatch starting after the exchange loads the new snapshot
+        if (readers == 0)
+            retired.clear();
+    }
 
-            for(auto& it : to_remove)
-                list.erase(it);
+    template <typename Arg>
+    static void run(const bucket_t& bucket, Arg& arg) {
+        for (auto& entry : bucket) {
+            if (entry->active) {
+                if (!entry->handler.condition || entry->handler.condition(arg))
+                    entry->handler.callback(arg);
+            }
         }
     }
 public:
-    iterator_t add(typename T::EventHandler handler) {
-        std::unique_lock add_lock(add_mutex);
-        list.emplace_front(std::move(handler), true);
-        return list.begin();
+    EventHandlerList() = default;
+
+    EventHandlerList(const EventHandlerList&) = delete;
+
+    EventHandlerList& operator=(const EventHandlerList&) = delete;
+
+    ~EventHandlerList() {
+        delete snapshot.load();
     }
 
-    void remove(iterator_t iterator) {
-        std::unique_lock lock(mutex, std::try_to_lock);
-        if (lock.owns_lock()) {
-            std::unique_lock add_lock(add_mutex);
-            list.erase(iterator);
+    handle_t add(typename T::EventHandler handler) {
+        const auto key = handler.key;
+        auto entry = std::make_shared<Entry>(std::move(handler));
+
+        std::lock_guard lock(write_mutex);
+        auto next = std::make_unique<Snapshot>(*snapshot.load());
+        auto& bucket = key ? next->keyed[*key] : next->unkeyed;
+        // Newest handlers run first
+        bucket.insert(bucket.begin(), entry);
+        publish(std::move(next));
+
+        return entry;
+    }
+
+    void remove(const handle_t& handle) {
+        handle->active = false;
+
+        std::lock_guard lock(write_mutex);
+        auto next = std::make_unique<Snapshot>(*snapshot.load());
+        const auto& key = handle->handler.key;
+        if (key) {
+            auto it = next->keyed.find(*key);
+            if (it != next->keyed.end()) {
+                std::erase(it->second, handle);
+                if (it->second.empty())
+                    next->keyed.erase(it);
+            }
         } else {
-            iterator->second = false;
+            std::erase(next->unkeyed, handle);
         }
+        publish(std::move(next));
     }
 
     template <typename Arg>
-    void run_all(Arg arg) {
-        cleanup();
-        std::shared_lock lock(mutex);
-        std::shared_lock add_lock(add_mutex);
-        for (auto& handler : list) {
-            add_lock.unlock();
-            if (handler.second) {
-                if (handler.first.condition(arg))
-                    handler.first.callback(arg);
-            }
-            add_lock.lock();
+    void run_all(Arg&& arg) {
+        ReadGuard guard(readers);
+        const auto handlers = snapshot.load();
+
+        if (auto key = T::eventKey(arg)) {
+            auto bucket = handlers->keyed.find(*key);
+            if (bucket != handlers->keyed.end())
+                run(bucket->second, arg);
         }
+
+        run(handlers->unkeyed, arg);
     }
 };
 
 template <class T>
 class EventHandlerLock {
     typedef EventHandlerList<T> list_t;
-    typedef typename list_t::iterator_t iterator_t;
+    typedef typename list_t::handle_t handle_t;
 
     friend T;
 
     std::weak_ptr<list_t> _list;
-    iterator_t _iterator;
+    handle_t _handle;
 
-    EventHandlerLock(const std::shared_ptr<list_t>& list, iterator_t iterator) :
-                     _list (list), _iterator (iterator) {
+    EventHandlerLock(const std::shared_ptr<list_t>& list, handle_t handle) :
+                     _list (list), _handle (std::move(handle)) {
     }
 public:
     EventHandlerLock() = default;
 
     EventHandlerLock(const EventHandlerLock&) = delete;
 
-    EventHandlerLock(EventHandlerLock&& o) noexcept : _list (o._list), _iterator (o._iterator) {
+    EventHandlerLock(EventHandlerLock&& o) noexcept : _list (o._list), _handle (std::move(o._handle)) {
         o._list.reset();
     }
 
@@ -113,12 +185,12 @@ public:
         if (this != &o) {
             if (auto list = _list.lock()) {
                 this->_list.reset();
-                list->remove(_iterator);
+                list->remove(_handle);
             }
 
             this->_list = o._list;
             o._list.reset();
-            this->_iterator = o._iterator;
+            this->_handle = std::move(o._handle);
         }
 
         return *this;
@@ -126,7 +198,7 @@ public:
 
     ~EventHandlerLock() {
         if(auto list = _list.lock())
-            list->remove(_iterator);
+            list->remove(_handle);
     }
 
     [[nodiscard]] bool empty() const noexcept {
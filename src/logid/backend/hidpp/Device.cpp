@@ -52,7 +52,7 @@ Device::InvalidDevice::Reason Device::InvalidDevice::code() const noexcept {
 Device::Device(const std::string& path, DeviceIndex index,
                const std::shared_ptr<raw::DeviceMonitor>& monitor, double timeout) :
         io_timeout(duration_cast<milliseconds>(
-                duration<double, std::milli>(timeout))),
+                duration<double, std::milli>(timeout))), _rtt(io_timeout),
         _raw_device(raw::RawDevice::make(path, monitor)),
         _receiver(nullptr), _path(path), _index(index) {
 }
@@ -60,7 +60,7 @@ Device::Device(const std::string& path, DeviceIndex index,
 Device::Device(std::shared_ptr<raw::RawDevice> raw_device, DeviceIndex index,
                double timeout) :
         io_timeout(duration_cast<milliseconds>(
-                duration<double, std::milli>(timeout))),
+                duration<double, std::milli>(timeout))), _rtt(io_timeout),
         _raw_device(std::move(raw_device)), _receiver(nullptr),
         _path(_raw_device->rawPath()), _index(index) {
 }
@@ -68,7 +68,7 @@ Device::Device(std::shared_ptr<raw::RawDevice> raw_device, DeviceIndex index,
 Device::Device(const std::shared_ptr<hidpp10::Receiver>& receiver,
                hidpp::DeviceConnectionEvent event, double timeout) :
         io_timeout(duration_cast<milliseconds>(
-                duration<double, std::milli>(timeout))),
+                duration<double, std::milli>(timeout))), _rtt(io_timeout),
         _raw_device(receiver->rawDevice()), _receiver(receiver),
         _path(receiver->rawDevice()->rawPath()), _index(event.index) {
     // Device will throw an error soon, just do it now
@@ -84,7 +84,7 @@ Device::Device(const std::shared_ptr<hidpp10::Receiver>& receiver,
 Device::Device(const std::shared_ptr<hidpp10::Receiver>& receiver,
                DeviceIndex index, double timeout) :
         io_timeout(duration_cast<milliseconds>(
-                duration<double, std::milli>(timeout))),
+                duration<double, std::milli>(timeout))), _rtt(io_timeout),
         _raw_device(receiver->rawDevice()),
         _receiver(receiver), _path(receiver->rawDevice()->rawPath()),
         _index(index) {
@@ -118,17 +118,15 @@ void Device::_setupReportsAndInit() {
         throw InvalidDevice(InvalidDevice::VirtualNode);
 
     _raw_handler = _raw_device->addEventHandler(
-            {[index = _index](
-                    const std::vector<uint8_t>& report) -> bool {
-                return (report[Offset::Type] == Report::Type::Short ||
-                        report[Offset::Type] == Report::Type::Long) &&
-                       (report[Offset::DeviceIndex] == index);
+            {[](std::span<const uint8_t> report) -> bool {
+                return report[Offset::Type] == Report::Type::Short ||
+                       report[Offset::Type] == Report::Type::Long;
             },
-             [self_weak = _self](const std::vector<uint8_t>& report) -> void {
+             [self_weak = _self](std::span<const uint8_t> report) -> void {
                  Report _report(report);
                  if(auto self = self_weak.lock())
                      self->handleEvent(_report);
-             }});
+             }, raw::RawDevice::eventKey(_index)});
 
     _init();
 }
@@ -190,31 +188,46 @@ EventHandlerLock<Device> Device::addEventHandler(EventHandler handler) {
     return {_event_handlers, _event_handlers->add(std::move(handler))};
 }
 
+std::optional<uint16_t> Device::eventKey(const Report& report) {
+    return eventKey(report.feature(), report.function());
+}
+
 void Device::handleEvent(Report& report) {
     if (responseReport(report))
         return;
 
+    latency_attach(_latency);
     _event_handlers->run_all(report);
 }
 
 Report Device::sendReport(const Report& report) {
+    return _withRetries([this, &report](milliseconds timeout) {
+        return _sendTransaction(report, timeout);
+    });
+}
+
+Report Device::_sendTransaction(const Report& report, milliseconds timeout) {
     /* Must complete transaction before next send */
     std::lock_guard send_lock(_send_mutex);
     _sent_sub_id = report.subId();
     _sent_address = report.address();
     std::unique_lock lock(_response_mutex);
+    const auto sent = steady_clock::now();
     _sendReport(report);
 
     bool valid = _response_cv.wait_for(
-            lock, io_timeout, [this]() {
+            lock, timeout, [this]() {
                 return _response.has_value();
             });
 
     if (!valid) {
         _sent_sub_id.reset();
+        _rtt.timedOut();
         throw TimeoutError();
     }
 
+    _rtt.sample(steady_clock::now() - sent);
+
     Response response = _response.value();
     _response.reset();
     _sent_sub_id.reset();
@@ -268,6 +281,18 @@ const std::shared_ptr<raw::RawDevice>& Device::rawDevice() const {
     return _raw_device;
 }
 
+logid::latency_tracker& Device::latency() {
+    return _latency;
+}
+
+RttEstimator::Stats Device::timingStats() const {
+    return _rtt.stats();
+}
+
+void Device::setTransaction(Transaction transaction) {
+    _transaction = transaction;
+}
+
 void Device::_sendReport(Report report) {
     reportFixup(report);
     _raw_device->sendReport(report.rawReport());
@@ -22,7 +22,11 @@
 #include <backend/raw/RawDevice.h>
 #include <backend/hidpp/Report.h>
 #include <backend/hidpp/defs.h>
+#include <backend/hidpp/IOTiming.h>
+#include <backend/Error.h>
 #include <backend/EventHandlerList.h>
+#include <util/latency.h>
+#include <atomic>
 #include <optional>
 #include <variant>
 #include <string>
@@ -59,8 +63,11 @@ namespace logid::backend::hidpp {
 
     public:
         struct EventHandler {
-            std::function<bool(Report&)> condition;
-            std::function<void(Report&)> callback;
+            std::function<bool(Report&)> condition = {};
+            std::function<void(Report&)> callback = {};
+
+            /* If set, only reports whose eventKey matches are seen */
+            std::optional<uint16_t> key = {};
         };
 
         class InvalidDevice : std::exception {
@@ -94,6 +101,14 @@ namespace logid::backend::hidpp {
 
         EventHandlerLock<Device> addEventHandler(EventHandler handler);
 
+        /* Reports are dispatched by feature index and function (or, for
+         * HID++ 1.0, sub ID and the address' upper nibble) */
+        static std::optional<uint16_t> eventKey(const Report& report);
+
+        static constexpr uint16_t eventKey(uint8_t feature, uint8_t function) {
+            return static_cast<uint16_t>(feature << 8 | (function & 0x0f));
+        }
+
         virtual Report sendReport(const Report& report);
 
         virtual void sendReportNoACK(const Report& report);
@@ -102,6 +117,14 @@ namespace logid::backend::hidpp {
 
         [[nodiscard]] const std::shared_ptr<raw::RawDevice>& rawDevice() const;
 
+        [[nodiscard]] RttEstimator::Stats timingStats() const;
+
+        /* Input latency of this device's events */
+        [[nodiscard]] latency_tracker& latency();
+
+        /* Selects the retry policy for subsequent requests */
+        void setTransaction(Transaction transaction);
+
         Device(const Device&) = delete;
 
         Device(Device&&) = delete;
@@ -132,7 +155,25 @@ namespace logid::backend::hidpp {
 
         void reportFixup(Report& report) const;
 
+        /* Runs transaction(timeout) under the current retry policy */
+        template<typename F>
+        auto _withRetries(F&& transaction) {
+            const auto policy = retryPolicy(_transaction);
+            for (unsigned int attempt = 0;; ++attempt) {
+                try {
+                    return transaction(_rtt.timeout(policy, attempt));
+                } catch (TimeoutError& e) {
+                    if (attempt >= policy.retries)
+                        throw;
+                    _rtt.retried();
+                }
+            }
+        }
+
+        /* Initial timeout, before any round trip has been measured */
         const std::chrono::milliseconds io_timeout;
+        RttEstimator _rtt;
+        std::atomic<Transaction> _transaction = Transaction::Connect;
         uint8_t supported_reports{};
 
         std::mutex _response_mutex;
@@ -142,6 +183,8 @@ namespace logid::backend::hidpp {
 
         void _init();
 
+        Report _sendTransaction(const Report& report, std::chrono::milliseconds timeout);
+
         std::shared_ptr<raw::RawDevice> _raw_device;
         EventHandlerLock<raw::RawDevice> _raw_handler;
         std::shared_ptr<hidpp10::Receiver> _receiver;
@@ -160,11 +203,18 @@ namespace logid::backend::hidpp {
         std::optional<uint8_t> _sent_sub_id{};
         std::optional<uint8_t> _sent_address{};
 
+        latency_tracker _latency;
+
         std::shared_ptr<EventHandlerList<Device>> _event_handlers;
 
         std::weak_ptr<Device> _self;
 
     protected:
+        template<typename T>
+        [[nodiscard]] std::weak_ptr<T> self() const {
+            return std::static_pointer_cast<T>(_self.lock());
+        }
+
         template<typename T, typename... Args>
         static std::shared_ptr<T> makeDerived(Args... args) {
             auto device = _deviceWrapper<T>::make(std::forward<Args>(args)...);
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <backend/hidpp/IOTiming.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace logid::backend::hidpp;
+using namespace std::chrono;
+
+namespace {
+    std::mutex settings_mutex;
+
+    TimeoutLimits timeout_limits = default_timeout_limits;
+
+    RetryPolicy connect_policy = default_connect_policy;
+    RetryPolicy runtime_policy = default_runtime_policy;
+
+    /* Clock granularity term from RFC 6298 */
+    constexpr microseconds granularity = milliseconds(1);
+}
+
+void logid::backend::hidpp::setTimeoutLimits(TimeoutLimits limits) {
+    std::lock_guard lock(settings_mutex);
+    timeout_limits = limits;
+}
+
+TimeoutLimits logid::backend::hidpp::timeoutLimits() {
+    std::lock_guard lock(settings_mutex);
+    return timeout_limits;
+}
+
+void logid::backend::hidpp::setRetryPolicy(Transaction transaction,
+                                           RetryPolicy policy) {
+    std::lock_guard lock(settings_mutex);
+    if (transaction == Transaction::Connect)
+        connect_policy = policy;
+    else
+        runtime_policy = policy;
+}
+
+RetryPolicy logid::backend::hidpp::retryPolicy(Transaction transaction) {
+    std::lock_guard lock(settings_mutex);
+    return transaction == Transaction::Connect ? connect_policy : runtime_policy;
+}
+
+RttEstimator::RttEstimator(milliseconds initial_timeout) :
+        RttEstimator(initial_timeout, timeoutLimits()) {
+}
+
+RttEstimator::RttEstimator(milliseconds initial_timeout, TimeoutLimits limits) :
+        // The configured timeout is always allowed, even above the limit
+        _min(std::min(limits.min, std::max(limits.max, initial_timeout))),
+        _max(std::max(limits.max, initial_timeout)),
+        _initial(initial_timeout), _timeout(initial_timeout) {
+}
+
+milliseconds RttEstimator::timeout(const RetryPolicy& policy,
+                                   unsigned int attempt) const {
+    std::lock_guard lock(_mutex);
+    auto scale = std::pow(std::max(policy.backoff, 1.0), attempt);
+    auto timeout = std::min(duration_cast<milliseconds>(
+            duration<double, std::milli>(_timeout) * scale), _max);
+
+    // Nothing is left to retry with, don't fail sooner than a fixed timeout
+    if (attempt >= policy.retries)
+        timeout = std::max(timeout, _initial);
+
+    return timeout;
+}
+
+void RttEstimator::sample(steady_clock::duration rtt) {
+    auto r = duration_cast<microseconds>(rtt);
+
+    std::lock_guard lock(_mutex);
+    if (_samples++ == 0) {
+        _srtt = r;
+        _rttvar = r / 2;
+    } else {
+        auto delta = _srtt > r ? _srtt - r : r - _srtt;
+        _rttvar = (3 * _rttvar + delta) / 4;
+        _srtt = (7 * _srtt + r) / 8;
+    }
+
+    auto timeout = _srtt + std::max(granularity, 4 * _rttvar);
+    _timeout = std::clamp(ceil<milliseconds>(timeout), _min, _max);
+}
+
+void RttEstimator::timedOut() {
+    std::lock_guard lock(_mutex);
+    ++_timeouts;
+
+    // Back off until a response gives a new sample (RFC 6298 5.5)
+    _timeout = std::min(2 * _timeout, _max);
+}
+
+void RttEstimator::retried() {
+    std::lock_guard lock(_mutex);
+    ++_retries;
+}
+
+RttEstimator::Stats RttEstimator::stats() const {
+    std::lock_guard lock(_mutex);
+    return {_srtt, _rttvar, _timeout, _samples, _timeouts, _retries};
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LOGID_BACKEND_HIDPP_IOTIMING_H
+#define LOGID_BACKEND_HIDPP_IOTIMING_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace logid::backend::hidpp {
+    enum class Transaction {
+        Connect, /* Requests made while a device is being set up */
+        Runtime
+    };
+
+    struct RetryPolicy {
+        unsigned int retries;
+        /* Multiplies the timeout on every retry */
+        double backoff;
+    };
+
+    struct TimeoutLimits {
+        std::chrono::milliseconds min;
+        std::chrono::milliseconds max;
+    };
+
+    static constexpr TimeoutLimits default_timeout_limits = {
+            std::chrono::milliseconds(100), std::chrono::milliseconds(2000)};
+    static constexpr RetryPolicy default_connect_policy = {2, 2.0};
+    static constexpr RetryPolicy default_runtime_policy = {0, 2.0};
+
+    /* Process-wide settings, meant to be set from the configuration before
+     * any device is opened. */
+    void setTimeoutLimits(TimeoutLimits limits);
+
+    [[nodiscard]] TimeoutLimits timeoutLimits();
+
+    void setRetryPolicy(Transaction transaction, RetryPolicy policy);
+
+    [[nodiscard]] RetryPolicy retryPolicy(Transaction transaction);
+
+    /*
+     * Derives a device's response timeout from a smoothed round-trip time
+     * and its variance, as TCP does for its retransmission timeout
+     * (RFC 6298). Until the first sample the initial timeout is used.
+     * A timeout doubles the current estimate until the next sample.
+     *
+     * The last attempt of a transaction always waits at least the initial
+     * timeout, so a request never gives up sooner than with a fixed one.
+     */
+    class RttEstimator {
+    public:
+        struct Stats {
+            std::chrono::microseconds srtt;
+            std::chrono::microseconds rttvar;
+            std::chrono::milliseconds timeout;
+            uint64_t samples;
+            uint64_t timeouts;
+            uint64_t retries;
+        };
+
+        explicit RttEstimator(std::chrono::milliseconds initial_timeout);
+
+        /* An inverted minimum is lowered to the maximum */
+        RttEstimator(std::chrono::milliseconds initial_timeout, TimeoutLimits limits);
+
+        [[nodiscard]] std::chrono::milliseconds timeout(
+                const RetryPolicy& policy, unsigned int attempt) const;
+
+        void sample(std::chrono::steady_clock::duration rtt);
+
+        void timedOut();
+
+        void retried();
+
+        [[nodiscard]] Stats stats() const;
+
+    private:
+        mutable std::mutex _mutex;
+        const std::chrono::milliseconds _min;
+        const std::chrono::milliseconds _max;
+        const std::chrono::milliseconds _initial;
+
+        std::chrono::microseconds _srtt{};
+        std::chrono::microseconds _rttvar{};
+        std::chrono::milliseconds _timeout;
+
+        uint64_t _samples = 0;
+        uint64_t _timeouts = 0;
+        uint64_t _retries = 0;
+    };
+}
+
+#endif //LOGID_BACKEND_HIDPP_IOTIMING_H
@@ -106,6 +106,15 @@ uint8_t hidpp::getSupportedReports(const std::vector<uint8_t>& report_desc) {
     return ret;
 }
 
+std::vector<uint8_t> hidpp::makeReportDescriptor(uint8_t supported_reports) {
+    std::vector<uint8_t> report_desc;
+    if (supported_reports & ShortReportSupported)
+        report_desc.insert(report_desc.end(), ShortReportDesc.begin(), ShortReportDesc.end());
+    if (supported_reports & LongReportSupported)
+        report_desc.insert(report_desc.end(), LongReportDesc.begin(), LongReportDesc.end());
+    return report_desc;
+}
+
 const char* Report::InvalidReportID::what() const noexcept {
     return "Invalid report ID";
 }
@@ -114,19 +123,19 @@ const char* Report::InvalidReportLength::what() const noexcept {
     return "Invalid report length";
 }
 
-Report::Report(Report::Type type, DeviceIndex device_index,
-               uint8_t sub_id, uint8_t address) {
+std::size_t Report::_lengthOf(Report::Type type) {
     switch (type) {
         case Type::Short:
-            _data.resize(HeaderLength + ShortParamLength);
-            break;
+            return HeaderLength + ShortParamLength;
         case Type::Long:
-            _data.resize(HeaderLength + LongParamLength);
-            break;
+            return HeaderLength + LongParamLength;
         default:
             throw InvalidReportID();
     }
+}
 
+Report::Report(Report::Type type, DeviceIndex device_index,
+               uint8_t sub_id, uint8_t address) : _length(_lengthOf(type)) {
     _data[Offset::Type] = type;
     _data[Offset::DeviceIndex] = device_index;
     _data[Offset::SubID] = sub_id;
@@ -134,21 +143,11 @@ Report::Report(Report::Type type, DeviceIndex device_index,
 }
 
 Report::Report(Report::Type type, DeviceIndex device_index,
-               uint8_t feature_index, uint8_t function, uint8_t sw_id) {
+               uint8_t feature_index, uint8_t function, uint8_t sw_id) :
+        _length(_lengthOf(type)) {
     assert(function <= 0x0f);
     assert(sw_id <= 0x0f);
 
-    switch (type) {
-        case Type::Short:
-            _data.resize(HeaderLength + ShortParamLength);
-            break;
-        case Type::Long:
-            _data.resize(HeaderLength + LongParamLength);
-            break;
-        default:
-            throw InvalidReportID();
-    }
-
     _data[Offset::Type] = type;
     _data[Offset::DeviceIndex] = device_index;
     _data[Offset::Feature] = feature_index;
@@ -156,21 +155,11 @@ Report::Report(Report::Type type, DeviceIndex device_index,
                               (sw_id & 0x0f);
 }
 
-Report::Report(const std::vector<uint8_t>& data) :
-        _data(data) {
-    _data.resize(HeaderLength + LongParamLength);
-
+Report::Report(std::span<const uint8_t> data) {
     // Truncating data is entirely valid here.
-    switch (_data[Offset::Type]) {
-        case Type::Short:
-            _data.resize(HeaderLength + ShortParamLength);
-            break;
-        case Type::Long:
-            _data.resize(HeaderLength + LongParamLength);
-            break;
-        default:
-            throw InvalidReportID();
-    }
+    std::copy_n(data.begin(), std::min(data.size(), MaxDataLength),
+                _data.begin());
+    _length = _lengthOf(static_cast<Report::Type>(_data[Offset::Type]));
 }
 
 Report::Type Report::type() const {
@@ -178,17 +167,12 @@ Report::Type Report::type() const {
 }
 
 void Report::setType(Report::Type type) {
-    switch (type) {
-        case Type::Short:
-            _data.resize(HeaderLength + ShortParamLength);
-            break;
-        case Type::Long:
-            _data.resize(HeaderLength + LongParamLength);
-            break;
-        default:
-            throw InvalidReportID();
-    }
+    auto length = _lengthOf(type);
 
+    // Clear any stale parameters when shrinking or growing the report
+    std::fill(_data.begin() + (std::ptrdiff_t)std::min(length, _length),
+              _data.end(), 0);
+    _length = length;
     _data[Offset::Type] = type;
 }
 
@@ -242,24 +226,24 @@ uint8_t Report::address() const {
     _data[Offset::Address] = address;
 }
 
-std::vector<uint8_t>::iterator Report::paramBegin() {
+Report::iterator Report::paramBegin() {
     return _data.begin() + Offset::Parameters;
 }
 
-std::vector<uint8_t>::iterator Report::paramEnd() {
-    return _data.end();
+Report::iterator Report::paramEnd() {
+    return _data.begin() + (std::ptrdiff_t)_length;
 }
 
-std::vector<uint8_t>::const_iterator Report::paramBegin() const {
+Report::const_iterator Report::paramBegin() const {
     return _data.begin() + Offset::Parameters;
 }
 
-std::vector<uint8_t>::const_iterator Report::paramEnd() const {
-    return _data.end();
+Report::const_iterator Report::paramEnd() const {
+    return _data.begin() + (std::ptrdiff_t)_length;
 }
 
 void Report::setParams(const std::vector<uint8_t>& _params) {
-    assert(_params.size() <= _data.size() - HeaderLength);
+    assert(_params.size() <= _length - HeaderLength);
 
     for (std::size_t i = 0; i < _params.size(); i++)
         _data[Offset::Parameters + i] = _params[i];
@@ -292,6 +276,6 @@ bool Report::isError20(Report::Hidpp20Error& error) const {
     return true;
 }
 
-const std::vector<uint8_t>& Report::rawReport() const {
-    return _data;
+std::span<const uint8_t> Report::rawReport() const {
+    return {_data.data(), _length};
 }
@@ -22,10 +22,15 @@
 #include <backend/raw/RawDevice.h>
 #include <backend/hidpp/defs.h>
 #include <cstdint>
+#include <array>
+#include <span>
 
 namespace logid::backend::hidpp {
     uint8_t getSupportedReports(const std::vector<uint8_t>& report_desc);
 
+    /* A descriptor that only declares the supported HID++ reports */
+    std::vector<uint8_t> makeReportDescriptor(uint8_t supported_reports);
+
     /* Some devices only support a subset of these reports */
     static constexpr uint8_t ShortReportSupported = 1U;
     static constexpr uint8_t LongReportSupported = (1U<<1);
@@ -59,7 +64,11 @@ namespace logid::backend::hidpp {
             [[nodiscard]] const char* what() const noexcept override;
         };
 
-        static constexpr std::size_t MaxDataLength = 20;
+        static constexpr std::size_t HeaderLength = 4;
+        static constexpr std::size_t MaxDataLength = HeaderLength + LongParamLength;
+
+        typedef std::array<uint8_t, MaxDataLength>::iterator iterator;
+        typedef std::array<uint8_t, MaxDataLength>::const_iterator const_iterator;
 
         Report(Report::Type type, DeviceIndex device_index,
                uint8_t sub_id,
@@ -70,7 +79,7 @@ namespace logid::backend::hidpp {
                uint8_t function,
                uint8_t sw_id);
 
-        explicit Report(const std::vector<uint8_t>& data);
+        explicit Report(std::span<const uint8_t> data);
 
         [[nodiscard]] Report::Type type() const;
 
@@ -100,13 +109,13 @@ namespace logid::backend::hidpp {
 
         [[maybe_unused]] void setAddress(uint8_t address);
 
-        [[nodiscard]] std::vector<uint8_t>::iterator paramBegin();
+        [[nodiscard]] iterator paramBegin();
 
-        [[nodiscard]] std::vector<uint8_t>::iterator paramEnd();
+        [[nodiscard]] iterator paramEnd();
 
-        [[nodiscard]] std::vector<uint8_t>::const_iterator paramBegin() const;
+        [[nodiscard]] const_iterator paramBegin() const;
 
-        [[nodiscard]] std::vector<uint8_t>::const_iterator paramEnd() const;
+        [[nodiscard]] const_iterator paramEnd() const;
 
         void setParams(const std::vector<uint8_t>& _params);
 
@@ -124,11 +133,14 @@ namespace logid::backend::hidpp {
 
         bool isError20(Hidpp20Error& error) const;
 
-        [[nodiscard]] const std::vector<uint8_t>& rawReport() const;
+        [[nodiscard]] std::span<const uint8_t> rawReport() const;
 
-        static constexpr std::size_t HeaderLength = 4;
     private:
-        std::vector<uint8_t> _data;
+        static std::size_t _lengthOf(Report::Type type);
+
+        /* Reports are small enough to live inline, keeping them off the heap */
+        std::array<uint8_t, MaxDataLength> _data{};
+        std::size_t _length;
     };
 }
 
@@ -0,0 +1,806 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <backend/hidpp/Simulator.h>
+#include <backend/hidpp/Report.h>
+#include <backend/hidpp10/defs.h>
+#include <backend/hidpp10/Error.h>
+#include <backend/hidpp10/Receiver.h>
+#include <backend/hidpp20/Error.h>
+#include <backend/hidpp20/feature_defs.h>
+#include <backend/hidpp20/features/AdjustableDPI.h>
+#include <backend/hidpp20/features/DeviceName.h>
+#include <backend/hidpp20/features/FeatureSet.h>
+#include <backend/hidpp20/features/HiresScroll.h>
+#include <backend/hidpp20/features/ReprogControls.h>
+#include <backend/hidpp20/features/Root.h>
+#include <backend/hidpp20/features/SmartShift.h>
+#include <backend/hidpp20/features/ThumbWheel.h>
+#include <backend/hidpp20/features/WirelessDeviceStatus.h>
+#include <algorithm>
+#include <optional>
+#include <set>
+
+using namespace logid::backend;
+using namespace logid::backend::hidpp;
+
+namespace {
+    constexpr uint16_t logitech_vid = 0x046d;
+    constexpr uint16_t unifying_pid = 0xc52b;
+    constexpr uint16_t bolt_pid = 0xc548;
+
+    constexpr uint8_t protocol_version[2] = {4, 2};
+
+    constexpr uint16_t min_dpi = 200;
+    constexpr uint16_t max_dpi = 4000;
+    constexpr uint16_t dpi_step = 50;
+
+    struct SimFeature {
+        uint16_t id;
+        uint8_t version;
+    };
+
+    /* The feature table, by index */
+    constexpr SimFeature sim_features[] = {
+            {hidpp20::FeatureID::ROOT,                   0},
+            {hidpp20::FeatureID::FEATURE_SET,            0},
+            {hidpp20::FeatureID::DEVICE_NAME,            0},
+            {hidpp20::FeatureID::WIRELESS_DEVICE_STATUS, 0},
+            {hidpp20::FeatureID::REPROG_CONTROLS_V4,     4},
+            {hidpp20::FeatureID::SMART_SHIFT,            0},
+            {hidpp20::FeatureID::HIRES_SCROLLING_V2,     0},
+            {hidpp20::FeatureID::THUMB_WHEEL,            0},
+            {hidpp20::FeatureID::ADJUSTABLE_DPI,         0},
+    };
+
+    constexpr uint8_t feature_count = std::size(sim_features);
+
+    constexpr uint8_t feature_index(uint16_t id) {
+        for (uint8_t i = 0; i < feature_count; ++i) {
+            if (sim_features[i].id == id)
+                return i;
+        }
+        return 0;
+    }
+
+    Report error10(DeviceIndex index, uint8_t sub_id, uint8_t address, uint8_t code) {
+        Report report(Report::Type::Short, index, hidpp10::ErrorID, sub_id);
+        report.paramBegin()[0] = address;
+        report.paramBegin()[1] = code;
+        return report;
+    }
+}
+
+class Simulator::Device {
+public:
+    Device(std::string name, uint16_t pid, DeviceIndex index) :
+            _name(std::move(name)), _pid(pid), _index(index) {
+        using Reprog = hidpp20::ReprogControls;
+        constexpr uint8_t button = Reprog::MouseButton;
+        constexpr uint8_t divertable = Reprog::TemporaryDivertable |
+                                       Reprog::PersistentlyDivertable | Reprog::ReprogHint;
+
+        _controls = {
+                {0x0050, 0x0038, button,              0},
+                {0x0051, 0x0039, button,              0},
+                {0x0052, 0x003a, button | divertable, 0},
+                {0x0053, 0x003c, button | divertable, 0},
+                {0x0056, 0x003e, button | divertable, 0},
+                {0x00c3, 0x00a9, divertable,          Reprog::RawXY},
+                {0x00c4, 0x00aa, divertable,          0},
+        };
+    }
+
+    [[nodiscard]] const std::string& name() const {
+        return _name;
+    }
+
+    [[nodiscard]] uint16_t pid() const {
+        return _pid;
+    }
+
+    /* The response to a request, HID++ 2.0 errors included */
+    Report request(const Report& request) {
+        Report response(Report::Type::Long, _index, request.feature(),
+                        request.function(), request.swId());
+        try {
+            auto params = _call(request.feature(), request.function(),
+                                std::span<const uint8_t>(request.paramBegin(),
+                                                         request.paramEnd()));
+            params.resize(std::min<std::size_t>(params.size(), LongParamLength));
+            response.setParams(params);
+        } catch (hidpp20::Error& e) {
+            response = Report(Report::Type::Long, _index, hidpp20::ErrorID,
+                              request.feature());
+            response.paramBegin()[0] = request.rawReport()[Offset::Function];
+            response.paramBegin()[1] = e.code();
+        }
+        return response;
+    }
+
+    std::optional<Report> buttons(const std::vector<uint16_t>& cids) {
+        using Reprog = hidpp20::ReprogControls;
+        _pressed.assign(cids.begin(), cids.end());
+
+        std::vector<uint8_t> params;
+        for (auto cid: cids) {
+            auto control = _control(cid);
+            if (control && (control->reporting & (Reprog::TemporaryDiverted |
+                                                 Reprog::PersistentlyDiverted))) {
+                params.push_back(cid >> 8);
+                params.push_back(cid & 0xff);
+            }
+        }
+        params.resize(std::min<std::size_t>(params.size(), 8));
+
+        // An empty event is sent when the last diverted button is released
+        if (params.empty() && !_diverted_held)
+            return {};
+        _diverted_held = !params.empty();
+
+        return _event(feature_index(hidpp20::ReprogControlsV4::ID), Reprog::DivertedButtonEvent, params);
+    }
+
+    std::optional<Report> rawXY(int16_t x, int16_t y) {
+        using Reprog = hidpp20::ReprogControls;
+        bool diverted = std::any_of(_pressed.begin(), _pressed.end(), [this](uint16_t cid) {
+            auto control = _control(cid);
+            return control && (control->reporting & Reprog::RawXYDiverted);
+        });
+        if (!diverted)
+            return {};
+
+        return _event(feature_index(hidpp20::ReprogControlsV4::ID), Reprog::DivertedRawXYEvent,
+                      {uint8_t(x >> 8), uint8_t(x & 0xff), uint8_t(y >> 8), uint8_t(y & 0xff)});
+    }
+
+    std::optional<Report> scroll(int16_t delta) {
+        using Hires = hidpp20::HiresScroll;
+        if (!(_hires_mode & Hires::Target))
+            return {};
+
+        const uint8_t flags = (_hires_mode & Hires::HiRes ? 1 << 4 : 0) | 1;
+        return _event(feature_index(Hires::ID), Hires::WheelMovement,
+                      {flags, uint8_t(delta >> 8), uint8_t(delta & 0xff)});
+    }
+
+    std::optional<Report> thumbWheel(int16_t rotation) {
+        using Wheel = hidpp20::ThumbWheel;
+        if (!_thumb_diverted)
+            return {};
+
+        uint8_t status = Wheel::Active;
+        if (rotation == 0) {
+            status = Wheel::Stop;
+            _thumb_rotating = false;
+        } else if (!_thumb_rotating) {
+            status = Wheel::Start;
+            _thumb_rotating = true;
+        }
+
+        ++_thumb_timestamp;
+        return _event(feature_index(Wheel::ID), Wheel::Event,
+                      {uint8_t(rotation >> 8), uint8_t(rotation & 0xff),
+                       uint8_t(_thumb_timestamp >> 8), uint8_t(_thumb_timestamp & 0xff),
+                       status, 0});
+    }
+
+    Report reconnect() {
+        using Status = hidpp20::WirelessDeviceStatus;
+        return _event(feature_index(Status::ID), Status::StatusBroadcast, {1, 1, 0});
+    }
+
+private:
+    struct Control {
+        uint16_t cid;
+        uint16_t task;
+        uint8_t flags;
+        uint8_t additional_flags;
+        uint8_t reporting = 0;
+        uint16_t remap = 0;
+    };
+
+    Control* _control(uint16_t cid) {
+        auto it = std::find_if(_controls.begin(), _controls.end(),
+                               [cid](const Control& c) { return c.cid == cid; });
+        return it == _controls.end() ? nullptr : &*it;
+    }
+
+    [[nodiscard]] Report _event(uint8_t feature, uint8_t function,
+                                const std::vector<uint8_t>& params) const {
+        Report report(Report::Type::Long, _index, feature, function, 0);
+        report.setParams(params);
+        return report;
+    }
+
+    [[noreturn]] void _fail(uint8_t code) const {
+        throw hidpp20::Error(code, _index);
+    }
+
+    std::vector<uint8_t> _call(uint8_t index, uint8_t function,
+                               std::span<const uint8_t> params) {
+        if (index >= feature_count)
+            _fail(hidpp20::Error::InvalidFeatureIndex);
+
+        switch (sim_features[index].id) {
+            case hidpp20::FeatureID::ROOT:
+                return _root(function, params);
+            case hidpp20::FeatureID::FEATURE_SET:
+                return _featureSet(function, params);
+            case hidpp20::FeatureID::DEVICE_NAME:
+                return _deviceName(function, params);
+            case hidpp20::FeatureID::REPROG_CONTROLS_V4:
+                return _reprogControls(function, params);
+            case hidpp20::FeatureID::SMART_SHIFT:
+                return _smartShift(function, params);
+            case hidpp20::FeatureID::HIRES_SCROLLING_V2:
+                return _hiresScroll(function, params);
+            case hidpp20::FeatureID::THUMB_WHEEL:
+                return _thumbWheel(function, params);
+            case hidpp20::FeatureID::ADJUSTABLE_DPI:
+                return _adjustableDPI(function, params);
+            default:
+                // WirelessDeviceStatus only has events
+                _fail(hidpp20::Error::InvalidFunctionID);
+        }
+    }
+
+    std::vector<uint8_t> _root(uint8_t function, std::span<const uint8_t> params) {
+        switch (function) {
+            case hidpp20::Root::GetFeature: {
+                const uint16_t id = params[0] << 8 | params[1];
+                for (uint8_t i = 0; i < feature_count; ++i) {
+                    if (sim_features[i].id == id)
+                        return {i, 0, sim_features[i].version};
+                }
+                return {0, 0, 0};
+            }
+            case hidpp20::Root::Ping:
+                return {protocol_version[0], protocol_version[1], params[2]};
+            default:
+                _fail(hidpp20::Error::InvalidFunctionID);
+        }
+    }
+
+    std::vector<uint8_t> _featureSet(uint8_t function, std::span<const uint8_t> params) {
+        switch (function) {
+            case hidpp20::FeatureSet::GetFeatureCount:
+                // Root is not counted
+                return {feature_count - 1};
+            case hidpp20::FeatureSet::GetFeature: {
+                if (params[0] >= feature_count)
+                    _fail(hidpp20::Error::OutOfRange);
+                const auto& feature = sim_features[params[0]];
+                return {uint8_t(feature.id >> 8), uint8_t(feature.id & 0xff), 0,
+                        feature.version};
+            }
+            default:
+                _fail(hidpp20::Error::InvalidFunctionID);
+        }
+    }
+
+    std::vector<uint8_t> _deviceName(uint8_t function, std::span<const uint8_t> params) {
+        switch (function) {
+            case hidpp20::DeviceName::GetLength:
+                return {static_cast<uint8_t>(_name.size())};
+            case hidpp20::DeviceName::GetDeviceName: {
+                std::vector<uint8_t> chunk;
+                for (std::size_t i = params[0];
+                     i < _name.size() && chunk.size() < LongParamLength; ++i)
+                    chunk.push_back(_name[i]);
+                return chunk;
+            }
+            default:
+                _fail(hidpp20::Error::InvalidFunctionID);
+        }
+    }
+
+    std::vector<uint8_t> _reprogControls(uint8_t function, std::span<const uint8_t> params) {
+        using Reprog = hidpp20::ReprogControls;
+
+        switch (function) {
+            case Reprog::GetControlCount:
+                return {static_cast<uint8_t>(_controls.size())};
+            case Reprog::GetControlInfo: {
+                if (params[0] >= _controls.size())
+                    _fail(hidpp20::Error::OutOfRange);
+                const auto& c = _controls[params[0]];
+                return {uint8_t(c.cid >> 8), uint8_t(c.cid & 0xff),
+                        uint8_t(c.task >> 8), uint8_t(c.task & 0xff),
+                        c.flags, 0, 0, 0, c.additional_flags};
+            }
+            case Reprog::GetControlReporting:
+            case Reprog::SetControlReporting: {
+                auto c = _control(params[0] << 8 | params[1]);
+                if (!c)
+                    _fail(hidpp20::Error::InvalidArgument);
+
+                if (function == Reprog::SetControlReporting) {
+                    const uint8_t flags = params[2];
+                    auto apply = [c, flags](uint8_t change, uint8_t bit) {
+                        if (flags & change)
+                            c->reporting = (c->reporting & ~bit) | (flags & bit);
+                    };
+                    apply(Reprog::ChangeTemporaryDivert, Reprog::TemporaryDiverted);
+                    apply(Reprog::ChangePersistentDivert, Reprog::PersistentlyDiverted);
+                    apply(Reprog::ChangeRawXYDivert, Reprog::RawXYDiverted);
+
+                    const uint16_t remap = params[3] << 8 | params[4];
+                    if (remap)
+                        c->remap = remap;
+                }
+
+                return {uint8_t(c->cid >> 8), uint8_t(c->cid & 0xff), c->reporting,
+                        uint8_t(c->remap >> 8), uint8_t(c->remap & 0xff)};
+            }
+            default:
+                _fail(hidpp20::Error::InvalidFunctionID);
+        }
+    }
+
+    std::vector<uint8_t> _smartShift(uint8_t function, std::span<const uint8_t> params) {
+        switch (function) {
+            case hidpp20::SmartShift::SetStatus:
+                if (params[0])
+                    _smartshift_mode = params[0];
+                if (params[1])
+                    _smartshift_threshold = params[1];
+                [[fallthrough]];
+            case hidpp20::SmartShift::GetStatus:
+                return {_smartshift_mode, _smartshift_threshold, default_threshold};
+            default:
+                _fail(hidpp20::Error::InvalidFunctionID);
+        }
+    }
+
+    std::vector<uint8_t> _hiresScroll(uint8_t function, std::span<const uint8_t> params) {
+        using Hires = hidpp20::HiresScroll;
+
+        switch (function) {
+            case Hires::GetCapabilities:
+                return {8, Hires::HasRatchet | Hires::Invertible};
+            case Hires::SetMode:
+                _hires_mode = params[0];
+                [[fallthrough]];
+            case Hires::GetMode:
+                return {_hires_mode};
+            case Hires::GetRatchetState:
+                return {1};
+            default:
+                _fail(hidpp20::Error::InvalidFunctionID);
+        }
+    }
+
+    std::vector<uint8_t> _thumbWheel(uint8_t function, std::span<const uint8_t> params) {
+        using Wheel = hidpp20::ThumbWheel;
+
+        switch (function) {
+            case Wheel::GetInfo:
+                return {0, 18, 0, 120, 1,
+                        Wheel::Timestamp | Wheel::Touch | Wheel::Proxy | Wheel::SingleTap,
+                        0, 5};
+            case Wheel::SetReporting:
+                _thumb_diverted = params[0];
+                _thumb_inverted = params[1];
+                [[fallthrough]];
+            case Wheel::GetStatus:
+                return {_thumb_diverted, _thumb_inverted};
+            default:
+                _fail(hidpp20::Error::InvalidFunctionID);
+        }
+    }
+
+    std::vector<uint8_t> _adjustableDPI(uint8_t function, std::span<const uint8_t> params) {
+        using DPI = hidpp20::AdjustableDPI;
+
+        if (function != DPI::GetSensorCount && params[0] != 0)
+            _fail(hidpp20::Error::OutOfRange);
+
+        switch (function) {
+            case DPI::GetSensorCount:
+                return {1};
+            case DPI::GetSensorDPIList:
+                return {0, min_dpi >> 8, min_dpi & 0xff,
+                        0xe0, dpi_step, max_dpi >> 8, max_dpi & 0xff};
+            case DPI::SetSensorDPI: {
+                const uint16_t dpi = params[1] << 8 | params[2];
+                if (dpi < min_dpi || dpi > max_dpi)
+                    _fail(hidpp20::Error::InvalidArgument);
+                _dpi = dpi;
+                return {0, uint8_t(_dpi >> 8), uint8_t(_dpi & 0xff)};
+            }
+            case DPI::GetSensorDPI:
+                return {0, uint8_t(_dpi >> 8), uint8_t(_dpi & 0xff),
+                        uint8_t(default_dpi >> 8), uint8_t(default_dpi & 0xff)};
+            default:
+                _fail(hidpp20::Error::InvalidFunctionID);
+        }
+    }
+
+    static constexpr uint8_t default_threshold = 10;
+    static constexpr uint16_t default_dpi = 1000;
+
+    const std::string _name;
+    const uint16_t _pid;
+    const DeviceIndex _index;
+
+    std::vector<Control> _controls;
+    std::vector<uint16_t> _pressed;
+    bool _diverted_held = false;
+
+    uint8_t _smartshift_mode = 2;
+    uint8_t _smartshift_threshold = default_threshold;
+    uint8_t _hires_mode = 0;
+    bool _thumb_diverted = false;
+    bool _thumb_inverted = false;
+    bool _thumb_rotating = false;
+    uint16_t _thumb_timestamp = 0;
+    uint16_t _dpi = default_dpi;
+};
+
+Simulator::Simulator() : Simulator(Config{}) {
+}
+
+Simulator::Simulator(Config config) : _config(config), _random(config.seed) {
+    _thread = std::thread([this]() { _run(); });
+}
+
+Simulator::~Simulator() noexcept {
+    {
+        std::lock_guard lock(_mutex);
+        _stop = true;
+    }
+    _cv.notify_all();
+    _thread.join();
+}
+
+std::string Simulator::_addNode(raw::TraceDevice info) {
+    std::lock_guard lock(_mutex);
+    info.path = "/sim/hidraw" + std::to_string(_next_node++);
+    auto path = info.path;
+    _nodes[path].info = std::move(info);
+    return path;
+}
+
+std::string Simulator::addDevice(const std::string& name, uint16_t pid) {
+    auto path = _addNode({"", name, logitech_vid, pid, raw::RawDevice::USB, false});
+
+    std::lock_guard lock(_mutex);
+    _nodes[path].devices.emplace(DefaultDevice,
+                                 std::make_unique<Device>(name, pid, DefaultDevice));
+    return path;
+}
+
+std::string Simulator::addReceiver(bool bolt) {
+    auto path = _addNode({"", bolt ? "Logitech Bolt Receiver" : "Logitech USB Receiver",
+                          logitech_vid, bolt ? bolt_pid : unifying_pid,
+                          raw::RawDevice::USB, false});
+
+    std::lock_guard lock(_mutex);
+    _nodes[path].bolt = bolt;
+    return path;
+}
+
+DeviceIndex Simulator::pair(const std::string& receiver, const std::string& name,
+                            uint16_t pid) {
+    std::lock_guard lock(_mutex);
+    auto& node = _node(receiver);
+
+    for (uint8_t i = WirelessDevice1; i <= WirelessDevice6; ++i) {
+        if (node.devices.count(i))
+            continue;
+
+        auto index = static_cast<DeviceIndex>(i);
+        node.devices.emplace(i, std::make_unique<Device>(name, pid, index));
+        _connectionEvent(node, index, true);
+        return index;
+    }
+
+    throw std::runtime_error("receiver is full");
+}
+
+void Simulator::unpair(const std::string& receiver, DeviceIndex index) {
+    std::lock_guard lock(_mutex);
+    auto& node = _node(receiver);
+    if (node.devices.erase(index))
+        _connectionEvent(node, index, false);
+}
+
+void Simulator::pressButtons(const std::string& path, DeviceIndex index,
+                             const std::vector<uint16_t>& cids) {
+    std::lock_guard lock(_mutex);
+    if (auto event = _device(path, index).buttons(cids))
+        _queue(path, _node(path), event->rawReport());
+}
+
+void Simulator::moveRawXY(const std::string& path, DeviceIndex index, int16_t x, int16_t y) {
+    std::lock_guard lock(_mutex);
+    if (auto event = _device(path, index).rawXY(x, y))
+        _queue(path, _node(path), event->rawReport());
+}
+
+void Simulator::scroll(const std::string& path, DeviceIndex index, int16_t delta) {
+    std::lock_guard lock(_mutex);
+    if (auto event = _device(path, index).scroll(delta))
+        _queue(path, _node(path), event->rawReport());
+}
+
+void Simulator::rotateThumbWheel(const std::string& path, DeviceIndex index,
+                                 int16_t rotation) {
+    std::lock_guard lock(_mutex);
+    if (auto event = _device(path, index).thumbWheel(rotation))
+        _queue(path, _node(path), event->rawReport());
+}
+
+void Simulator::reconnect(const std::string& path, DeviceIndex index) {
+    std::lock_guard lock(_mutex);
+    _queue(path, _node(path), _device(path, index).reconnect().rawReport());
+}
+
+std::vector<std::string> Simulator::devices() const {
+    std::lock_guard lock(_mutex);
+    std::vector<std::string> paths;
+    for (auto& node: _nodes)
+        paths.push_back(node.first);
+    return paths;
+}
+
+raw::TraceDevice Simulator::info(const std::string& path) const {
+    std::lock_guard lock(_mutex);
+    return _nodes.at(path).info;
+}
+
+std::vector<uint8_t> Simulator::reportDescriptor(const std::string& path) const {
+    (void) info(path);
+    return makeReportDescriptor(ShortReportSupported | LongReportSupported);
+}
+
+void Simulator::attach(const std::string& path, Handler handler) {
+    std::lock_guard lock(_mutex);
+    _node(path).handler = std::move(handler);
+}
+
+void Simulator::detach(const std::string& path) noexcept {
+    std::lock_guard lock(_mutex);
+    auto it = _nodes.find(path);
+    if (it != _nodes.end())
+        it->second.handler = {};
+}
+
+void Simulator::sendReport(const std::string& path, std::span<const uint8_t> report) {
+    if (report.size() < Report::HeaderLength ||
+        (report[Offset::Type] != Report::Type::Short &&
+         report[Offset::Type] != Report::Type::Long))
+        return;
+
+    std::lock_guard lock(_mutex);
+    auto& node = _node(path);
+    const Report request(report);
+
+    if (node.info.pid == unifying_pid || node.info.pid == bolt_pid) {
+        if (request.deviceIndex() == DefaultDevice) {
+            _receiverRequest(node, report);
+            return;
+        }
+
+        auto it = node.devices.find(request.deviceIndex());
+        if (it == node.devices.end()) {
+            _queue(path, node, error10(request.deviceIndex(), request.subId(),
+                                       request.address(),
+                                       hidpp10::Error::UnknownDevice).rawReport());
+            return;
+        }
+        _queue(path, node, it->second->request(request).rawReport());
+    } else {
+        // Corded devices ignore other indexes
+        auto it = node.devices.find(request.deviceIndex());
+        if (it != node.devices.end())
+            _queue(path, node, it->second->request(request).rawReport());
+    }
+}
+
+void Simulator::_receiverRequest(Node& node, std::span<const uint8_t> data) {
+    using Receiver = hidpp10::Receiver;
+
+    const Report request(data);
+    const auto& path = node.info.path;
+    const uint8_t sub_id = request.subId();
+    const uint8_t reg = request.address();
+    auto params = request.paramBegin();
+
+    auto fail = [&](uint8_t code) {
+        _queue(path, node, error10(DefaultDevice, sub_id, reg, code).rawReport());
+    };
+
+    auto respond = [&](const std::vector<uint8_t>& response) {
+        const bool is_long = sub_id == hidpp10::GetRegisterLong;
+        Report report(is_long ? Report::Type::Long : Report::Type::Short,
+                      DefaultDevice, sub_id, reg);
+        report.setParams(response);
+        _queue(path, node, report.rawReport());
+    };
+
+    if (sub_id < hidpp10::SetRegisterShort || sub_id > hidpp10::GetRegisterLong) {
+        fail(hidpp10::Error::InvalidSubID);
+        return;
+    }
+
+    const bool set = sub_id == hidpp10::SetRegisterShort ||
+                     sub_id == hidpp10::SetRegisterLong;
+
+    switch (reg) {
+        case Receiver::EnableHidppNotifications:
+            if (set)
+                std::copy_n(params, node.notifications.size(), node.notifications.begin());
+            respond(set ? std::vector<uint8_t>() :
+                    std::vector<uint8_t>(node.notifications.begin(),
+                                         node.notifications.end()));
+            return;
+        case Receiver::ConnectionState:
+            if (!set) {
+                respond({static_cast<uint8_t>(node.devices.size())});
+                return;
+            }
+            respond({});
+            // Asks the receiver to announce every connected device
+            if (params[0] == 2) {
+                for (auto& device: node.devices)
+                    _connectionEvent(node, static_cast<DeviceIndex>(device.first), true);
+            }
+            return;
+        case Receiver::DevicePairing:
+        case Receiver::BoltDevicePairing: {
+            const uint8_t disconnect = node.bolt ? 3 : 2;
+            if (set && params[0] == disconnect && params[1] != DefaultDevice) {
+                if (node.devices.erase(params[1]))
+                    _connectionEvent(node, static_cast<DeviceIndex>(params[1]), false);
+            }
+            respond({});
+            return;
+        }
+        case Receiver::BoltDeviceDiscovery:
+            respond({});
+            return;
+        case Receiver::DeviceActivity:
+            respond(std::vector<uint8_t>(LongParamLength));
+            return;
+        case Receiver::PairingInfo:
+            break;
+        default:
+            fail(hidpp10::Error::InvalidAddress);
+            return;
+    }
+
+    /* Pairing info sub-registers. Unifying uses 0x2N, 0x3N and 0x4N for
+     * slot N+1; Bolt uses 0x5N and 0x6N for slot N. */
+    const uint8_t sub_reg = params[0];
+    const uint8_t kind = sub_reg & 0xf0;
+    const uint8_t slot = node.bolt ? sub_reg & 0x0f : (sub_reg & 0x0f) + 1;
+
+    auto device = node.devices.find(slot);
+    if (set || device == node.devices.end()) {
+        fail(hidpp10::Error::InvalidValue);
+        return;
+    }
+
+    const auto pid = device->second->pid();
+    const auto& name = device->second->name();
+    std::vector<uint8_t> response{sub_reg};
+
+    if (!node.bolt && kind == 0x20) {
+        response.insert(response.end(), {0, 8, uint8_t(pid >> 8), uint8_t(pid & 0xff),
+                                         0, 0, DeviceMouse});
+    } else if (!node.bolt && kind == 0x30) {
+        response.insert(response.end(), {slot, 0, 0, 0, 0x1a, 0x40, 0, 0});
+    } else if (!node.bolt && kind == 0x40) {
+        response.push_back(static_cast<uint8_t>(name.size()));
+        response.insert(response.end(), name.begin(), name.begin() + (std::ptrdiff_t)
+                std::min<std::size_t>(name.size(), LongParamLength - 2));
+    } else if (node.bolt && kind == 0x50) {
+        response.insert(response.end(), {DeviceMouse, uint8_t(pid & 0xff), uint8_t(pid >> 8),
+                                         slot, 0, 0, 0, 0x1a, 0x40, 0, 0, 0});
+    } else if (node.bolt && kind == 0x60) {
+        // Names are sent 13 bytes at a time, parts count from 1
+        const std::size_t chunk = LongParamLength - 3;
+        const std::size_t offset = (std::max<uint8_t>(params[1], 1) - 1) * chunk;
+        response.push_back(params[1]);
+        response.push_back(static_cast<uint8_t>(name.size()));
+        for (std::size_t i = offset; i < name.size() && i < offset + chunk; ++i)
+            response.push_back(name[i]);
+    } else {
+        fail(hidpp10::Error::InvalidValue);
+        return;
+    }
+
+    respond(response);
+}
+
+void Simulator::_connectionEvent(Node& node, DeviceIndex index, bool connected) {
+    if (!connected) {
+        Report report(Report::Type::Short, index, hidpp10::Receiver::DeviceDisconnection, 2);
+        _queue(node.info.path, node, report.rawReport());
+        return;
+    }
+
+    const auto pid = node.devices.at(index)->pid();
+    Report report(Report::Type::Short, index, hidpp10::Receiver::DeviceConnection,
+                  node.bolt ? 0x10 : 0x04);
+    report.setParams({DeviceMouse, uint8_t(pid & 0xff), uint8_t(pid >> 8)});
+    _queue(node.info.path, node, report.rawReport());
+}
+
+Simulator::Node& Simulator::_node(const std::string& path) {
+    auto it = _nodes.find(path);
+    if (it == _nodes.end())
+        throw std::invalid_argument("unknown simulated device " + path);
+    return it->second;
+}
+
+Simulator::Device& Simulator::_device(const std::string& path, DeviceIndex index) {
+    auto& node = _node(path);
+    auto it = node.devices.find(index);
+    if (it == node.devices.end())
+        throw std::invalid_argument("no simulated device at index " + std::to_string(index));
+    return *it->second;
+}
+
+void Simulator::_queue(const std::string& path, Node& node, std::span<const uint8_t> report) {
+    auto delay = std::chrono::duration_cast<clock::duration>(_config.latency);
+    if (_config.jitter.count() > 0) {
+        std::uniform_int_distribution<int64_t> jitter(-_config.jitter.count(),
+                                                      _config.jitter.count());
+        delay += std::chrono::microseconds(jitter(_random));
+    }
+
+    // A device answers in order, whatever the jitter
+    auto due = std::max(clock::now() + std::max(delay, clock::duration::zero()),
+                        node.last_due);
+    node.last_due = due;
+
+    _deliveries.push({due, _delivery_order++, path, {report.begin(), report.end()}});
+    _cv.notify_all();
+}
+
+void Simulator::_run() {
+    std::unique_lock lock(_mutex);
+
+    while (!_stop) {
+        if (_deliveries.empty()) {
+            _cv.wait(lock);
+            continue;
+        }
+
+        // The queue may reallocate while waiting, copy the time point
+        const auto due = _deliveries.top().due;
+        if (due > clock::now()) {
+            _cv.wait_until(lock, due);
+            continue;
+        }
+
+        auto delivery = _deliveries.top();
+        _deliveries.pop();
+
+        auto it = _nodes.find(delivery.path);
+        if (it == _nodes.end() || !it->second.handler)
+            continue;
+
+        auto handler = it->second.handler;
+        lock.unlock();
+        handler(delivery.report);
+        lock.lock();
+    }
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LOGID_BACKEND_HIDPP_SIMULATOR_H
+#define LOGID_BACKEND_HIDPP_SIMULATOR_H
+
+#include <backend/raw/VirtualTransport.h>
+#include <backend/hidpp/defs.h>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+
+namespace logid::backend::hidpp {
+    /*
+     * Simulated HID++ hardware for running the daemon without devices.
+     * Corded devices, and devices paired to a simulated Unifying or Bolt
+     * receiver, implement Root, FeatureSet, DeviceName,
+     * WirelessDeviceStatus, ReprogControls v4, SmartShift, HiresScroll,
+     * ThumbWheel and AdjustableDPI. Like real devices, they only send
+     * events for controls that the host has diverted.
+     */
+    class Simulator : public raw::VirtualTransport {
+    public:
+        struct Config {
+            std::chrono::microseconds latency{1000};
+            /* Each response is delayed by latency +/- up to jitter */
+            std::chrono::microseconds jitter{0};
+            uint32_t seed = 1;
+        };
+
+        Simulator();
+
+        explicit Simulator(Config config);
+
+        Simulator(const Simulator&) = delete;
+
+        Simulator& operator=(const Simulator&) = delete;
+
+        ~Simulator() noexcept override;
+
+        /* Returns the path of the new device */
+        std::string addDevice(const std::string& name = default_name,
+                              uint16_t pid = default_pid);
+
+        std::string addReceiver(bool bolt = false);
+
+        /* Pairs and connects a device in the first free slot */
+        DeviceIndex pair(const std::string& receiver,
+                         const std::string& name = default_name,
+                         uint16_t pid = default_pid);
+
+        void unpair(const std::string& receiver, DeviceIndex index);
+
+        /* Device events. Corded devices use DefaultDevice as their index. */
+        void pressButtons(const std::string& path, DeviceIndex index,
+                          const std::vector<uint16_t>& cids);
+
+        void moveRawXY(const std::string& path, DeviceIndex index, int16_t x, int16_t y);
+
+        void scroll(const std::string& path, DeviceIndex index, int16_t delta);
+
+        void rotateThumbWheel(const std::string& path, DeviceIndex index, int16_t rotation);
+
+        /* A WirelessDeviceStatus broadcast asking for reconfiguration */
+        void reconnect(const std::string& path, DeviceIndex index);
+
+        [[nodiscard]] std::vector<std::string> devices() const override;
+
+        [[nodiscard]] raw::TraceDevice info(const std::string& path) const override;
+
+        [[nodiscard]] std::vector<uint8_t>
+        reportDescriptor(const std::string& path) const override;
+
+        void attach(const std::string& path, Handler handler) override;
+
+        void detach(const std::string& path) noexcept override;
+
+        /* Responses arrive on the simulator thread */
+        void sendReport(const std::string& path, std::span<const uint8_t> report) override;
+
+        static constexpr auto default_name = "Simulated Mouse";
+        static constexpr uint16_t default_pid = 0x4082;
+
+    private:
+        typedef std::chrono::steady_clock clock;
+
+        /* A HID++ 2.0 device, defined in Simulator.cpp */
+        class Device;
+
+        struct Node {
+            raw::TraceDevice info;
+            bool bolt = false;
+            std::array<uint8_t, 3> notifications{};
+
+            /* Corded devices use DefaultDevice, receivers use 1-6 */
+            std::map<uint8_t, std::unique_ptr<Device>> devices;
+
+            Handler handler;
+            clock::time_point last_due;
+        };
+
+        struct Delivery {
+            clock::time_point due;
+            uint64_t order;
+            std::string path;
+            std::vector<uint8_t> report;
+
+            bool operator>(const Delivery& o) const {
+                return due > o.due || (due == o.due && order > o.order);
+            }
+        };
+
+        std::string _addNode(raw::TraceDevice info);
+
+        Node& _node(const std::string& path);
+
+        Device& _device(const std::string& path, DeviceIndex index);
+
+        void _receiverRequest(Node& node, std::span<const uint8_t> request);
+
+        void _connectionEvent(Node& node, DeviceIndex index, bool connected);
+
+        /* Must hold _mutex */
+        void _queue(const std::string& path, Node& node, std::span<const uint8_t> report);
+
+        void _run();
+
+        const Config _config;
+        std::mt19937 _random;
+
+        std::map<std::string, Node> _nodes;
+        unsigned int _next_node = 0;
+
+        mutable std::mutex _mutex;
+        std::condition_variable _cv;
+        std::priority_queue<Delivery, std::vector<Delivery>, std::greater<>> _deliveries;
+        uint64_t _delivery_order = 0;
+        bool _stop = false;
+
+        std::thread _thread;
+    };
+}
+
+#endif //LOGID_BACKEND_HIDPP_SIMULATOR_H
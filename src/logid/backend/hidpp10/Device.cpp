@@ -62,6 +62,13 @@ void Device::ResponseSlot::reset() {
 }
 
 hidpp::Report Device::sendReport(const hidpp::Report& report) {
+    return _withRetries([this, &report](std::chrono::milliseconds timeout) {
+        return _sendTransaction(report, timeout);
+    });
+}
+
+hidpp::Report Device::_sendTransaction(const hidpp::Report& report,
+                                       std::chrono::milliseconds timeout) {
     auto& response_slot = _responses[report.subId() % SubIDCount];
 
     std::unique_lock<std::mutex> lock(_response_mutex);
@@ -70,16 +77,20 @@ hidpp::Report Device::sendReport(const hidpp::Report& report) {
     });
     response_slot.sub_id = report.subId();
 
+    const auto sent = std::chrono::steady_clock::now();
     _sendReport(report);
-    bool valid = _response_cv.wait_for(lock, io_timeout, [&response_slot]() {
+    bool valid = _response_cv.wait_for(lock, timeout, [&response_slot]() {
         return response_slot.response.has_value();
     });
 
     if (!valid) {
         response_slot.reset();
+        _rtt.timedOut();
         throw TimeoutError();
     }
 
+    _rtt.sample(std::chrono::steady_clock::now() - sent);
+
     auto response = response_slot.response.value();
     response_slot.reset();
 
@@ -66,6 +66,9 @@ namespace logid::backend::hidpp10 {
 
         std::array<ResponseSlot, SubIDCount> _responses;
 
+        hidpp::Report _sendTransaction(const hidpp::Report& report,
+                                       std::chrono::milliseconds timeout);
+
         std::vector<uint8_t> accessRegister(
                 uint8_t sub_id, uint8_t address, const std::vector<uint8_t>& params);
 
@@ -35,7 +35,7 @@ ReceiverMonitor::ReceiverMonitor(const std::string& path,
 void ReceiverMonitor::_ready() {
     if (_connect_ev_handler.empty()) {
         _connect_ev_handler = _receiver->rawDevice()->addEventHandler(
-                {[](const std::vector<uint8_t>& report) -> bool {
+                {[](std::span<const uint8_t> report) -> bool {
                     if (report[Offset::Type] == Report::Type::Short ||
                         report[Offset::Type] == Report::Type::Long) {
                         uint8_t sub_id = report[Offset::SubID];
@@ -43,14 +43,16 @@ void ReceiverMonitor::_ready() {
                                 sub_id == Receiver::DeviceDisconnection);
                     }
                     return false;
-                }, [self_weak = _self](const std::vector<uint8_t>& raw) -> void {
-                    /* Running in a new thread prevents deadlocks since the
-                     * receiver may be enumerating.
+                }, [self_weak = _self](std::span<const uint8_t> raw) -> void {
+                    /* Handling this on the I/O thread would deadlock while
+                     * the receiver is enumerating. The receiver's strand
+                     * keeps connections and disconnections in order
+                     * without holding more than one worker.
                      */
                     hidpp::Report report(raw);
 
                     if (auto self = self_weak.lock()) {
-                        run_task([self_weak, report]() {
+                        self->_strand.run([self_weak, report]() {
                             auto self = self_weak.lock();
                             if (!self)
                                 return;
@@ -84,7 +86,7 @@ void ReceiverMonitor::_ready() {
 
                          if (filled) {
                              self->_pair_state = FindingPasskey;
-                             run_task([self_weak, event = self->_discovery_event]() {
+                             self->_strand.run([self_weak, event = self->_discovery_event]() {
                                  if (auto self = self_weak.lock())
                                      self->receiver()->startBoltPairing(event);
                              });
@@ -161,26 +163,27 @@ void ReceiverMonitor::waitForDevice(hidpp::DeviceIndex index) {
     const std::lock_guard lock(_wait_mutex);
     if (!_waiters.count(index)) {
         _waiters.emplace(index, _receiver->rawDevice()->addEventHandler(
-                {[index](const std::vector<uint8_t>& report) -> bool {
+                {[](std::span<const uint8_t> report) -> bool {
                     /* Connection events should be handled by connect_ev_handler */
                     auto sub_id = report[Offset::SubID];
-                    return report[Offset::DeviceIndex] == index &&
-                           sub_id != Receiver::DeviceConnection &&
+                    return sub_id != Receiver::DeviceConnection &&
                            sub_id != Receiver::DeviceDisconnection;
                 },
                  [self_weak = _self, index](
-                         [[maybe_unused]] const std::vector<uint8_t>& report) {
+                         [[maybe_unused]] std::span<const uint8_t> report) {
                      hidpp::DeviceConnectionEvent event{};
                      event.withPayload = false;
                      event.linkEstablished = true;
                      event.index = index;
                      event.fromTimeoutCheck = true;
 
-                     run_task([self_weak, event]() {
-                         if (auto self = self_weak.lock())
-                             self->_addHandler(event);
-                     });
-                 }
+                     if (auto self = self_weak.lock()) {
+                         self->_strand.run([self_weak, event]() {
+                             if (auto self = self_weak.lock())
+                                 self->_addHandler(event);
+                         });
+                     }
+                 }, raw::RawDevice::eventKey(index)
                 }));
     }
 }
@@ -217,6 +220,8 @@ void ReceiverMonitor::_stopPair() {
 }
 
 void ReceiverMonitor::_addHandler(const hidpp::DeviceConnectionEvent& event, int tries) {
+    _add_retries.cancel(event.index);
+
     auto device_path = _receiver->devicePath();
     try {
         addDevice(event);
@@ -231,10 +236,11 @@ void ReceiverMonitor::_addHandler(const hidpp::DeviceConnectionEvent& event, int
             std::chrono::milliseconds wait((1 << tries) * ready_backoff);
             logPrintf(DEBUG, "Failed to add device %s:%d on try %d, backing off for %dms",
                       device_path.c_str(), event.index, tries + 1, wait.count());
-            run_task_after([self_weak = _self, event, tries]() {
-                if (auto self = self_weak.lock())
-                    self->_addHandler(event, tries + 1);
-            }, wait);
+            _add_retries.replace(event.index, _strand.run_after(
+                    [self_weak = _self, event, tries]() {
+                        if (auto self = self_weak.lock())
+                            self->_addHandler(event, tries + 1);
+                    }, wait));
         }
     } catch (std::exception& e) {
         logPrintf(ERROR, "Failed to add device %d to receiver on %s: %s",
@@ -243,6 +249,8 @@ void ReceiverMonitor::_addHandler(const hidpp::DeviceConnectionEvent& event, int
 }
 
 void ReceiverMonitor::_removeHandler(hidpp::DeviceIndex index) {
+    _add_retries.cancel(index);
+
     try {
         removeDevice(index);
     } catch (std::exception& e) {
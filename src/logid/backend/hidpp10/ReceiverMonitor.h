@@ -21,6 +21,7 @@
 
 #include <backend/hidpp10/Receiver.h>
 #include <backend/hidpp/defs.h>
+#include <util/task.h>
 #include <cstdint>
 #include <string>
 
@@ -101,6 +102,12 @@ namespace logid::backend::hidpp10 {
 
         std::weak_ptr<ReceiverMonitor> _self;
 
+        /* Connection events are handled in order, one at a time */
+        strand _strand;
+
+        /* Pending add retries, by device index */
+        keyed_tasks<hidpp::DeviceIndex> _add_retries;
+
         std::mutex _wait_mutex;
         std::map<hidpp::DeviceIndex, EventHandlerLock<raw::RawDevice>> _waiters;
 
@@ -0,0 +1,276 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <backend/hidpp20/CapabilityCache.h>
+#include <backend/hidpp/defs.h>
+#include <util/log.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace logid;
+using namespace logid::backend::hidpp20;
+
+namespace {
+    /*
+     * On-disk layout, native endianness (the cache never leaves the host):
+     *   FileHeader
+     *   FeatureRecord[feature_count]
+     *   ResponseRecord[response_count]
+     * Any size or header mismatch discards the whole file.
+     */
+    constexpr char file_magic[8] = {'L', 'O', 'G', 'I', 'D', 'C', 'A', 'P'};
+    constexpr uint32_t file_version = 1;
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint16_t pid;
+        uint16_t reserved;
+        uint64_t firmware;
+        uint32_t feature_count;
+        uint32_t response_count;
+    };
+
+    struct FeatureRecord {
+        uint16_t feature_id;
+        uint8_t index;
+        uint8_t version;
+        uint8_t flags;
+        uint8_t reserved[3];
+    };
+
+    struct ResponseRecord {
+        uint64_t key;
+        uint8_t length;
+        uint8_t reserved[7];
+        uint8_t data[backend::hidpp::LongParamLength];
+    };
+
+    static_assert(sizeof(FileHeader) == 32);
+    static_assert(sizeof(FeatureRecord) == 8);
+    static_assert(sizeof(ResponseRecord) == 32);
+}
+
+CapabilityCache::CapabilityCache(uint16_t pid, uint64_t firmware) :
+        _pid(pid), _firmware(firmware) {
+    _load();
+}
+
+bool CapabilityCache::hasFeatures() const {
+    std::lock_guard lock(_mutex);
+    return !_features.empty();
+}
+
+std::vector<feature_entry> CapabilityCache::features() const {
+    std::lock_guard lock(_mutex);
+    return _features;
+}
+
+void CapabilityCache::setFeatures(const std::vector<feature_entry>& features) {
+    std::lock_guard lock(_mutex);
+    _features = features;
+    _dirty = true;
+}
+
+std::optional<std::vector<uint8_t>> CapabilityCache::findResponse(
+        uint16_t feature_id, uint8_t function,
+        const std::vector<uint8_t>& params) const {
+    auto key = _responseKey(feature_id, function, params);
+    if (!key)
+        return {};
+
+    std::lock_guard lock(_mutex);
+    auto it = _responses.find(key.value());
+    if (it == _responses.end())
+        return {};
+    return it->second;
+}
+
+void CapabilityCache::addResponse(uint16_t feature_id, uint8_t function,
+                                  const std::vector<uint8_t>& params,
+                                  const std::vector<uint8_t>& response) {
+    auto key = _responseKey(feature_id, function, params);
+    if (!key || response.size() > backend::hidpp::LongParamLength)
+        return;
+
+    std::lock_guard lock(_mutex);
+    auto [it, inserted] = _responses.try_emplace(key.value(), response);
+    if (inserted)
+        _dirty = true;
+}
+
+void CapabilityCache::save() {
+    std::lock_guard lock(_mutex);
+    if (!_dirty)
+        return;
+
+    const std::size_t size = sizeof(FileHeader) +
+                             _features.size() * sizeof(FeatureRecord) +
+                             _responses.size() * sizeof(ResponseRecord);
+
+    if (::mkdir(cache_dir, 0755) && errno != EEXIST) {
+        logPrintf(DEBUG, "Cannot create %s: %s", cache_dir, strerror(errno));
+        return;
+    }
+
+    // Write to a temporary file and rename it so readers never see a partial cache
+    const std::string path = _path();
+    std::string tmp_path = path + ".XXXXXX";
+    int fd = ::mkostemp(tmp_path.data(), O_CLOEXEC);
+    if (fd < 0) {
+        logPrintf(DEBUG, "Cannot write capability cache %s: %s", path.c_str(),
+                  strerror(errno));
+        return;
+    }
+
+    void* map = MAP_FAILED;
+    if (::fchmod(fd, 0644) == 0 && ::ftruncate(fd, (off_t) size) == 0)
+        map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (map == MAP_FAILED) {
+        logPrintf(DEBUG, "Cannot write capability cache %s: %s", path.c_str(),
+                  strerror(errno));
+        ::close(fd);
+        ::unlink(tmp_path.c_str());
+        return;
+    }
+
+    auto data = static_cast<uint8_t*>(map);
+
+    FileHeader header{};
+    std::memcpy(header.magic, file_magic, sizeof(file_magic));
+    header.version = file_version;
+    header.pid = _pid;
+    header.firmware = _firmware;
+    header.feature_count = _features.size();
+    header.response_count = _responses.size();
+    std::memcpy(data, &header, sizeof(header));
+    data += sizeof(header);
+
+    for (auto& feature: _features) {
+        FeatureRecord record{};
+        record.feature_id = feature.feature_id;
+        record.index = feature.index;
+        record.version = feature.version;
+        record.flags = feature.flags;
+        std::memcpy(data, &record, sizeof(record));
+        data += sizeof(record);
+    }
+
+    for (auto& [key, response]: _responses) {
+        ResponseRecord record{};
+        record.key = key;
+        record.length = response.size();
+        std::copy(response.begin(), response.end(), record.data);
+        std::memcpy(data, &record, sizeof(record));
+        data += sizeof(record);
+    }
+
+    ::munmap(map, size);
+    ::close(fd);
+
+    if (::rename(tmp_path.c_str(), path.c_str())) {
+        logPrintf(DEBUG, "Cannot write capability cache %s: %s", path.c_str(),
+                  strerror(errno));
+        ::unlink(tmp_path.c_str());
+        return;
+    }
+
+    _dirty = false;
+}
+
+std::optional<uint64_t> CapabilityCache::_responseKey(
+        uint16_t feature_id, uint8_t function,
+        const std::vector<uint8_t>& params) {
+    if (params.size() > max_params)
+        return {};
+
+    uint64_t key = ((uint64_t) feature_id << 40) | ((uint64_t) function << 32) |
+                   ((uint64_t) params.size() << 24);
+    for (std::size_t i = 0; i < params.size(); ++i)
+        key |= (uint64_t) params[i] << (16 - 8 * i);
+
+    return key;
+}
+
+std::string CapabilityCache::_path() const {
+    char name[32];
+    snprintf(name, sizeof(name), "%04x-%016llx", _pid,
+             (unsigned long long) _firmware);
+    return std::string(cache_dir) + "/" + name;
+}
+
+void CapabilityCache::_load() {
+    int fd = ::open(_path().c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct stat st{};
+    if (::fstat(fd, &st) || (std::size_t) st.st_size < sizeof(FileHeader)) {
+        ::close(fd);
+        return;
+    }
+
+    const auto size = (std::size_t) st.st_size;
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return;
+
+    auto data = static_cast<const uint8_t*>(map);
+
+    FileHeader header{};
+    std::memcpy(&header, data, sizeof(header));
+    data += sizeof(header);
+
+    const std::size_t expected_size = sizeof(FileHeader) +
+            (std::size_t) header.feature_count * sizeof(FeatureRecord) +
+            (std::size_t) header.response_count * sizeof(ResponseRecord);
+
+    if (std::memcmp(header.magic, file_magic, sizeof(file_magic)) != 0 ||
+        header.version != file_version || header.pid != _pid ||
+        header.firmware != _firmware || size != expected_size) {
+        ::munmap(map, size);
+        return;
+    }
+
+    std::lock_guard lock(_mutex);
+    _features.reserve(header.feature_count);
+    for (uint32_t i = 0; i < header.feature_count; ++i) {
+        FeatureRecord record{};
+        std::memcpy(&record, data, sizeof(record));
+        data += sizeof(record);
+        _features.push_back({record.feature_id, record.index,
+                             record.version, record.flags});
+    }
+
+    for (uint32_t i = 0; i < header.response_count; ++i) {
+        ResponseRecord record{};
+        std::memcpy(&record, data, sizeof(record));
+        data += sizeof(record);
+        auto length = std::min<std::size_t>(record.length, sizeof(record.data));
+        _responses.emplace(record.key, std::vector<uint8_t>(
+                record.data, record.data + length));
+    }
+
+    ::munmap(map, size);
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LOGID_BACKEND_HIDPP20_CAPABILITYCACHE_H
+#define LOGID_BACKEND_HIDPP20_CAPABILITYCACHE_H
+
+#include <backend/hidpp20/feature_defs.h>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace logid::backend::hidpp20 {
+    /*
+     * Static device data (feature table and read-only function responses)
+     * persisted per model and firmware version. Entries live in a
+     * memory-mapped file under cache_dir and are only trusted when both
+     * the product ID and firmware key match.
+     */
+    class CapabilityCache {
+    public:
+        static constexpr const char* cache_dir = "/var/cache/logid";
+
+        /* Only functions with up to this many parameters are cached */
+        static constexpr std::size_t max_params = 3;
+
+        CapabilityCache(uint16_t pid, uint64_t firmware);
+
+        [[nodiscard]] bool hasFeatures() const;
+
+        [[nodiscard]] std::vector<feature_entry> features() const;
+
+        void setFeatures(const std::vector<feature_entry>& features);
+
+        [[nodiscard]] std::optional<std::vector<uint8_t>> findResponse(
+                uint16_t feature_id, uint8_t function,
+                const std::vector<uint8_t>& params) const;
+
+        void addResponse(uint16_t feature_id, uint8_t function,
+                         const std::vector<uint8_t>& params,
+                         const std::vector<uint8_t>& response);
+
+        /* Writes the cache out if anything was added since it was loaded */
+        void save();
+
+    private:
+        static std::optional<uint64_t> _responseKey(
+                uint16_t feature_id, uint8_t function,
+                const std::vector<uint8_t>& params);
+
+        [[nodiscard]] std::string _path() const;
+
+        void _load();
+
+        const uint16_t _pid;
+        const uint64_t _firmware;
+
+        mutable std::mutex _mutex;
+        std::vector<feature_entry> _features;
+        std::map<uint64_t, std::vector<uint8_t>> _responses;
+        bool _dirty = false;
+    };
+}
+
+#endif //LOGID_BACKEND_HIDPP20_CAPABILITYCACHE_H
@@ -17,9 +17,14 @@
  */
 
 #include <cassert>
+#include <algorithm>
 #include <backend/hidpp20/Device.h>
 #include <backend/Error.h>
 #include <backend/hidpp10/Receiver.h>
+#include <backend/hidpp20/features/DeviceInformation.h>
+#include <backend/hidpp20/features/FeatureSet.h>
+#include <util/task.h>
+#include <future>
 
 using namespace logid::backend;
 using namespace logid::backend::hidpp20;
@@ -44,76 +49,215 @@ Device::Device(const std::shared_ptr<hidpp10::Receiver>& receiver,
         : hidpp::Device(receiver, index, timeout) {
 }
 
-std::vector<uint8_t> Device::callFunction(uint8_t feature_index,
-                                          uint8_t function, std::vector<uint8_t>& params) {
-    hidpp::Report::Type type;
+Device::~Device() {
+    /* Failing a request resumes its coroutine, which may queue another
+     * before giving up, so keep going until nothing is left. A timeout
+     * would be retried on this device, hence DeviceNotReady. */
+    while (true) {
+        std::vector<ResponseCallback> callbacks;
+        {
+            std::unique_lock<std::mutex> lock(_response_mutex);
+            for (auto& slot: _responses) {
+                if (slot.feature.has_value()) {
+                    callbacks.push_back(std::move(slot.callback));
+                    slot.reset();
+                }
+            }
+
+            for (auto& pending: _pending)
+                callbacks.push_back(std::move(pending.callback));
+            _pending.clear();
+        }
+
+        if (callbacks.empty())
+            break;
+
+        for (auto& callback: callbacks) {
+            if (callback)
+                callback(std::make_exception_ptr(DeviceNotReady()));
+        }
+    }
+}
+
+bool Device::hasFeatureTable() const {
+    return _has_feature_table;
+}
+
+const std::vector<feature_entry>& Device::featureTable() const {
+    return _features;
+}
+
+std::optional<feature_entry> Device::findFeature(uint16_t feature_id) const {
+    auto it = std::lower_bound(_features.begin(), _features.end(), feature_id,
+                               [](const feature_entry& entry, uint16_t id) {
+                                   return entry.feature_id < id;
+                               });
+    if (it == _features.end() || it->feature_id != feature_id)
+        return {};
+    return *it;
+}
+
+bool Device::hasFeature(uint16_t feature_id) const {
+    return findFeature(feature_id).has_value();
+}
+
+std::optional<std::vector<uint8_t>> Device::cachedResponse(
+        uint16_t feature_id, uint8_t function,
+        const std::vector<uint8_t>& params) const {
+    if (!_capabilities)
+        return {};
+    return _capabilities->findResponse(feature_id, function, params);
+}
+
+void Device::cacheResponse(uint16_t feature_id, uint8_t function,
+                           const std::vector<uint8_t>& params,
+                           const std::vector<uint8_t>& response) {
+    if (_capabilities)
+        _capabilities->addResponse(feature_id, function, params, response);
+}
+
+void Device::saveCapabilities() {
+    if (_capabilities)
+        _capabilities->save();
+}
+
+void Device::_loadCapabilities() {
+    // FNV-1a over the model and every firmware entity
+    uint64_t firmware = 0xcbf29ce484222325;
+    auto hash = [&firmware](uint8_t byte) {
+        firmware ^= byte;
+        firmware *= 0x100000001b3;
+    };
+
+    try {
+        DeviceInformation device_info(this);
+        auto info = device_info.getDeviceInfo();
+        for (auto byte: info.modelId)
+            hash(byte);
+        hash(info.extendedModelId);
+
+        std::vector<async_task<DeviceInformation::FirmwareInfo>> requests;
+        for (uint8_t i = 0; i < info.entityCount; ++i)
+            requests.push_back(device_info.getFirmwareInfoAsync(i));
+
+        for (auto& fw: get_all(requests)) {
+            hash(fw.type);
+            for (auto c: fw.prefix)
+                hash(c);
+            hash(fw.number);
+            hash(fw.revision);
+            hash(fw.build >> 8);
+            hash(fw.build & 0xff);
+        }
+    } catch (UnsupportedFeature& e) {
+        // Without a firmware version there is nothing safe to key the cache on
+        return;
+    } catch (Error& e) {
+        return;
+    }
+
+    _capabilities = std::make_shared<CapabilityCache>(pid(), firmware);
+}
 
+void Device::_enumerateFeatures() {
+    if (_capabilities && _capabilities->hasFeatures()) {
+        _features = _capabilities->features();
+        std::sort(_features.begin(), _features.end(),
+                  [](const feature_entry& a, const feature_entry& b) {
+                      return a.feature_id < b.feature_id;
+                  });
+        _has_feature_table = true;
+        return;
+    }
+
+    std::vector<feature_entry> features;
+    try {
+        features = FeatureSet(this).getFeatureEntries();
+    } catch (UnsupportedFeature& e) {
+        // Features will be looked up through Root as they are used
+        return;
+    } catch (Error& e) {
+        return;
+    }
+
+    std::sort(features.begin(), features.end(),
+              [](const feature_entry& a, const feature_entry& b) {
+                  return a.feature_id < b.feature_id;
+              });
+    _features = std::move(features);
+    _has_feature_table = true;
+
+    if (_capabilities)
+        _capabilities->setFeatures(_features);
+}
+
+hidpp::Report::Type Device::_requestType(const std::vector<uint8_t>& params) {
     assert(params.size() <= hidpp::LongParamLength);
     if (params.size() <= hidpp::ShortParamLength)
-        type = hidpp::Report::Type::Short;
+        return hidpp::Report::Type::Short;
     else if (params.size() <= hidpp::LongParamLength)
-        type = hidpp::Report::Type::Long;
+        return hidpp::Report::Type::Long;
     else
         throw hidpp::Report::InvalidReportID();
+}
 
-    hidpp::Report request(type, deviceIndex(), feature_index, function,
-                          hidpp::softwareID);
+std::vector<uint8_t> Device::callFunction(uint8_t feature_index,
+                                          uint8_t function, std::vector<uint8_t>& params) {
+    hidpp::Report request(_requestType(params), deviceIndex(), feature_index,
+                          function, hidpp::softwareID);
     std::copy(params.begin(), params.end(), request.paramBegin());
 
     auto response = this->sendReport(request);
     return {response.paramBegin(), response.paramEnd()};
 }
 
-void Device::callFunctionNoResponse(uint8_t feature_index, uint8_t function,
-                                    std::vector<uint8_t>& params) {
-    hidpp::Report::Type type;
+logid::async_task<std::vector<uint8_t>> Device::callFunctionAsync(
+        uint8_t feature_index, uint8_t function, std::vector<uint8_t> params) {
+    hidpp::Report request(_requestType(params), deviceIndex(), feature_index,
+                          function, hidpp::softwareID);
+    std::copy(params.begin(), params.end(), request.paramBegin());
 
-    assert(params.size() <= hidpp::LongParamLength);
-    if (params.size() <= hidpp::ShortParamLength)
-        type = hidpp::Report::Type::Short;
-    else if (params.size() <= hidpp::LongParamLength)
-        type = hidpp::Report::Type::Long;
-    else
-        throw hidpp::Report::InvalidReportID();
+    auto response = co_await sendReportAsync(request);
+    co_return std::vector<uint8_t>(response.paramBegin(), response.paramEnd());
+}
 
-    hidpp::Report request(type, deviceIndex(), feature_index, function, hidpp::softwareID);
+void Device::callFunctionNoResponse(uint8_t feature_index, uint8_t function,
+                                    std::vector<uint8_t>& params) {
+    hidpp::Report request(_requestType(params), deviceIndex(), feature_index,
+                          function, hidpp::softwareID);
     std::copy(params.begin(), params.end(), request.paramBegin());
 
     this->sendReportNoACK(request);
 }
 
 hidpp::Report Device::sendReport(const hidpp::Report& report) {
-    auto& response_slot = _responses[report.feature() % _responses.size()];
+    return _withRetries([this, &report](std::chrono::milliseconds timeout) {
+        auto response = std::make_shared<std::promise<Response>>();
+        auto future = response->get_future();
 
-    std::unique_lock<std::mutex> response_lock(_response_mutex);
-    _response_cv.wait(response_lock, [&response_slot]() {
-        return !response_slot.feature.has_value();
-    });
-
-    response_slot.feature = report.feature();
+        auto request = _queueRequest(report, [response](Response r) {
+            response->set_value(std::move(r));
+        });
 
-    _sendReport(report);
+        if (future.wait_for(timeout) != std::future_status::ready)
+            _expireRequest(request);
 
-    bool valid = _response_cv.wait_for(
-            response_lock, io_timeout,
-            [&response_slot]() {
-                return response_slot.response.has_value();
-            });
+        return _unwrapResponse(future.get());
+    });
+}
 
-    if (!valid) {
-        response_slot.reset();
-        throw TimeoutError();
-    }
+logid::async_task<hidpp::Report> Device::sendReportAsync(hidpp::Report report) {
+    const auto policy = hidpp::retryPolicy(_transaction);
+    for (unsigned int attempt = 0;; ++attempt) {
+        auto response = co_await ResponseAwaiter(
+                this, report, _rtt.timeout(policy, attempt));
 
-    assert(response_slot.response.has_value());
-    auto response = response_slot.response.value();
-    response_slot.reset();
+        if (attempt < policy.retries && _isTimeout(response)) {
+            _rtt.retried();
+            continue;
+        }
 
-    if (std::holds_alternative<hidpp::Report>(response)) {
-        return std::get<hidpp::Report>(response);
-    } else { // if(std::holds_alternative<Error::ErrorCode>(response))
-        auto error = std::get<hidpp::Report::Hidpp20Error>(response);
-        throw Error(error.error_code, error.device_index);
+        co_return _unwrapResponse(std::move(response));
     }
 }
 
@@ -124,9 +268,8 @@ void Device::sendReportNoACK(const hidpp::Report& report) {
 }
 
 bool Device::responseReport(const hidpp::Report& report) {
-    auto& response_slot = _responses[report.feature() % _responses.size()];
-    std::lock_guard<std::mutex> lock(_response_mutex);
-    uint8_t sw_id, feature;
+    std::unique_lock<std::mutex> lock(_response_mutex);
+    uint8_t sw_id, feature, function;
 
     bool is_error = false;
     hidpp::Report::Hidpp20Error hidpp20_error{};
@@ -134,29 +277,206 @@ bool Device::responseReport(const hidpp::Report& report) {
         is_error = true;
         sw_id = hidpp20_error.software_id;
         feature = hidpp20_error.feature_index;
+        function = hidpp20_error.function;
     } else {
         sw_id = report.swId();
         feature = report.feature();
+        function = report.function();
+    }
+
+    /* Notifications use SW ID 0, which is never assigned to a request */
+    auto& response_slot = _responses[sw_id % _responses.size()];
+    if (!response_slot.feature || response_slot.feature.value() != feature ||
+        response_slot.function != function)
+        return false;
+
+    _rtt.sample(std::chrono::steady_clock::now() - response_slot.sent);
+
+    auto callback = std::move(response_slot.callback);
+    response_slot.reset();
+    _dispatchPending(lock);
+    lock.unlock();
+
+    if (is_error)
+        callback(hidpp20_error);
+    else
+        callback(report);
+
+    return true;
+}
+
+hidpp::Report Device::_unwrapResponse(Response response) {
+    if (std::holds_alternative<hidpp::Report>(response)) {
+        return std::get<hidpp::Report>(response);
+    } else if (std::holds_alternative<hidpp::Report::Hidpp20Error>(response)) {
+        auto error = std::get<hidpp::Report::Hidpp20Error>(response);
+        throw Error(error.error_code, error.device_index);
+    } else {
+        std::rethrow_exception(std::get<std::exception_ptr>(response));
     }
+}
 
-    if (sw_id != hidpp::softwareID)
+bool Device::_isTimeout(const Response& response) {
+    if (!std::holds_alternative<std::exception_ptr>(response))
         return false;
 
-    if (!response_slot.feature || response_slot.feature.value() != feature) {
+    try {
+        std::rethrow_exception(std::get<std::exception_ptr>(response));
+    } catch (TimeoutError& e) {
+        return true;
+    } catch (...) {
         return false;
     }
+}
+
+uint64_t Device::_queueRequest(const hidpp::Report& report,
+                               ResponseCallback callback) {
+    std::unique_lock<std::mutex> lock(_response_mutex);
+    const uint64_t request = ++_last_request;
+    PendingRequest pending{request, report, std::move(callback)};
 
-    if (is_error) {
-        response_slot.response = hidpp20_error;
+    if (auto sw_id = _acquireSwId()) {
+        try {
+            _startRequest(lock, sw_id.value(), std::move(pending));
+        } catch (...) {
+            /* The request never reached the device, give its ID back */
+            _responses[sw_id.value()].reset();
+            _dispatchPending(lock);
+            throw;
+        }
     } else {
-        response_slot.response = report;
+        _pending.push_back(std::move(pending));
     }
 
-    _response_cv.notify_all();
-    return true;
+    return request;
+}
+
+void Device::_expireRequest(uint64_t request) {
+    ResponseCallback callback;
+    {
+        std::unique_lock<std::mutex> lock(_response_mutex);
+        for (auto& slot: _responses) {
+            if (slot.feature.has_value() && slot.request == request) {
+                callback = std::move(slot.callback);
+                slot.reset();
+                _dispatchPending(lock);
+                break;
+            }
+        }
+
+        if (!callback) {
+            for (auto it = _pending.begin(); it != _pending.end(); ++it) {
+                if (it->request == request) {
+                    callback = std::move(it->callback);
+                    _pending.erase(it);
+                    break;
+                }
+            }
+        }
+    }
+
+    // The response may have beaten us here
+    if (callback) {
+        _rtt.timedOut();
+        callback(std::make_exception_ptr(TimeoutError()));
+    }
+}
+
+std::optional<uint8_t> Device::_acquireSwId() {
+    /* Rotate through the ID space so that a late response to a timed out
+     * request is unlikely to be matched to a new one. */
+    for (std::size_t i = 1; i <= _responses.size(); ++i) {
+        uint8_t id = (_last_sw_id + i) % _responses.size();
+        if (id == 0 || id == hidpp::noAckSoftwareID)
+            continue;
+        if (!_responses[id].feature.has_value()) {
+            _last_sw_id = id;
+            return id;
+        }
+    }
+
+    return {};
+}
+
+void Device::_startRequest(std::unique_lock<std::mutex>& lock, uint8_t sw_id,
+                           PendingRequest request) {
+    auto& response_slot = _responses[sw_id];
+    response_slot.feature = request.report.feature();
+    response_slot.function = request.report.function();
+    response_slot.request = request.request;
+    response_slot.callback = std::move(request.callback);
+
+    request.report.setSwId(sw_id);
+    response_slot.sent = std::chrono::steady_clock::now();
+
+    /* Other requests may be sent while this one is being written */
+    lock.unlock();
+    try {
+        _sendReport(request.report);
+    } catch (...) {
+        lock.lock();
+        throw;
+    }
+    lock.lock();
+}
+
+void Device::_dispatchPending(std::unique_lock<std::mutex>& lock) {
+    while (!_pending.empty()) {
+        auto sw_id = _acquireSwId();
+        if (!sw_id)
+            return;
+
+        auto request = std::move(_pending.front());
+        _pending.pop_front();
+
+        try {
+            _startRequest(lock, sw_id.value(), std::move(request));
+        } catch (...) {
+            auto callback = std::move(_responses[sw_id.value()].callback);
+            _responses[sw_id.value()].reset();
+            lock.unlock();
+            if (callback)
+                callback(std::current_exception());
+            lock.lock();
+        }
+    }
+}
+
+Device::ResponseAwaiter::ResponseAwaiter(Device* device,
+                                         const hidpp::Report& report,
+                                         std::chrono::milliseconds timeout) :
+        _device(device), _report(report), _timeout(timeout) {
+}
+
+void Device::ResponseAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    /* The response may resume the coroutine (and destroy this awaiter)
+     * before _queueRequest returns, so only touch locals afterwards. */
+    auto self_weak = _device->self<Device>();
+    auto timeout = _timeout;
+
+    auto request = _device->_queueRequest(
+            _report, [this, handle](Response response) {
+                _response = std::move(response);
+                handle.resume();
+            });
+
+    /* Workers may all be blocked waiting on responses, expire on the timer
+     * thread so that a lost response can never hold them forever */
+    run_timer_after([self_weak, request]() {
+        if (auto self = self_weak.lock())
+            self->_expireRequest(request);
+    }, timeout);
+}
+
+Device::Response Device::ResponseAwaiter::await_resume() {
+    assert(_response.has_value());
+    return std::move(_response.value());
 }
 
 void Device::ResponseSlot::reset() {
-    response.reset();
     feature.reset();
+    function = 0;
+    request = 0;
+    callback = nullptr;
+    sent = {};
 }
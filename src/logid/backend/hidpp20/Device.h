@@ -20,26 +20,59 @@
 #define LOGID_BACKEND_HIDPP20_DEVICE_H
 
 #include <cstdint>
+#include <array>
+#include <list>
 #include <optional>
 #include <variant>
+#include <backend/hidpp20/CapabilityCache.h>
 #include <backend/hidpp20/Error.h>
+#include <backend/hidpp20/feature_defs.h>
 #include <backend/hidpp/Device.h>
+#include <util/async_task.h>
 
 namespace logid::backend::hidpp20 {
     class Device : public hidpp::Device {
     public:
+        /* Fails every queued and in-flight request with DeviceNotReady */
+        ~Device() override;
+
         std::vector<uint8_t> callFunction(uint8_t feature_index,
                                           uint8_t function,
                                           std::vector<uint8_t>& params);
 
+        async_task<std::vector<uint8_t>> callFunctionAsync(uint8_t feature_index,
+                                                           uint8_t function,
+                                                           std::vector<uint8_t> params);
+
         void callFunctionNoResponse(uint8_t feature_index,
                                     uint8_t function,
                                     std::vector<uint8_t>& params);
 
         hidpp::Report sendReport(const hidpp::Report& report) final;
 
+        async_task<hidpp::Report> sendReportAsync(hidpp::Report report);
+
         void sendReportNoACK(const hidpp::Report& report) final;
 
+        [[nodiscard]] bool hasFeatureTable() const;
+
+        [[nodiscard]] const std::vector<feature_entry>& featureTable() const;
+
+        [[nodiscard]] std::optional<feature_entry> findFeature(uint16_t feature_id) const;
+
+        [[nodiscard]] bool hasFeature(uint16_t feature_id) const;
+
+        [[nodiscard]] std::optional<std::vector<uint8_t>> cachedResponse(
+                uint16_t feature_id, uint8_t function,
+                const std::vector<uint8_t>& params) const;
+
+        void cacheResponse(uint16_t feature_id, uint8_t function,
+                           const std::vector<uint8_t>& params,
+                           const std::vector<uint8_t>& response);
+
+        /* Persist capabilities read since connecting, if there are any new ones */
+        void saveCapabilities();
+
     protected:
         Device(const std::string& path, hidpp::DeviceIndex index,
                const std::shared_ptr<raw::DeviceMonitor>& monitor, double timeout);
@@ -56,15 +89,78 @@ namespace logid::backend::hidpp20 {
         bool responseReport(const hidpp::Report& report) final;
 
     private:
-        typedef std::variant<hidpp::Report, hidpp::Report::Hidpp20Error> Response;
+        typedef std::variant<hidpp::Report, hidpp::Report::Hidpp20Error,
+                std::exception_ptr> Response;
+        typedef std::function<void(Response)> ResponseCallback;
+
         struct ResponseSlot {
-            std::optional<Response> response;
             std::optional<uint8_t> feature;
+            uint8_t function{};
+            uint64_t request{};
+            ResponseCallback callback;
+            std::chrono::steady_clock::time_point sent;
             void reset();
         };
 
-        /* Multiplex responses on lower nibble of SubID, ignore upper nibble for space */
+        struct PendingRequest {
+            uint64_t request;
+            hidpp::Report report;
+            ResponseCallback callback;
+        };
+
+        class ResponseAwaiter {
+        public:
+            ResponseAwaiter(Device* device, const hidpp::Report& report,
+                            std::chrono::milliseconds timeout);
+
+            [[nodiscard]] bool await_ready() const noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> handle);
+
+            Response await_resume();
+
+        private:
+            Device* const _device;
+            const hidpp::Report _report;
+            const std::chrono::milliseconds _timeout;
+            std::optional<Response> _response;
+        };
+
+        void _loadCapabilities();
+
+        void _enumerateFeatures();
+
+        static hidpp::Report _unwrapResponse(Response response);
+
+        static bool _isTimeout(const Response& response);
+
+        static hidpp::Report::Type _requestType(const std::vector<uint8_t>& params);
+
+        /* Queues a request, calling back with the response from any thread */
+        uint64_t _queueRequest(const hidpp::Report& report, ResponseCallback callback);
+
+        void _expireRequest(uint64_t request);
+
+        std::optional<uint8_t> _acquireSwId();
+
+        void _startRequest(std::unique_lock<std::mutex>& lock, uint8_t sw_id,
+                           PendingRequest request);
+
+        void _dispatchPending(std::unique_lock<std::mutex>& lock);
+
+        /* Each in-flight request owns a software ID (the lower nibble of the
+         * function byte), so up to 14 requests may be pipelined. IDs 0 and
+         * noAckSoftwareID are never handed out. */
         std::array<ResponseSlot, 16> _responses;
+        std::list<PendingRequest> _pending;
+        uint8_t _last_sw_id = hidpp::softwareID;
+        uint64_t _last_request = 0;
+
+        /* Sorted by feature ID, filled in once before the device is shared */
+        std::vector<feature_entry> _features;
+        bool _has_feature_table = false;
+
+        std::shared_ptr<CapabilityCache> _capabilities;
 
     public:
         template <typename... Args>
@@ -74,9 +170,12 @@ namespace logid::backend::hidpp20 {
             if (std::get<0>(device->version()) < 2)
                 throw std::invalid_argument("not a hid++ 2.0 device");
 
+            device->_loadCapabilities();
+            device->_enumerateFeatures();
+
             return device;
         }
     };
 }
 
-#endif //LOGID_BACKEND_HIDPP20_DEVICE_H
\ No newline at end of file
+#endif //LOGID_BACKEND_HIDPP20_DEVICE_H
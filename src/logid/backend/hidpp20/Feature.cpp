@@ -35,15 +35,45 @@ std::vector<uint8_t> Feature::callFunction(uint8_t function_id,
     return _device->callFunction(_index, function_id, params);
 }
 
+logid::async_task<std::vector<uint8_t>> Feature::callFunctionAsync(
+        uint8_t function_id, std::vector<uint8_t> params) {
+    return _device->callFunctionAsync(_index, function_id, std::move(params));
+}
+
 void Feature::callFunctionNoResponse(uint8_t function_id,
                                      std::vector<uint8_t>& params) {
     _device->callFunctionNoResponse(_index, function_id, params);
 }
 
+std::vector<uint8_t> Feature::callFunctionCached(uint8_t function_id,
+                                                 std::vector<uint8_t>& params) {
+    if (auto cached = _device->cachedResponse(getID(), function_id, params))
+        return cached.value();
+
+    auto response = callFunction(function_id, params);
+    _device->cacheResponse(getID(), function_id, params, response);
+    return response;
+}
+
+logid::async_task<std::vector<uint8_t>> Feature::callFunctionCachedAsync(
+        uint8_t function_id, std::vector<uint8_t> params) {
+    if (auto cached = _device->cachedResponse(getID(), function_id, params))
+        co_return cached.value();
+
+    auto response = co_await callFunctionAsync(function_id, params);
+    _device->cacheResponse(getID(), function_id, params, response);
+    co_return response;
+}
+
 Feature::Feature(Device* dev, uint16_t _id) : _device(dev) {
     _index = hidpp20::FeatureID::ROOT;
 
-    if (_id) {
+    if (_id && dev->hasFeatureTable()) {
+        auto entry = dev->findFeature(_id);
+        if (!entry)
+            throw UnsupportedFeature(_id);
+        _index = entry->index;
+    } else if (_id) {
         std::vector<uint8_t> getFunc_req(2);
         getFunc_req[0] = (_id >> 8) & 0xff;
         getFunc_req[1] = _id & 0xff;
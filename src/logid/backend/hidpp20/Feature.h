@@ -22,6 +22,7 @@
 #include <cstdint>
 #include <exception>
 #include <vector>
+#include <util/async_task.h>
 
 namespace logid::backend::hidpp20 {
     class Device;
@@ -53,8 +54,18 @@ namespace logid::backend::hidpp20 {
 
         std::vector<uint8_t> callFunction(uint8_t function_id, std::vector<uint8_t>& params);
 
+        async_task<std::vector<uint8_t>> callFunctionAsync(uint8_t function_id,
+                                                           std::vector<uint8_t> params);
+
         void callFunctionNoResponse(uint8_t function_id, std::vector<uint8_t>& params);
 
+        /* For read-only functions whose result is fixed for a given firmware */
+        std::vector<uint8_t> callFunctionCached(uint8_t function_id,
+                                                std::vector<uint8_t>& params);
+
+        async_task<std::vector<uint8_t>> callFunctionCachedAsync(
+                uint8_t function_id, std::vector<uint8_t> params);
+
         Device* const _device;
         uint8_t _index;
     };
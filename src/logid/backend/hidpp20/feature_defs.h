@@ -29,6 +29,13 @@ namespace logid::backend::hidpp20 {
         bool hidden;
     };
 
+    struct feature_entry {
+        uint16_t feature_id;
+        uint8_t index;
+        uint8_t version;
+        uint8_t flags;
+    };
+
     namespace FeatureID {
         enum FeatureID : uint16_t {
             ROOT = 0x0000,
@@ -18,21 +18,10 @@
 #include <backend/hidpp20/features/AdjustableDPI.h>
 
 using namespace logid::backend::hidpp20;
+using namespace logid;
 
-AdjustableDPI::AdjustableDPI(Device* dev) : Feature(dev, ID) {
-}
-
-uint8_t AdjustableDPI::getSensorCount() {
-    std::vector<uint8_t> params(0);
-    auto response = callFunction(GetSensorCount, params);
-    return response[0];
-}
-
-AdjustableDPI::SensorDPIList AdjustableDPI::getSensorDPIList(uint8_t sensor) {
-    SensorDPIList dpi_list{};
-    std::vector<uint8_t> params(1);
-    params[0] = sensor;
-    auto response = callFunction(GetSensorDPIList, params);
+static AdjustableDPI::SensorDPIList parseDPIList(const std::vector<uint8_t>& response) {
+    AdjustableDPI::SensorDPIList dpi_list{};
 
     dpi_list.dpiStep = false;
     for (std::size_t i = 1; i < response.size(); i += 2) {
@@ -51,6 +40,36 @@ AdjustableDPI::SensorDPIList AdjustableDPI::getSensorDPIList(uint8_t sensor) {
     return dpi_list;
 }
 
+static uint16_t parseSensorDPI(const std::vector<uint8_t>& response) {
+    uint16_t dpi = response[2];
+    dpi |= (response[1] << 8);
+
+    return dpi;
+}
+
+AdjustableDPI::AdjustableDPI(Device* dev) : Feature(dev, ID) {
+}
+
+uint8_t AdjustableDPI::getSensorCount() {
+    std::vector<uint8_t> params(0);
+    auto response = callFunctionCached(GetSensorCount, params);
+    return response[0];
+}
+
+AdjustableDPI::SensorDPIList AdjustableDPI::getSensorDPIList(uint8_t sensor) {
+    std::vector<uint8_t> params(1);
+    params[0] = sensor;
+    return parseDPIList(callFunctionCached(GetSensorDPIList, params));
+}
+
+async_task<AdjustableDPI::SensorDPIList> AdjustableDPI::getSensorDPIListAsync(
+        uint8_t sensor) {
+    std::vector<uint8_t> params(1);
+    params[0] = sensor;
+    co_return parseDPIList(
+            co_await callFunctionCachedAsync(GetSensorDPIList, params));
+}
+
 uint16_t AdjustableDPI::getDefaultSensorDPI(uint8_t sensor) {
     std::vector<uint8_t> params(1);
     params[0] = sensor;
@@ -65,12 +84,13 @@ uint16_t AdjustableDPI::getDefaultSensorDPI(uint8_t sensor) {
 uint16_t AdjustableDPI::getSensorDPI(uint8_t sensor) {
     std::vector<uint8_t> params(1);
     params[0] = sensor;
-    auto response = callFunction(GetSensorDPI, params);
-
-    uint16_t dpi = response[2];
-    dpi |= (response[1] << 8);
+    return parseSensorDPI(callFunction(GetSensorDPI, params));
+}
 
-    return dpi;
+async_task<uint16_t> AdjustableDPI::getSensorDPIAsync(uint8_t sensor) {
+    std::vector<uint8_t> params(1);
+    params[0] = sensor;
+    co_return parseSensorDPI(co_await callFunctionAsync(GetSensorDPI, params));
 }
 
 void AdjustableDPI::setSensorDPI(uint8_t sensor, uint16_t dpi) {
@@ -79,4 +99,12 @@ void AdjustableDPI::setSensorDPI(uint8_t sensor, uint16_t dpi) {
     params[1] = (dpi >> 8);
     params[2] = (dpi & 0xFF);
     callFunction(SetSensorDPI, params);
-}
\ No newline at end of file
+}
+
+async_task<void> AdjustableDPI::setSensorDPIAsync(uint8_t sensor, uint16_t dpi) {
+    std::vector<uint8_t> params(3);
+    params[0] = sensor;
+    params[1] = (dpi >> 8);
+    params[2] = (dpi & 0xFF);
+    co_await callFunctionAsync(SetSensorDPI, params);
+}
@@ -47,11 +47,17 @@ namespace logid::backend::hidpp20 {
 
         SensorDPIList getSensorDPIList(uint8_t sensor);
 
+        async_task<SensorDPIList> getSensorDPIListAsync(uint8_t sensor);
+
         uint16_t getDefaultSensorDPI(uint8_t sensor);
 
         uint16_t getSensorDPI(uint8_t sensor);
 
+        async_task<uint16_t> getSensorDPIAsync(uint8_t sensor);
+
         void setSensorDPI(uint8_t sensor, uint16_t dpi);
+
+        async_task<void> setSensorDPIAsync(uint8_t sensor, uint16_t dpi);
     };
 }
 
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <backend/hidpp20/features/DeviceInformation.h>
+#include <algorithm>
+
+using namespace logid::backend::hidpp20;
+using namespace logid;
+
+static DeviceInformation::FirmwareInfo parseFirmwareInfo(
+        const std::vector<uint8_t>& response) {
+    DeviceInformation::FirmwareInfo info{};
+
+    info.type = response[0] & 0x0f;
+    for (std::size_t i = 1; i < 4 && response[i]; ++i)
+        info.prefix += (char) response[i];
+    info.number = response[4];
+    info.revision = response[5];
+    info.build = response[7];
+    info.build |= (response[6] << 8);
+
+    return info;
+}
+
+DeviceInformation::DeviceInformation(Device* dev) : Feature(dev, ID) {
+}
+
+DeviceInformation::DeviceInfo DeviceInformation::getDeviceInfo() {
+    std::vector<uint8_t> params(0);
+    auto response = callFunction(GetDeviceInfo, params);
+
+    DeviceInfo info{};
+    info.entityCount = response[0];
+    std::copy(response.begin() + 1, response.begin() + 5,
+              info.unitId.begin());
+    info.transport = response[6];
+    info.transport |= (response[5] << 8);
+    std::copy(response.begin() + 7, response.begin() + 13,
+              info.modelId.begin());
+    info.extendedModelId = response[13];
+    info.capabilities = response[14];
+
+    return info;
+}
+
+DeviceInformation::FirmwareInfo DeviceInformation::getFirmwareInfo(uint8_t entity) {
+    std::vector<uint8_t> params(1);
+    params[0] = entity;
+    return parseFirmwareInfo(callFunction(GetFwInfo, params));
+}
+
+async_task<DeviceInformation::FirmwareInfo> DeviceInformation::getFirmwareInfoAsync(
+        uint8_t entity) {
+    std::vector<uint8_t> params(1);
+    params[0] = entity;
+    co_return parseFirmwareInfo(co_await callFunctionAsync(GetFwInfo, params));
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LOGID_BACKEND_HIDPP20_FEATURE_DEVICEINFORMATION_H
+#define LOGID_BACKEND_HIDPP20_FEATURE_DEVICEINFORMATION_H
+
+#include <backend/hidpp20/Feature.h>
+#include <backend/hidpp20/feature_defs.h>
+#include <array>
+#include <string>
+
+namespace logid::backend::hidpp20 {
+    class DeviceInformation : public Feature {
+    public:
+        static const uint16_t ID = FeatureID::FW_VERSION;
+
+        uint16_t getID() final { return ID; }
+
+        enum Function {
+            GetDeviceInfo = 0,
+            GetFwInfo = 1
+        };
+
+        explicit DeviceInformation(Device* dev);
+
+        struct DeviceInfo {
+            uint8_t entityCount;
+            std::array<uint8_t, 4> unitId;
+            uint16_t transport;
+            std::array<uint8_t, 6> modelId;
+            uint8_t extendedModelId;
+            uint8_t capabilities;
+        };
+
+        struct FirmwareInfo {
+            uint8_t type;
+            std::string prefix;
+            uint8_t number;
+            uint8_t revision;
+            uint16_t build;
+        };
+
+        DeviceInfo getDeviceInfo();
+
+        FirmwareInfo getFirmwareInfo(uint8_t entity);
+
+        async_task<FirmwareInfo> getFirmwareInfoAsync(uint8_t entity);
+    };
+}
+
+#endif //LOGID_BACKEND_HIDPP20_FEATURE_DEVICEINFORMATION_H
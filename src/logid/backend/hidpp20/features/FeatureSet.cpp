@@ -18,6 +18,7 @@
 #include <backend/hidpp20/features/FeatureSet.h>
 
 using namespace logid::backend::hidpp20;
+using namespace logid;
 
 [[maybe_unused]]
 FeatureSet::FeatureSet(Device* device) : Feature(device, ID) {
@@ -46,4 +47,30 @@ std::map<uint8_t, uint16_t> FeatureSet::getFeatures() {
     for (uint8_t i = 0; i < feature_count; i++)
         features[i] = getFeature(i);
     return features;
-}
\ No newline at end of file
+}
+
+async_task<feature_entry> FeatureSet::getFeatureEntryAsync(uint8_t feature_index) {
+    std::vector<uint8_t> params(1);
+    params[0] = feature_index;
+    auto response = co_await callFunctionAsync(GetFeature, params);
+
+    feature_entry entry{};
+    entry.feature_id = (response[0] << 8);
+    entry.feature_id |= response[1];
+    entry.index = feature_index;
+    entry.flags = response[2];
+    entry.version = response[3];
+    co_return entry;
+}
+
+std::vector<feature_entry> FeatureSet::getFeatureEntries() {
+    const uint8_t feature_count = getFeatureCount();
+
+    /* Root is not included in the count but is listed at index 0 */
+    std::vector<async_task<feature_entry>> requests;
+    requests.reserve(feature_count + 1);
+    for (unsigned int i = 0; i <= feature_count; ++i)
+        requests.push_back(getFeatureEntryAsync(i));
+
+    return get_all(requests);
+}
@@ -21,6 +21,7 @@
 #include <backend/hidpp20/Feature.h>
 #include <backend/hidpp20/feature_defs.h>
 #include <map>
+#include <vector>
 
 namespace logid::backend::hidpp20 {
     class FeatureSet : public Feature {
@@ -43,6 +44,11 @@ namespace logid::backend::hidpp20 {
 
         [[maybe_unused]]
         [[nodiscard]] std::map<uint8_t, uint16_t> getFeatures();
+
+        async_task<feature_entry> getFeatureEntryAsync(uint8_t feature_index);
+
+        /* Reads every feature entry, with all requests in flight at once */
+        [[nodiscard]] std::vector<feature_entry> getFeatureEntries();
     };
 }
 
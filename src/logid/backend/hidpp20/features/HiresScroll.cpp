@@ -25,7 +25,7 @@ HiresScroll::HiresScroll(Device* device) : Feature(device, ID) {
 
 HiresScroll::Capabilities HiresScroll::getCapabilities() {
     std::vector<uint8_t> params(0);
-    auto response = callFunction(GetCapabilities, params);
+    auto response = callFunctionCached(GetCapabilities, params);
 
     Capabilities capabilities{};
     capabilities.multiplier = response[0];
@@ -39,6 +39,10 @@ DEFINE_REPROG(ReprogControlsV4, ReprogControlsV3)
 
 template<typename T>
 std::shared_ptr<T> make_reprog(Device* dev) {
+    // No need to probe the device when its feature table is known
+    if (dev->hasFeatureTable() && !dev->hasFeature(T::ID))
+        return {};
+
     try {
         return std::make_shared<T>(dev);
     } catch (UnsupportedFeature& e) {
@@ -62,7 +66,7 @@ std::shared_ptr<ReprogControls> ReprogControls::autoVersion(Device* dev) {
 
 uint8_t ReprogControls::getControlCount() {
     std::vector<uint8_t> params(0);
-    auto response = callFunction(GetControlCount, params);
+    auto response = callFunctionCached(GetControlCount, params);
     return response[0];
 }
 
@@ -70,7 +74,7 @@ ReprogControls::ControlInfo ReprogControls::getControlInfo(uint8_t index) {
     std::vector<uint8_t> params(1);
     ControlInfo info{};
     params[0] = index;
-    auto response = callFunction(GetControlInfo, params);
+    auto response = callFunctionCached(GetControlInfo, params);
 
     info.controlID = response[1];
     info.controlID |= response[0] << 8;
@@ -135,16 +139,21 @@ void ReprogControls::setControlReporting(uint16_t cid, ControlInfo info) {
     (void) info; // Suppress unused warnings
 }
 
-std::set<uint16_t> ReprogControls::divertedButtonEvent(
+logid::async_task<void> ReprogControls::setControlReportingAsync(uint16_t cid, ControlInfo info) {
+    setControlReporting(cid, info);
+    co_return;
+}
+
+ReprogControls::DivertedButtons ReprogControls::divertedButtonEvent(
         const hidpp::Report& report) {
     assert(report.function() == DivertedButtonEvent);
-    std::set<uint16_t> buttons;
+    DivertedButtons buttons{};
     uint8_t cids = std::distance(report.paramBegin(), report.paramEnd()) / 2;
     for (uint8_t i = 0; i < cids; i++) {
         uint16_t cid = report.paramBegin()[2 * i + 1];
         cid |= report.paramBegin()[2 * i] << 8;
         if (cid)
-            buttons.insert(cid);
+            buttons[i] = cid;
         else
             break;
     }
@@ -173,12 +182,23 @@ ReprogControls::ControlInfo ReprogControlsV4::getControlReporting(uint16_t cid)
     return info;
 }
 
-void ReprogControlsV4::setControlReporting(uint16_t cid, ControlInfo info) {
+static std::vector<uint8_t> controlReportingParams(
+        uint16_t cid, const ReprogControls::ControlInfo& info) {
     std::vector<uint8_t> params(5);
     params[0] = (cid >> 8) & 0xff;
     params[1] = cid & 0xff;
     params[2] = info.flags;
     params[3] = (info.controlID >> 8) & 0xff;
     params[4] = info.controlID & 0xff;
+    return params;
+}
+
+void ReprogControlsV4::setControlReporting(uint16_t cid, ControlInfo info) {
+    auto params = controlReportingParams(cid, info);
     callFunction(SetControlReporting, params);
+}
+
+logid::async_task<void> ReprogControlsV4::setControlReportingAsync(
+        uint16_t cid, ControlInfo info) {
+    co_await callFunctionAsync(SetControlReporting, controlReportingParams(cid, info));
 }
\ No newline at end of file
@@ -22,7 +22,7 @@
 #include <backend/hidpp20/Feature.h>
 #include <backend/hidpp/Report.h>
 #include <map>
-#include <set>
+#include <array>
 #include <memory>
 
 namespace logid::backend::hidpp20 {
@@ -77,6 +77,9 @@ namespace logid::backend::hidpp20 {
             int16_t y;
         };
 
+        /* Pressed CIDs from a diverted button event, unused entries are 0 */
+        typedef std::array<uint16_t, hidpp::LongParamLength / 2> DivertedButtons;
+
         static const uint16_t ID = FeatureID::REPROG_CONTROLS;
 
         [[nodiscard]] uint16_t getID() override { return ID; }
@@ -102,7 +105,9 @@ namespace logid::backend::hidpp20 {
         // Only controlId (for remap) and flags will be read
         virtual void setControlReporting(uint16_t cid, ControlInfo info);
 
-        [[nodiscard]] static std::set<uint16_t> divertedButtonEvent(const hidpp::Report& report);
+        virtual async_task<void> setControlReportingAsync(uint16_t cid, ControlInfo info);
+
+        [[nodiscard]] static DivertedButtons divertedButtonEvent(const hidpp::Report& report);
 
         [[nodiscard]] static Move divertedRawXYEvent(const hidpp::Report& report);
 
@@ -164,6 +169,8 @@ namespace logid::backend::hidpp20 {
 
         void setControlReporting(uint16_t cid, ControlInfo info) override;
 
+        async_task<void> setControlReportingAsync(uint16_t cid, ControlInfo info) override;
+
         explicit ReprogControlsV4(Device* dev);
 
     protected:
@@ -16,8 +16,10 @@
  *
  */
 #include <backend/hidpp20/features/SmartShift.h>
+#include <backend/hidpp20/Device.h>
 
 using namespace logid::backend::hidpp20;
+using namespace logid;
 
 SmartShift::SmartShift(Device* dev) : SmartShift(dev, ID) {
 }
@@ -31,6 +33,10 @@ SmartShiftV2::SmartShiftV2(Device* dev) : SmartShift(dev, ID) {
 
 template<typename T>
 std::shared_ptr<T> make_smartshift(Device* dev) {
+    // No need to probe the device when its feature table is known
+    if (dev->hasFeatureTable() && !dev->hasFeature(T::ID))
+        return {};
+
     try {
         return std::make_shared<T>(dev);
     } catch (UnsupportedFeature& e) {
@@ -45,21 +51,36 @@ std::shared_ptr<SmartShift> SmartShift::autoVersion(Device* dev) {
     return std::make_shared<SmartShift>(dev);
 }
 
-SmartShift::Status SmartShift::getStatus() {
-    std::vector<uint8_t> params(0);
-
-    auto response = callFunction(GetStatus, params);
-
+/* Only v2 has torque, v1 leaves that byte out of its responses */
+static SmartShift::Status parseStatus(const std::vector<uint8_t>& response, bool torque) {
     return {
             .active = static_cast<bool>(response[0] - 1),
             .autoDisengage = response[1],
-            .torque = 0,
-            .setActive = false,
-            .setAutoDisengage = false,
-            .setTorque = false
+            .torque = static_cast<uint8_t>(torque ? response[2] : 0),
+            .setActive = false, .setAutoDisengage = false, .setTorque = false,
     };
 }
 
+static std::vector<uint8_t> statusParams(const SmartShift::Status& status, bool torque) {
+    std::vector<uint8_t> params(3);
+    if (status.setActive)
+        params[0] = status.active + 1;
+    if (status.setAutoDisengage)
+        params[1] = status.autoDisengage;
+    if (torque && status.setTorque)
+        params[2] = status.torque;
+    return params;
+}
+
+SmartShift::Status SmartShift::getStatus() {
+    std::vector<uint8_t> params(0);
+    return parseStatus(callFunction(GetStatus, params), false);
+}
+
+async_task<SmartShift::Status> SmartShift::getStatusAsync() {
+    co_return parseStatus(co_await callFunctionAsync(GetStatus, {}), false);
+}
+
 SmartShift::Defaults SmartShift::getDefaults() {
     std::vector<uint8_t> params(0);
 
@@ -73,14 +94,14 @@ SmartShift::Defaults SmartShift::getDefaults() {
 }
 
 void SmartShift::setStatus(Status status) {
-    std::vector<uint8_t> params(3);
-    if (status.setActive)
-        params[0] = status.active + 1;
-    if (status.setAutoDisengage)
-        params[1] = status.autoDisengage;
+    auto params = statusParams(status, false);
     callFunction(SetStatus, params);
 }
 
+async_task<void> SmartShift::setStatusAsync(Status status) {
+    co_await callFunctionAsync(SetStatus, statusParams(status, false));
+}
+
 SmartShift::Defaults SmartShiftV2::getDefaults() {
     std::vector<uint8_t> params(0);
     auto response = callFunction(GetCapabilities, params);
@@ -94,32 +115,25 @@ SmartShift::Defaults SmartShiftV2::getDefaults() {
 
 SmartShift::Status SmartShiftV2::getStatus() {
     std::vector<uint8_t> params(0);
-    auto response = callFunction(GetStatus, params);
+    return parseStatus(callFunction(GetStatus, params), true);
+}
 
-    return {
-            .active = static_cast<bool>(response[0] - 1),
-            .autoDisengage = response[1],
-            .torque = response[2],
-            .setActive = false, .setAutoDisengage = false, .setTorque = false,
-    };
+async_task<SmartShift::Status> SmartShiftV2::getStatusAsync() {
+    co_return parseStatus(co_await callFunctionAsync(GetStatus, {}), true);
 }
 
 void SmartShiftV2::setStatus(Status status) {
-    std::vector<uint8_t> params(3);
-    if (status.setActive)
-        params[0] = status.active + 1;
-    if (status.setAutoDisengage)
-        params[1] = status.autoDisengage;
-    if (status.setTorque)
-        params[2] = status.torque;
-
+    auto params = statusParams(status, true);
     callFunction(SetStatus, params);
 }
 
+async_task<void> SmartShiftV2::setStatusAsync(Status status) {
+    co_await callFunctionAsync(SetStatus, statusParams(status, true));
+}
+
 bool SmartShiftV2::supportsTorque() {
     std::vector<uint8_t> params(0);
     auto response = callFunction(GetCapabilities, params);
 
     return static_cast<bool>(response[0] & 1);
 }
-
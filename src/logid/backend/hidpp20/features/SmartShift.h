@@ -55,8 +55,12 @@ namespace logid::backend::hidpp20 {
 
         [[nodiscard]] virtual Status getStatus();
 
+        virtual async_task<Status> getStatusAsync();
+
         virtual void setStatus(Status status);
 
+        virtual async_task<void> setStatusAsync(Status status);
+
         [[nodiscard]] static std::shared_ptr<SmartShift> autoVersion(Device* dev);
 
     protected:
@@ -83,7 +87,11 @@ namespace logid::backend::hidpp20 {
 
         [[nodiscard]] Status getStatus() final;
 
+        async_task<Status> getStatusAsync() final;
+
         void setStatus(Status status) final;
+
+        async_task<void> setStatusAsync(Status status) final;
     };
 }
 
@@ -27,7 +27,7 @@ ThumbWheel::ThumbWheel(Device* dev) : Feature(dev, ID) {
 ThumbWheel::ThumbwheelInfo ThumbWheel::getInfo() {
     std::vector<uint8_t> params(0), response;
     ThumbwheelInfo info{};
-    response = callFunction(GetInfo, params);
+    response = callFunctionCached(GetInfo, params);
 
     info.nativeRes = response[1];
     info.nativeRes |= (response[0] << 8);
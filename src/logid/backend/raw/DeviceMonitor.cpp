@@ -19,6 +19,7 @@
 #include <backend/raw/DeviceMonitor.h>
 #include <backend/raw/IOMonitor.h>
 #include <backend/raw/RawDevice.h>
+#include <backend/raw/VirtualTransport.h>
 #include <backend/hidpp/Device.h>
 #include <backend/Error.h>
 #include <util/task.h>
@@ -33,8 +34,10 @@ extern "C"
 using namespace logid;
 using namespace logid::backend::raw;
 
-DeviceMonitor::DeviceMonitor() : _io_monitor(std::make_shared<IOMonitor>()),
-                                 _ready(false) {
+DeviceMonitor::DeviceMonitor(unsigned int io_threads, const std::vector<int>& io_cpus,
+                             IOBackend io_backend, std::shared_ptr<VirtualTransport> transport) :
+        _io_monitor(std::make_shared<IOMonitor>(io_threads, io_cpus, io_backend)),
+        _transport(std::move(transport)), _ready(false) {
     int ret;
     _udev_context = udev_new();
     if (!_udev_context)
@@ -74,7 +77,7 @@ DeviceMonitor::DeviceMonitor() : _io_monitor(std::make_shared<IOMonitor>()),
 }
 
 DeviceMonitor::~DeviceMonitor() {
-    if (_ready)
+    if (_ready && !_transport)
         _io_monitor->remove(_fd);
 
     if (_udev_monitor)
@@ -88,6 +91,9 @@ void DeviceMonitor::ready() {
         return;
     _ready = true;
 
+    if (_transport)
+        return;
+
     _io_monitor->add(_fd, {
             [self_weak = _self]() {
                 if (auto self = self_weak.lock()) {
@@ -119,6 +125,12 @@ void DeviceMonitor::ready() {
 }
 
 void DeviceMonitor::enumerate() {
+    if (_transport) {
+        for (auto& device: _transport->devices())
+            _addHandler(device);
+        return;
+    }
+
     int ret;
     struct udev_enumerate* udev_enum = udev_enumerate_new(_udev_context);
     ret = udev_enumerate_add_match_subsystem(udev_enum, "hidraw");
@@ -154,8 +166,11 @@ void DeviceMonitor::enumerate() {
 }
 
 void DeviceMonitor::_addHandler(const std::string& device, int tries) {
+    _add_retries.cancel(device);
+
     try {
         auto supported_reports = backend::hidpp::getSupportedReports(
+                _transport ? _transport->reportDescriptor(device) :
                 RawDevice::getReportDescriptor(device));
         if (supported_reports)
             addDevice(device);
@@ -170,10 +185,11 @@ void DeviceMonitor::_addHandler(const std::string& device, int tries) {
             std::chrono::milliseconds wait((1 << tries) * ready_backoff);
             logPrintf(DEBUG, "Failed to add device %s on try %d, backing off for %dms",
                       device.c_str(), tries + 1, wait.count());
-            run_task_after([self_weak = _self, device, tries]() {
-                if (auto self = self_weak.lock())
-                    self->_addHandler(device, tries + 1);
-            }, wait);
+            _add_retries.replace(device, run_task_after(
+                    [self_weak = _self, device, tries]() {
+                        if (auto self = self_weak.lock())
+                            self->_addHandler(device, tries + 1);
+                    }, wait));
         }
     } catch (std::exception& e) {
         logPrintf(WARN, "Error adding device %s: %s", device.c_str(), e.what());
@@ -181,6 +197,8 @@ void DeviceMonitor::_addHandler(const std::string& device, int tries) {
 }
 
 void DeviceMonitor::_removeHandler(const std::string& device) {
+    _add_retries.cancel(device);
+
     try {
         removeDevice(device);
     } catch (std::exception& e) {
@@ -192,3 +210,7 @@ void DeviceMonitor::_removeHandler(const std::string& device) {
 std::shared_ptr<IOMonitor> DeviceMonitor::ioMonitor() const {
     return _io_monitor;
 }
+
+std::shared_ptr<VirtualTransport> DeviceMonitor::transport() const {
+    return _transport;
+}
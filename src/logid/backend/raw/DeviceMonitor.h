@@ -23,6 +23,9 @@
 #include <mutex>
 #include <atomic>
 #include <memory>
+#include <vector>
+#include <backend/raw/IOMonitor.h>
+#include <util/task.h>
 
 extern "C"
 {
@@ -31,7 +34,7 @@ struct udev_monitor;
 }
 
 namespace logid::backend::raw {
-    class IOMonitor;
+    class VirtualTransport;
 
     static constexpr int max_tries = 5;
     static constexpr int ready_backoff = 500;
@@ -58,6 +61,9 @@ namespace logid::backend::raw {
 
         [[nodiscard]] std::shared_ptr<IOMonitor> ioMonitor() const;
 
+        /* Set if devices come from a virtual transport instead of hidraw */
+        [[nodiscard]] std::shared_ptr<VirtualTransport> transport() const;
+
         template<typename T, typename... Args>
         static std::shared_ptr<T> make(Args... args) {
             auto device_monitor = _deviceMonitorWrapper<T>::make(std::forward<Args>(args)...);
@@ -68,7 +74,13 @@ namespace logid::backend::raw {
         }
 
     protected:
-        DeviceMonitor();
+        /* io_threads I/O threads serve the hidraw nodes, optionally
+         * pinned to io_cpus. With a virtual transport, only its devices
+         * are added and udev is ignored. */
+        explicit DeviceMonitor(unsigned int io_threads = 1,
+                               const std::vector<int>& io_cpus = {},
+                               IOBackend io_backend = IOBackend::Epoll,
+                               std::shared_ptr<VirtualTransport> transport = {});
 
         // This should be run once the derived class is ready
         void ready();
@@ -88,12 +100,16 @@ namespace logid::backend::raw {
         void _removeHandler(const std::string& device);
 
         std::shared_ptr<IOMonitor> _io_monitor;
+        std::shared_ptr<VirtualTransport> _transport;
 
         struct udev* _udev_context;
         struct udev_monitor* _udev_monitor;
         int _fd;
         bool _ready;
 
+        /* Pending add retries, by device node */
+        keyed_tasks<std::string> _add_retries;
+
         std::weak_ptr<DeviceMonitor> _self;
     };
 }
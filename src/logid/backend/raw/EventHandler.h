@@ -21,16 +21,21 @@
 
 #include <functional>
 #include <cstdint>
-#include <vector>
+#include <span>
+#include <optional>
 
 namespace logid::backend::raw {
     struct RawEventHandler {
-        std::function<bool(const std::vector<uint8_t>&)> condition;
-        std::function<void(const std::vector<uint8_t>&)> callback;
+        std::function<bool(std::span<const uint8_t>)> condition;
+        std::function<void(std::span<const uint8_t>)> callback;
 
-        RawEventHandler(std::function<bool(const std::vector<uint8_t>&)> cond,
-                        std::function<void(const std::vector<uint8_t>&)> call) :
-                condition(std::move(cond)), callback(std::move(call)) {
+        /* If set, only reports whose RawDevice::eventKey matches are seen */
+        std::optional<uint16_t> key;
+
+        RawEventHandler(std::function<bool(std::span<const uint8_t>)> cond,
+                        std::function<void(std::span<const uint8_t>)> call,
+                        std::optional<uint16_t> k = {}) :
+                condition(std::move(cond)), callback(std::move(call)), key(k) {
         }
     };
 }
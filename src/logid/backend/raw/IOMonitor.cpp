@@ -17,10 +17,14 @@
  */
 #include <backend/raw/IOMonitor.h>
 #include <util/log.h>
+#include <array>
+#include <cstring>
 #include <optional>
 
 extern "C"
 {
+#include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
@@ -36,8 +40,160 @@ IOHandler::IOHandler(std::function<void()> r,
         error(std::move(err)) {
 }
 
-IOMonitor::IOMonitor() : _epoll_fd(epoll_create1(0)),
-                         _event_fd(eventfd(0, EFD_NONBLOCK)) {
+IOHandler::IOHandler(std::function<void()> r,
+                     std::function<void()> hup,
+                     std::function<void()> err,
+                     std::function<void(std::span<const uint8_t>)> d) :
+        read(std::move(r)),
+        hangup(std::move(hup)),
+        error(std::move(err)),
+        data(std::move(d)) {
+}
+
+IOMonitor::IOMonitor(unsigned int shard_count, const std::vector<int>& cpus,
+                     IOBackend backend) : _backend(backend) {
+    if (shard_count == 0)
+        shard_count = 1;
+
+#ifndef USE_IO_URING
+    if (_backend == IOBackend::IOUring) {
+        logPrintf(WARN, "logid was built without io_uring support, using epoll");
+        _backend = IOBackend::Epoll;
+    }
+#endif
+
+    for (unsigned int i = 0; i < shard_count; ++i) {
+        std::optional<int> cpu;
+        if (!cpus.empty())
+            cpu = cpus[i % cpus.size()];
+
+        _shards.push_back(_makeShard(cpu));
+    }
+
+    _shard_loads.resize(_shards.size());
+}
+
+IOMonitor::~IOMonitor() noexcept = default;
+
+void IOMonitor::add(int fd, IOHandler handler) {
+    std::size_t shard;
+    {
+        std::lock_guard lock(_assign_mutex);
+        if (_fd_shards.contains(fd))
+            throw std::runtime_error("duplicate io fd");
+
+        shard = 0;
+        for (std::size_t i = 1; i < _shard_loads.size(); ++i) {
+            if (_shard_loads[i] < _shard_loads[shard])
+                shard = i;
+        }
+
+        _fd_shards.emplace(fd, shard);
+        ++_shard_loads[shard];
+    }
+
+    try {
+        _shards[shard]->add(fd, std::move(handler));
+    } catch (...) {
+        std::lock_guard lock(_assign_mutex);
+        _fd_shards.erase(fd);
+        --_shard_loads[shard];
+        throw;
+    }
+}
+
+void IOMonitor::remove(int fd) noexcept {
+    std::size_t shard;
+    {
+        std::lock_guard lock(_assign_mutex);
+        auto it = _fd_shards.find(fd);
+        if (it == _fd_shards.end())
+            return;
+        shard = it->second;
+        _fd_shards.erase(it);
+        --_shard_loads[shard];
+    }
+
+    _shards[shard]->remove(fd);
+}
+
+bool IOMonitor::write(int fd, std::span<const uint8_t> data) {
+    std::optional<std::size_t> shard;
+    {
+        std::lock_guard lock(_assign_mutex);
+        auto it = _fd_shards.find(fd);
+        if (it != _fd_shards.end())
+            shard = it->second;
+    }
+
+    if (shard.has_value())
+        return _shards[shard.value()]->write(fd, data);
+
+    _writeSync(fd, data);
+    return true;
+}
+
+WriteStats IOMonitor::writeStats(int fd) const {
+    std::optional<std::size_t> shard;
+    {
+        std::lock_guard lock(_assign_mutex);
+        auto it = _fd_shards.find(fd);
+        if (it != _fd_shards.end())
+            shard = it->second;
+    }
+
+    if (shard.has_value())
+        return _shards[shard.value()]->writeStats(fd);
+    return {};
+}
+
+std::size_t IOMonitor::shardCount() const {
+    return _shards.size();
+}
+
+IOBackend IOMonitor::backend() const {
+    return _backend;
+}
+
+std::unique_ptr<IOMonitor::Shard> IOMonitor::_makeShard(std::optional<int> cpu) {
+#ifdef USE_IO_URING
+    if (_backend == IOBackend::IOUring) {
+        try {
+            return _makeUringShard(cpu);
+        } catch (std::exception& e) {
+            logPrintf(WARN, "io_uring is unavailable (%s), using epoll", e.what());
+            _backend = IOBackend::Epoll;
+        }
+    }
+#endif
+
+    return std::make_unique<EpollShard>(cpu);
+}
+
+void IOMonitor::_pinThread(std::thread& thread, std::optional<int> cpu) {
+    if (!cpu.has_value())
+        return;
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu.value(), &cpu_set);
+    int ret = pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set), &cpu_set);
+    if (ret)
+        logPrintf(WARN, "Failed to pin I/O thread to CPU %d: %s",
+                  cpu.value(), strerror(ret));
+}
+
+void IOMonitor::_writeSync(int fd, std::span<const uint8_t> data) {
+    for (int i = 0; i < max_write_tries && ::write(fd, data.data(), data.size()) == -1; ++i) {
+        auto err = errno;
+        if (err != EPIPE)
+            throw std::system_error(err, std::system_category(),
+                                    "sendReport write failed");
+    }
+}
+
+IOMonitor::EpollShard::EpollShard(std::optional<int> cpu) :
+        _epoll_fd(epoll_create1(0)), _event_fd(eventfd(0, EFD_NONBLOCK)) {
     if (_epoll_fd < 0) {
         if (_event_fd >= 0)
             close(_event_fd);
@@ -57,14 +213,16 @@ IOMonitor::IOMonitor() : _epoll_fd(epoll_create1(0)),
         throw std::system_error(errno, std::generic_category());
     }
 
-    _fds.emplace(_event_fd, nullptr);
-
+    _fds = new FdTable;
+    _is_running = true;
     _io_thread = std::make_unique<std::thread>([this]() {
         _listen();
     });
+
+    _pinThread(*_io_thread, cpu);
 }
 
-IOMonitor::~IOMonitor() noexcept {
+IOMonitor::EpollShard::~EpollShard() noexcept {
     _stop();
 
     if (_event_fd >= 0)
@@ -72,96 +230,231 @@ IOMonitor::~IOMonitor() noexcept {
 
     if (_epoll_fd >= 0)
         ::close(_epoll_fd);
-}
-
-void IOMonitor::_listen() {
-    std::unique_lock lock(_run_mutex);
-    std::vector<struct epoll_event> events;
 
-    if (_is_running)
-        throw std::runtime_error("IOMonitor double run");
+    delete _fds.load();
+}
 
-    _is_running = true;
+void IOMonitor::EpollShard::_listen() {
+    static constexpr int max_events = 64;
+    std::array<struct epoll_event, max_events> events{};
 
     while (_is_running) {
-        if (events.size() != _fds.size())
-            events.resize(_fds.size());
-
-        int ev_count = ::epoll_wait(_epoll_fd, events.data(), (int) events.size(), -1);
+        int ev_count = ::epoll_wait(_epoll_fd, events.data(), max_events, -1);
         for (int i = 0; i < ev_count; ++i) {
-            std::shared_ptr<IOHandler> handler;
-
             if (events[i].data.fd == _event_fd) {
-                if (events[i].events & EPOLLIN) {
-                    lock.unlock();
-                    /* Wait until done yielding */
-                    const std::lock_guard yield_lock(_yield_mutex);
-                    uint64_t event;
-                    while (-1 != ::eventfd_read(_event_fd, &event)) { }
-                    lock.lock();
-                }
-            } else {
-                try {
-                    handler = _fds.at(events[i].data.fd);
-                } catch (std::out_of_range& e) {
-                    continue;
-                }
+                uint64_t event;
+                while (-1 != ::eventfd_read(_event_fd, &event)) { }
+                continue;
+            }
+
+            const int fd = events[i].data.fd;
+            auto registration = _registration(fd);
+            if (!registration)
+                continue;
 
-                lock.unlock();
-                try {
-                    if (events[i].events & EPOLLIN)
-                        handler->read();
-                    if (events[i].events & EPOLLHUP)
-                        handler->hangup();
-                    if (events[i].events & EPOLLERR)
-                        handler->error();
-                } catch (std::exception& e) {
-                    logPrintf(ERROR, "Unhandled I/O handler error: %s", e.what());
+            try {
+                if (events[i].events & EPOLLOUT) {
+                    std::lock_guard lock(registration->write_mutex);
+                    _flush(fd, *registration);
                 }
-                lock.lock();
 
+                if (registration->removed)
+                    continue;
+
+                auto& handler = registration->handler;
+                if (events[i].events & EPOLLIN)
+                    handler.read();
+                if (events[i].events & EPOLLHUP)
+                    handler.hangup();
+                if (events[i].events & EPOLLERR)
+                    handler.error();
+            } catch (std::exception& e) {
+                logPrintf(ERROR, "Unhandled I/O handler error: %s", e.what());
             }
         }
     }
 }
 
-void IOMonitor::_stop() noexcept {
+void IOMonitor::EpollShard::_stop() noexcept {
     _is_running = false;
-    _yield();
+    ::eventfd_write(_event_fd, 1);
     _io_thread->join();
 }
 
-std::unique_lock<std::mutex> IOMonitor::_yield() noexcept {
-    /* Prevent listener thread from grabbing lock during yielding */
-    std::unique_lock yield_lock(_yield_mutex);
+std::shared_ptr<IOMonitor::EpollShard::Registration>
+IOMonitor::EpollShard::_registration(int fd) {
+    /* Read-side critical section, an odd epoch marks the listener as
+     * holding a table that add and remove must not free. */
+    _epoch.fetch_add(1);
+    const FdTable* table = _fds.load();
 
-    std::unique_lock run_lock(_run_mutex, std::try_to_lock);
-    if (!run_lock.owns_lock()) {
-        ::eventfd_write(_event_fd, 1);
-        run_lock = std::unique_lock<std::mutex>(_run_mutex);
-    }
+    std::shared_ptr<Registration> registration;
+    auto it = table->find(fd);
+    if (it != table->end())
+        registration = it->second;
 
-    return run_lock;
+    _epoch.fetch_add(1);
+    return registration;
 }
 
-void IOMonitor::add(int fd, IOHandler handler) {
-    const auto lock = _yield();
+std::shared_ptr<IOMonitor::EpollShard::Registration>
+IOMonitor::EpollShard::_lockedRegistration(int fd) const {
+    const std::lock_guard lock(_table_mutex);
+    const FdTable* table = _fds.load();
+    auto it = table->find(fd);
+    return it != table->end() ? it->second : nullptr;
+}
+
+void IOMonitor::EpollShard::_publish(std::unique_ptr<const FdTable> table) {
+    std::unique_ptr<const FdTable> old(_fds.exchange(table.release()));
+
+    /* Wait out a read-side section that may hold the old table. The
+     * listener only holds it for a lookup, never while dispatching. */
+    const uint64_t epoch = _epoch.load();
+    if (epoch & 1) {
+        while (_epoch.load() == epoch)
+            std::this_thread::yield();
+    }
+}
+
+void IOMonitor::EpollShard::add(int fd, IOHandler handler) {
+    const std::lock_guard lock(_table_mutex);
+
+    auto table = std::make_unique<FdTable>(*_fds.load());
+    if (!table->emplace(fd, std::make_shared<Registration>(std::move(handler))).second)
+        throw std::runtime_error("duplicate io fd");
+    _publish(std::move(table));
 
     struct epoll_event event{};
     event.events = EPOLLIN | EPOLLHUP | EPOLLERR;
     event.data.fd = fd;
 
-    if (!_fds.contains(fd)) {
-        if (::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event))
-            throw std::system_error(errno, std::generic_category());
-        _fds.emplace(fd, std::make_shared<IOHandler>(std::move(handler)));
-    } else {
-        throw std::runtime_error("duplicate io fd");
+    if (::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event)) {
+        const int err = errno;
+        table = std::make_unique<FdTable>(*_fds.load());
+        table->erase(fd);
+        _publish(std::move(table));
+        throw std::system_error(err, std::generic_category());
     }
 }
 
-void IOMonitor::remove(int fd) noexcept {
-    const auto lock = _yield();
+void IOMonitor::EpollShard::remove(int fd) noexcept {
+    const std::lock_guard lock(_table_mutex);
+
     ::epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
-    _fds.erase(fd);
-}
\ No newline at end of file
+
+    const FdTable* current = _fds.load();
+    if (auto it = current->find(fd); it != current->end()) {
+        std::lock_guard write_lock(it->second->write_mutex);
+        it->second->removed = true;
+        it->second->writes.clear();
+    }
+
+    try {
+        auto table = std::make_unique<FdTable>(*_fds.load());
+        table->erase(fd);
+        _publish(std::move(table));
+    } catch (std::bad_alloc& e) {
+        logPrintf(ERROR, "Failed to remove fd %d from I/O table", fd);
+    }
+}
+
+bool IOMonitor::EpollShard::write(int fd, std::span<const uint8_t> data) {
+    auto registration = _lockedRegistration(fd);
+    if (!registration) {
+        _writeSync(fd, data);
+        return true;
+    }
+
+    std::unique_lock lock(registration->write_mutex);
+    if (registration->removed) {
+        lock.unlock();
+        _writeSync(fd, data);
+        return true;
+    }
+
+    auto& stats = registration->stats;
+    int tries = 0;
+
+    /* Anything already queued goes first */
+    if (registration->writes.empty()) {
+        if (::write(fd, data.data(), data.size()) != -1) {
+            ++stats.written;
+            return true;
+        }
+
+        const int err = errno;
+        if (err != EAGAIN && err != EPIPE) {
+            ++stats.failed;
+            throw std::system_error(err, std::system_category(),
+                                    "sendReport write failed");
+        }
+        tries = 1;
+    }
+
+    if (registration->writes.size() >= max_queued_writes) {
+        ++stats.dropped;
+        return false;
+    }
+
+    registration->writes.push_back({{data.begin(), data.end()}, tries});
+    stats.depth = registration->writes.size();
+    stats.max_depth = std::max(stats.max_depth, stats.depth);
+
+    _pollOut(fd, *registration, true);
+    return true;
+}
+
+WriteStats IOMonitor::EpollShard::writeStats(int fd) const {
+    auto registration = _lockedRegistration(fd);
+    if (!registration)
+        return {};
+
+    std::lock_guard lock(registration->write_mutex);
+    return registration->stats;
+}
+
+void IOMonitor::EpollShard::_flush(int fd, Registration& registration) {
+    if (registration.removed)
+        return;
+
+    auto& writes = registration.writes;
+    auto& stats = registration.stats;
+
+    while (!writes.empty()) {
+        auto& write = writes.front();
+        if (::write(fd, write.data.data(), write.data.size()) != -1) {
+            ++stats.written;
+            writes.pop_front();
+            continue;
+        }
+
+        const int err = errno;
+        if (err == EAGAIN)
+            break;
+        if (err == EPIPE && ++write.tries < max_write_tries)
+            break; // Retried on the next EPOLLOUT
+
+        ++stats.failed;
+        logPrintf(WARN, "Write to fd %d failed: %s", fd, strerror(err));
+        writes.pop_front();
+    }
+
+    stats.depth = writes.size();
+    if (writes.empty())
+        _pollOut(fd, registration, false);
+}
+
+void IOMonitor::EpollShard::_pollOut(int fd, Registration& registration, bool enable) {
+    if (registration.removed || registration.polling_out == enable)
+        return;
+
+    struct epoll_event event{};
+    event.events = EPOLLIN | EPOLLHUP | EPOLLERR;
+    if (enable)
+        event.events |= EPOLLOUT;
+    event.data.fd = fd;
+
+    if (::epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, fd, &event) == 0)
+        registration.polling_out = enable;
+}
@@ -19,27 +19,58 @@
 #define LOGID_BACKEND_RAW_IOMONITOR_H
 
 #include <atomic>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <condition_variable>
+#include <optional>
+#include <span>
 #include <thread>
+#include <vector>
 
 namespace logid::backend::raw {
+    enum class IOBackend {
+        Epoll,
+        IOUring
+    };
+
     struct IOHandler {
         std::function<void()> read;
         std::function<void()> hangup;
         std::function<void()> error;
 
+        /* If set, backends that read on the handler's behalf pass the data
+         * here instead of calling read. */
+        std::function<void(std::span<const uint8_t>)> data;
+
         IOHandler(std::function<void()> r,
                   std::function<void()> hup,
                   std::function<void()> err);
+
+        IOHandler(std::function<void()> r,
+                  std::function<void()> hup,
+                  std::function<void()> err,
+                  std::function<void(std::span<const uint8_t>)> d);
+    };
+
+    struct WriteStats {
+        std::size_t depth = 0; // Currently queued
+        std::size_t max_depth = 0;
+        uint64_t written = 0;
+        uint64_t dropped = 0; // Rejected because the queue was full
+        uint64_t failed = 0;
     };
 
     class IOMonitor {
     public:
-        IOMonitor();
+        /* Spreads fds over shard_count I/O threads. If cpus is not empty,
+         * shard i is pinned to cpus[i % cpus.size()]. If the requested
+         * backend is unavailable, epoll is used instead. */
+        explicit IOMonitor(unsigned int shard_count = 1, const std::vector<int>& cpus = {},
+                           IOBackend backend = IOBackend::Epoll);
 
         IOMonitor(IOMonitor&&) = delete;
 
@@ -54,21 +85,129 @@ namespace logid::backend::raw {
         void add(int fd, IOHandler handler);
 
         void remove(int fd) noexcept;
+
+        /* Never blocks. Writes that can't complete now are queued and sent
+         * in order once the fd is writable. Returns false if the fd's
+         * queue is full and the data was dropped. */
+        bool write(int fd, std::span<const uint8_t> data);
+
+        [[nodiscard]] WriteStats writeStats(int fd) const;
+
+        [[nodiscard]] std::size_t shardCount() const;
+
+        [[nodiscard]] IOBackend backend() const;
+
+        static constexpr int max_write_tries = 8;
+        static constexpr std::size_t max_queued_writes = 64;
+
     private:
-        void _listen(); // This is a blocking call
-        void _stop() noexcept;
-        std::unique_lock<std::mutex> _yield() noexcept;
+        class Shard {
+        public:
+            virtual ~Shard() noexcept = default;
+
+            virtual void add(int fd, IOHandler handler) = 0;
+
+            virtual void remove(int fd) noexcept = 0;
+
+            virtual bool write(int fd, std::span<const uint8_t> data) = 0;
+
+            [[nodiscard]] virtual WriteStats writeStats(int fd) const = 0;
+        };
+
+        struct QueuedWrite {
+            std::vector<uint8_t> data;
+            int tries = 0;
+        };
+
+        /* One epoll thread and the fds it serves */
+        class EpollShard : public Shard {
+        public:
+            explicit EpollShard(std::optional<int> cpu);
+
+            EpollShard(const EpollShard&) = delete;
+
+            EpollShard& operator=(const EpollShard&) = delete;
+
+            ~EpollShard() noexcept override;
+
+            void add(int fd, IOHandler handler) override;
+
+            void remove(int fd) noexcept override;
+
+            bool write(int fd, std::span<const uint8_t> data) override;
+
+            [[nodiscard]] WriteStats writeStats(int fd) const override;
+
+        private:
+            struct Registration {
+                explicit Registration(IOHandler h) : handler(std::move(h)) { }
+
+                IOHandler handler;
+
+                mutable std::mutex write_mutex;
+                std::deque<QueuedWrite> writes;
+                bool polling_out = false;
+                WriteStats stats;
+
+                /* Set by remove() while holding write_mutex. The listener may
+                 * still hold the registration after its fd is closed and
+                 * reused, so nothing may touch the fd once this is set. */
+                std::atomic_bool removed = false;
+            };
+
+            typedef std::map<int, std::shared_ptr<Registration>> FdTable;
+
+            void _listen(); // This is a blocking call
+            void _stop() noexcept;
+
+            std::shared_ptr<Registration> _registration(int fd);
+
+            /* Any thread holding _table_mutex may also read the table */
+            std::shared_ptr<Registration> _lockedRegistration(int fd) const;
+
+            /* Sends queued writes, must hold the registration's write_mutex */
+            void _flush(int fd, Registration& registration);
+
+            void _pollOut(int fd, Registration& registration, bool enable);
+
+            /* Swaps in a new table, freeing the old one once unused */
+            void _publish(std::unique_ptr<const FdTable> table);
+
+            std::unique_ptr<std::thread> _io_thread;
+
+            /* The listener reads the table without locking. add and remove
+             * copy it, publish the copy and wait for the listener's epoch
+             * to move past any lookup that started on the old one. */
+            std::atomic<const FdTable*> _fds = nullptr;
+            std::atomic<uint64_t> _epoch = 0;
+            mutable std::mutex _table_mutex;
+
+            std::atomic_bool _is_running;
+
+            const int _epoll_fd;
+            const int _event_fd;
+        };
+
+#ifdef USE_IO_URING
+        /* Defined in IOUring.cpp */
+        class UringShard;
+
+        static std::unique_ptr<Shard> _makeUringShard(std::optional<int> cpu);
+#endif
+
+        std::unique_ptr<Shard> _makeShard(std::optional<int> cpu);
 
-        std::unique_ptr<std::thread> _io_thread;
+        static void _pinThread(std::thread& thread, std::optional<int> cpu);
 
-        std::mutex _run_mutex;
-        std::mutex _yield_mutex;
+        static void _writeSync(int fd, std::span<const uint8_t> data);
 
-        std::map<int, std::shared_ptr<IOHandler>> _fds;
-        std::atomic_bool _is_running;
+        std::vector<std::unique_ptr<Shard>> _shards;
+        IOBackend _backend;
 
-        const int _epoll_fd;
-        const int _event_fd;
+        /* Each fd stays on the shard it was added to, the least loaded one */
+        mutable std::mutex _assign_mutex;
+        std::map<int, std::size_t> _fd_shards;
+        std::vector<std::size_t> _shard_loads;
     };
 }
 
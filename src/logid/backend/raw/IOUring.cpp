@@ -0,0 +1,721 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <backend/raw/IOMonitor.h>
+#include <util/log.h>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <system_error>
+
+extern "C"
+{
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+}
+
+using namespace logid::backend::raw;
+
+namespace {
+    /* IORING_OP_READ_MULTISHOT, added in Linux 6.7. Older kernels reject
+     * it, in which case fds are polled and read by their handlers. */
+    constexpr uint8_t op_read_multishot = 49;
+
+    constexpr unsigned int ring_entries = 64;
+    constexpr unsigned int buffer_count = 256;
+    constexpr unsigned int buffer_size = 64;
+    constexpr uint16_t buffer_group = 0;
+
+    /* user_data is the operation in the top byte, then either a 24-bit
+     * registration generation and the fd, or a 56-bit write ID. */
+    enum Operation : uint8_t {
+        OpWake,
+        OpRead,
+        OpPoll,
+        OpWrite,
+        OpCancel,
+        OpProvide
+    };
+
+    constexpr uint64_t id_mask = (1ull << 56) - 1;
+    constexpr uint32_t generation_mask = (1u << 24) - 1;
+
+    uint64_t pack(Operation op, uint32_t generation, int fd) {
+        return (uint64_t(op) << 56) | (uint64_t(generation & generation_mask) << 32) |
+               uint32_t(fd);
+    }
+
+    uint64_t pack(Operation op, uint64_t id) {
+        return (uint64_t(op) << 56) | (id & id_mask);
+    }
+
+    int io_uring_setup(unsigned int entries, io_uring_params* params) {
+        return (int) ::syscall(__NR_io_uring_setup, entries, params);
+    }
+
+    int io_uring_enter(int ring_fd, unsigned int to_submit, unsigned int min_complete,
+                       unsigned int flags) {
+        return (int) ::syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                               flags, nullptr, 0);
+    }
+
+    template <typename T>
+    T load_acquire(T* p) {
+        return std::atomic_ref<T>(*p).load(std::memory_order_acquire);
+    }
+
+    template <typename T>
+    void store_release(T* p, T value) {
+        std::atomic_ref<T>(*p).store(value, std::memory_order_release);
+    }
+}
+
+/*
+ * One io_uring and the thread that owns it. The thread is the only
+ * submitter: other threads queue operations and wake it through an
+ * eventfd, which lets the kernel defer completion work to that thread.
+ */
+class IOMonitor::UringShard : public IOMonitor::Shard {
+public:
+    explicit UringShard(std::optional<int> cpu);
+
+    UringShard(const UringShard&) = delete;
+
+    UringShard& operator=(const UringShard&) = delete;
+
+    ~UringShard() noexcept override;
+
+    void add(int fd, IOHandler handler) override;
+
+    void remove(int fd) noexcept override;
+
+    bool write(int fd, std::span<const uint8_t> data) override;
+
+    [[nodiscard]] WriteStats writeStats(int fd) const override;
+
+private:
+    struct Entry {
+        std::shared_ptr<IOHandler> handler;
+        uint32_t generation;
+        std::deque<std::vector<uint8_t>> writes;
+        bool writing = false;
+        WriteStats stats;
+    };
+
+    struct Write {
+        int fd;
+        uint32_t generation;
+        std::vector<uint8_t> data;
+        int tries = 0;
+    };
+
+    struct Request {
+        Operation op;
+        int fd;
+        uint32_t generation;
+        uint64_t write;
+    };
+
+    void _setup();
+    void _teardown() noexcept;
+    void _listen(); // This is a blocking call
+
+    void _queue(Request request);
+    void _wake() noexcept;
+    void _dispatchRequests();
+
+    io_uring_sqe* _sqe();
+    void _submit();
+
+    void _provide(uint16_t buffer, unsigned int count);
+    void _armWake();
+    void _armRead(int fd, uint32_t generation, bool multishot);
+    void _armWrite(uint64_t id, const Write& write);
+
+    void _complete(const io_uring_cqe& cqe);
+    void _completeRead(int fd, uint32_t generation, const io_uring_cqe& cqe);
+    void _completePoll(int fd, uint32_t generation, const io_uring_cqe& cqe);
+    void _completeWrite(uint64_t id, int result);
+
+    /* Must hold _mutex. Fds are only armed and submitted while holding it,
+     * so a removed fd can't be reused under an operation meant for it. */
+    [[nodiscard]] bool _registered(int fd, uint32_t generation) const;
+    void _rearm(int fd, uint32_t generation, bool multishot);
+
+    std::shared_ptr<IOHandler> _handler(int fd, uint32_t generation);
+    void _recycle(uint16_t buffer);
+
+    int _ring_fd = -1;
+    int _event_fd = -1;
+    uint64_t _event_value = 0;
+
+    void* _sq_ring = MAP_FAILED;
+    std::size_t _sq_ring_size = 0;
+    void* _cq_ring = MAP_FAILED;
+    std::size_t _cq_ring_size = 0;
+    io_uring_sqe* _sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    std::size_t _sqes_size = 0;
+
+    unsigned int* _sq_head = nullptr;
+    unsigned int* _sq_tail = nullptr;
+    unsigned int* _sq_array = nullptr;
+    unsigned int _sq_mask = 0;
+    unsigned int _sq_entries = 0;
+    unsigned int _sq_unsubmitted = 0;
+
+    unsigned int* _cq_head = nullptr;
+    unsigned int* _cq_tail = nullptr;
+    io_uring_cqe* _cqes = nullptr;
+    unsigned int _cq_mask = 0;
+
+    /* Provided buffers for multishot reads, only touched by the ring thread */
+    std::vector<uint8_t> _buffers;
+    bool _multishot_read = false;
+
+    mutable std::mutex _mutex;
+    std::map<int, Entry> _fds;
+    std::map<uint64_t, Write> _writes;
+    std::deque<Request> _requests;
+    uint32_t _last_generation = 0;
+    uint64_t _last_write = 0;
+
+    std::thread::id _ring_thread;
+    std::atomic_bool _wake_pending = false;
+    std::atomic_bool _is_running = true;
+    std::unique_ptr<std::thread> _io_thread;
+};
+
+std::unique_ptr<IOMonitor::Shard> IOMonitor::_makeUringShard(std::optional<int> cpu) {
+    return std::make_unique<UringShard>(cpu);
+}
+
+IOMonitor::UringShard::UringShard(std::optional<int> cpu) {
+    std::promise<void> ready;
+    auto ready_future = ready.get_future();
+
+    /* The ring is created on its own thread, which becomes its only submitter */
+    _io_thread = std::make_unique<std::thread>([this, ready = std::move(ready)]() mutable {
+        _ring_thread = std::this_thread::get_id();
+        try {
+            _setup();
+        } catch (...) {
+            _teardown();
+            ready.set_exception(std::current_exception());
+            return;
+        }
+
+        ready.set_value();
+        _listen();
+    });
+
+    try {
+        ready_future.get();
+    } catch (...) {
+        _io_thread->join();
+        throw;
+    }
+
+    _pinThread(*_io_thread, cpu);
+}
+
+IOMonitor::UringShard::~UringShard() noexcept {
+    _is_running = false;
+    _wake();
+    _io_thread->join();
+    _teardown();
+}
+
+void IOMonitor::UringShard::_setup() {
+    _event_fd = ::eventfd(0, EFD_NONBLOCK);
+    if (_event_fd < 0)
+        throw std::system_error(errno, std::generic_category(), "eventfd");
+
+    io_uring_params params{};
+#if defined(IORING_SETUP_SINGLE_ISSUER) && defined(IORING_SETUP_DEFER_TASKRUN)
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+#endif
+    _ring_fd = io_uring_setup(ring_entries, &params);
+    if (_ring_fd < 0 && errno == EINVAL && params.flags) {
+        // Kernels before 6.1 don't support deferred task work
+        params = {};
+        _ring_fd = io_uring_setup(ring_entries, &params);
+    }
+    if (_ring_fd < 0)
+        throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+
+    _sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    _cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        _sq_ring_size = _cq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+
+    _sq_ring = ::mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+    if (_sq_ring == MAP_FAILED)
+        throw std::system_error(errno, std::generic_category(), "io_uring sq mmap");
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        _cq_ring = _sq_ring;
+    } else {
+        _cq_ring = ::mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+        if (_cq_ring == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "io_uring cq mmap");
+    }
+
+    _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    _sqes = static_cast<io_uring_sqe*>(
+            ::mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQES));
+    if (_sqes == MAP_FAILED)
+        throw std::system_error(errno, std::generic_category(), "io_uring sqe mmap");
+
+    auto sq = static_cast<uint8_t*>(_sq_ring);
+    _sq_head = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+    _sq_tail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+    _sq_array = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+    _sq_mask = *reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+    _sq_entries = params.sq_entries;
+
+    auto cq = static_cast<uint8_t*>(_cq_ring);
+    _cq_head = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+    _cq_tail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+    _cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    _cq_mask = *reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+
+    /* Multishot reads select from a group of provided buffers */
+    _buffers.resize(buffer_count * buffer_size);
+    _provide(0, buffer_count);
+    _submit();
+
+    int ret;
+    do {
+        ret = io_uring_enter(_ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0)
+        throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+
+    unsigned int head = *_cq_head;
+    _multishot_read = _cqes[head & _cq_mask].res >= 0;
+    store_release(_cq_head, head + 1);
+    if (!_multishot_read)
+        logPrintf(DEBUG, "io_uring provided buffers are unsupported, polling instead");
+
+    _armWake();
+    _submit();
+}
+
+void IOMonitor::UringShard::_teardown() noexcept {
+    // Closing the ring cancels everything still in flight
+    if (_ring_fd >= 0)
+        ::close(_ring_fd);
+    if (_event_fd >= 0)
+        ::close(_event_fd);
+
+    if (_sqes != MAP_FAILED)
+        ::munmap(_sqes, _sqes_size);
+    if (_cq_ring != MAP_FAILED && _cq_ring != _sq_ring)
+        ::munmap(_cq_ring, _cq_ring_size);
+    if (_sq_ring != MAP_FAILED)
+        ::munmap(_sq_ring, _sq_ring_size);
+
+    _ring_fd = -1;
+    _event_fd = -1;
+    _sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    _cq_ring = _sq_ring = MAP_FAILED;
+}
+
+void IOMonitor::UringShard::add(int fd, IOHandler handler) {
+    std::lock_guard lock(_mutex);
+    if (_fds.contains(fd))
+        throw std::runtime_error("duplicate io fd");
+
+    uint32_t generation = ++_last_generation & generation_mask;
+    _fds.emplace(fd, Entry{std::make_shared<IOHandler>(std::move(handler)), generation, {}, false, {}});
+    _queue({OpRead, fd, generation, 0});
+}
+
+void IOMonitor::UringShard::remove(int fd) noexcept {
+    std::lock_guard lock(_mutex);
+    auto it = _fds.find(fd);
+    if (it == _fds.end())
+        return;
+
+    _queue({OpCancel, fd, it->second.generation, 0});
+    _fds.erase(it);
+}
+
+bool IOMonitor::UringShard::write(int fd, std::span<const uint8_t> data) {
+    std::lock_guard lock(_mutex);
+    auto it = _fds.find(fd);
+    if (it == _fds.end()) {
+        _writeSync(fd, data);
+        return true;
+    }
+
+    /* Writes to one fd are issued one at a time to keep them in order */
+    auto& entry = it->second;
+    auto& stats = entry.stats;
+    if (entry.writing) {
+        if (entry.writes.size() + 1 >= max_queued_writes) {
+            ++stats.dropped;
+            return false;
+        }
+        entry.writes.emplace_back(data.begin(), data.end());
+    } else {
+        entry.writing = true;
+        uint64_t id = ++_last_write & id_mask;
+        _writes.emplace(id, Write{fd, entry.generation, {data.begin(), data.end()}});
+        _queue({OpWrite, fd, entry.generation, id});
+    }
+
+    stats.depth = entry.writes.size() + 1;
+    stats.max_depth = std::max(stats.max_depth, stats.depth);
+    return true;
+}
+
+WriteStats IOMonitor::UringShard::writeStats(int fd) const {
+    std::lock_guard lock(_mutex);
+    auto it = _fds.find(fd);
+    return it != _fds.end() ? it->second.stats : WriteStats();
+}
+
+void IOMonitor::UringShard::_queue(Request request) {
+    _requests.push_back(request);
+
+    // Handlers running on the ring thread are picked up before it waits again
+    if (std::this_thread::get_id() != _ring_thread)
+        _wake();
+}
+
+void IOMonitor::UringShard::_wake() noexcept {
+    if (!_wake_pending.exchange(true))
+        ::eventfd_write(_event_fd, 1);
+}
+
+void IOMonitor::UringShard::_dispatchRequests() {
+    _wake_pending = false;
+
+    std::lock_guard lock(_mutex);
+    for (auto& request: _requests) {
+        switch (request.op) {
+            case OpRead: {
+                auto it = _fds.find(request.fd);
+                if (_registered(request.fd, request.generation))
+                    _armRead(request.fd, request.generation,
+                             _multishot_read && it->second.handler->data);
+                break;
+            }
+            case OpCancel:
+                /* Either kind may be armed, depending on the handler and kernel */
+                for (auto target: {OpRead, OpPoll}) {
+                    auto sqe = _sqe();
+                    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                    sqe->fd = -1;
+                    sqe->addr = pack(target, request.generation, request.fd);
+                    sqe->user_data = pack(OpCancel, request.generation, request.fd);
+                }
+                break;
+            case OpWrite: {
+                auto it = _writes.find(request.write);
+                if (it != _writes.end() && _registered(request.fd, request.generation))
+                    _armWrite(it->first, it->second);
+                else if (it != _writes.end())
+                    _writes.erase(it);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    _requests.clear();
+
+    _submit();
+}
+
+io_uring_sqe* IOMonitor::UringShard::_sqe() {
+    unsigned int tail = *_sq_tail;
+    if (tail - load_acquire(_sq_head) >= _sq_entries) {
+        _submit();
+        if (tail - load_acquire(_sq_head) >= _sq_entries)
+            throw std::runtime_error("io_uring submission queue full");
+    }
+
+    unsigned int index = tail & _sq_mask;
+    auto sqe = &_sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    _sq_array[index] = index;
+
+    /* The caller fills in the entry before the next _submit() */
+    store_release(_sq_tail, tail + 1);
+    ++_sq_unsubmitted;
+
+    return sqe;
+}
+
+void IOMonitor::UringShard::_submit() {
+    while (_sq_unsubmitted) {
+        int ret = io_uring_enter(_ring_fd, _sq_unsubmitted, 0, 0);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EBUSY)
+                return; // Retried on the next submit
+            throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+        }
+        _sq_unsubmitted -= std::min<unsigned int>(ret, _sq_unsubmitted);
+    }
+}
+
+void IOMonitor::UringShard::_provide(uint16_t buffer, unsigned int count) {
+    auto sqe = _sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(count);
+    sqe->addr = reinterpret_cast<uint64_t>(_buffers.data() + buffer * buffer_size);
+    sqe->len = buffer_size;
+    sqe->off = buffer;
+    sqe->buf_group = buffer_group;
+    sqe->user_data = pack(OpProvide, 0);
+}
+
+void IOMonitor::UringShard::_armWake() {
+    auto sqe = _sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = _event_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&_event_value);
+    sqe->len = sizeof(_event_value);
+    sqe->user_data = pack(OpWake, 0);
+}
+
+void IOMonitor::UringShard::_armRead(int fd, uint32_t generation, bool multishot) {
+    auto sqe = _sqe();
+    sqe->fd = fd;
+    if (multishot) {
+        sqe->opcode = op_read_multishot;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = buffer_group;
+        sqe->user_data = pack(OpRead, generation, fd);
+    } else {
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->poll32_events = POLLIN | POLLHUP | POLLERR;
+        sqe->user_data = pack(OpPoll, generation, fd);
+    }
+}
+
+void IOMonitor::UringShard::_armWrite(uint64_t id, const Write& write) {
+    auto sqe = _sqe();
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = write.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(write.data.data());
+    sqe->len = write.data.size();
+    sqe->user_data = pack(OpWrite, id);
+}
+
+void IOMonitor::UringShard::_listen() {
+    while (_is_running) {
+        try {
+            _dispatchRequests();
+        } catch (std::exception& e) {
+            logPrintf(ERROR, "io_uring submission failed: %s", e.what());
+        }
+
+        /* Only the wakeup read may be left unsubmitted here */
+        int ret = io_uring_enter(_ring_fd, _sq_unsubmitted, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            logPrintf(ERROR, "io_uring_enter failed: %s", strerror(errno));
+            break;
+        }
+        if (ret > 0)
+            _sq_unsubmitted -= std::min<unsigned int>(ret, _sq_unsubmitted);
+
+        unsigned int head = *_cq_head;
+        unsigned int tail = load_acquire(_cq_tail);
+        while (head != tail) {
+            const io_uring_cqe cqe = _cqes[head & _cq_mask];
+            store_release(_cq_head, ++head);
+            _complete(cqe);
+
+            if (head == tail)
+                tail = load_acquire(_cq_tail);
+        }
+    }
+}
+
+void IOMonitor::UringShard::_complete(const io_uring_cqe& cqe) {
+    auto op = static_cast<Operation>(cqe.user_data >> 56);
+    auto generation = static_cast<uint32_t>(cqe.user_data >> 32) & generation_mask;
+    auto fd = static_cast<int>(static_cast<uint32_t>(cqe.user_data));
+
+    try {
+        switch (op) {
+            case OpWake:
+                _armWake();
+                break;
+            case OpRead:
+                _completeRead(fd, generation, cqe);
+                break;
+            case OpPoll:
+                _completePoll(fd, generation, cqe);
+                break;
+            case OpWrite:
+                _completeWrite(cqe.user_data & id_mask, cqe.res);
+                break;
+            case OpCancel:
+            case OpProvide:
+                break;
+        }
+    } catch (std::exception& e) {
+        logPrintf(ERROR, "Unhandled I/O handler error: %s", e.what());
+    }
+}
+
+void IOMonitor::UringShard::_completeRead(int fd, uint32_t generation,
+                                          const io_uring_cqe& cqe) {
+    std::optional<uint16_t> buffer;
+    if (cqe.flags & IORING_CQE_F_BUFFER)
+        buffer = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+
+    auto handler = _handler(fd, generation);
+    bool rearm = false;
+
+    try {
+        if (!handler) {
+            // Removed, nothing to do
+        } else if (cqe.res > 0 && buffer.has_value()) {
+            handler->data({_buffers.data() + buffer.value() * buffer_size,
+                           static_cast<std::size_t>(cqe.res)});
+            rearm = true;
+        } else if (cqe.res == 0) {
+            handler->hangup();
+        } else if (cqe.res == -ENOBUFS) {
+            rearm = true;
+        } else if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP || cqe.res == -EBADFD) {
+            /* This kernel or file can't do multishot reads */
+            if (cqe.res == -EINVAL)
+                _multishot_read = false;
+            _rearm(fd, generation, false);
+        } else if (cqe.res != -ECANCELED) {
+            handler->error();
+        }
+    } catch (...) {
+        if (buffer.has_value())
+            _recycle(buffer.value());
+        throw;
+    }
+
+    if (buffer.has_value())
+        _recycle(buffer.value());
+
+    if (rearm && !(cqe.flags & IORING_CQE_F_MORE))
+        _rearm(fd, generation, true);
+}
+
+void IOMonitor::UringShard::_completePoll(int fd, uint32_t generation,
+                                          const io_uring_cqe& cqe) {
+    auto handler = _handler(fd, generation);
+    if (!handler || cqe.res == -ECANCELED)
+        return;
+
+    if (cqe.res < 0) {
+        handler->error();
+        return;
+    }
+
+    /* Re-armed first so that a throwing handler doesn't stop the fd */
+    if (!(cqe.res & (POLLHUP | POLLERR)))
+        _rearm(fd, generation, false);
+
+    if (cqe.res & POLLIN)
+        handler->read();
+    if (cqe.res & POLLHUP)
+        handler->hangup();
+    if (cqe.res & POLLERR)
+        handler->error();
+}
+
+void IOMonitor::UringShard::_completeWrite(uint64_t id, int result) {
+    std::lock_guard lock(_mutex);
+    auto it = _writes.find(id);
+    if (it == _writes.end())
+        return;
+
+    auto& write = it->second;
+    if (result == -EPIPE && ++write.tries < max_write_tries &&
+        _registered(write.fd, write.generation)) {
+        _armWrite(id, write);
+        _submit();
+        return;
+    }
+
+    if (result < 0)
+        logPrintf(WARN, "Write to fd %d failed: %s", write.fd, strerror(-result));
+
+    const int fd = write.fd;
+    const uint32_t generation = write.generation;
+    _writes.erase(it);
+
+    auto entry = _fds.find(fd);
+    if (entry == _fds.end() || entry->second.generation != generation)
+        return;
+
+    auto& stats = entry->second.stats;
+    if (result < 0)
+        ++stats.failed;
+    else
+        ++stats.written;
+    stats.depth = entry->second.writes.size();
+
+    if (entry->second.writes.empty()) {
+        entry->second.writing = false;
+    } else {
+        uint64_t next = ++_last_write & id_mask;
+        auto [next_it, inserted] = _writes.emplace(
+                next, Write{fd, generation, std::move(entry->second.writes.front())});
+        entry->second.writes.pop_front();
+        _armWrite(next, next_it->second);
+        _submit();
+    }
+}
+
+bool IOMonitor::UringShard::_registered(int fd, uint32_t generation) const {
+    auto it = _fds.find(fd);
+    return it != _fds.end() && it->second.generation == generation;
+}
+
+void IOMonitor::UringShard::_rearm(int fd, uint32_t generation, bool multishot) {
+    std::lock_guard lock(_mutex);
+    if (_registered(fd, generation)) {
+        _armRead(fd, generation, multishot);
+        _submit();
+    }
+}
+
+std::shared_ptr<IOHandler> IOMonitor::UringShard::_handler(int fd, uint32_t generation) {
+    std::lock_guard lock(_mutex);
+    auto it = _fds.find(fd);
+    if (it == _fds.end() || it->second.generation != generation)
+        return nullptr;
+    return it->second.handler;
+}
+
+void IOMonitor::UringShard::_recycle(uint16_t buffer) {
+    // Submitted along with the next batch
+    _provide(buffer, 1);
+}
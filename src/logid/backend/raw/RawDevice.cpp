@@ -19,7 +19,10 @@
 #include <backend/raw/RawDevice.h>
 #include <backend/raw/DeviceMonitor.h>
 #include <backend/raw/IOMonitor.h>
+#include <backend/raw/VirtualTransport.h>
+#include <backend/raw/ReportTrace.h>
 #include <util/log.h>
+#include <util/latency.h>
 
 #include <string>
 #include <system_error>
@@ -40,8 +43,6 @@ using namespace logid::backend::raw;
 using namespace logid::backend;
 using namespace std::chrono;
 
-static constexpr int max_write_tries = 8;
-
 static const std::regex virtual_path_regex(R"~((.*\/)(.*:)([0-9]+))~");
 
 int get_fd(const std::string& path) {
@@ -107,19 +108,41 @@ std::string get_name(int fd) {
     return {name_buf, static_cast<size_t>(len) - 1};
 }
 
+RawDevice::dev_info get_virtual_info(const TraceDevice& info) {
+    return {static_cast<int16_t>(info.vid), static_cast<int16_t>(info.pid),
+            static_cast<RawDevice::BusType>(info.bus)};
+}
+
 RawDevice::RawDevice(std::string path, const std::shared_ptr<DeviceMonitor>& monitor) :
-        _valid(true), _path(std::move(path)), _fd(get_fd(_path)),
-        _dev_info(get_dev_info(_fd)), _name(get_name(_fd)),
-        _report_desc(getReportDescriptor(_fd)), _io_monitor(monitor->ioMonitor()),
+        _valid(true), _path(std::move(path)), _transport(monitor->transport()),
+        _fd(_transport ? -1 : get_fd(_path)),
+        _dev_info(_transport ? get_virtual_info(_transport->info(_path)) : get_dev_info(_fd)),
+        _name(_transport ? _transport->info(_path).name : get_name(_fd)),
+        _report_desc(_transport ? _transport->reportDescriptor(_path) : getReportDescriptor(_fd)),
+        _io_monitor(monitor->ioMonitor()),
         _event_handlers(std::make_shared<EventHandlerList<RawDevice>>()) {
 
-    if (busType() == USB) {
+    if (_transport) {
+        _sub_device = _transport->info(_path).sub_device;
+    } else if (busType() == USB) {
         auto phys = get_phys(_fd);
         _sub_device = std::regex_match(phys, virtual_path_regex);
     }
+
+    _trace_id = traceDeviceId({_path, _name, static_cast<uint16_t>(_dev_info.vid),
+                               static_cast<uint16_t>(_dev_info.pid),
+                               static_cast<uint8_t>(_dev_info.bus_type), _sub_device});
 }
 
 void RawDevice::_ready() {
+    if (_transport) {
+        _transport->attach(_path, [self_weak = _self](std::span<const uint8_t> report) {
+            if (auto self = self_weak.lock())
+                self->_handleReport(report);
+        });
+        return;
+    }
+
     _io_monitor->add(_fd, {
             [self_weak = _self]() {
                 if (auto self = self_weak.lock())
@@ -132,11 +155,20 @@ void RawDevice::_ready() {
             [self_weak = _self]() {
                 if (auto self = self_weak.lock())
                     self->_valid = false;
+            },
+            [self_weak = _self](std::span<const uint8_t> report) {
+                if (auto self = self_weak.lock())
+                    self->_handleReport(report);
             }
     });
 }
 
 RawDevice::~RawDevice() noexcept {
+    if (_transport) {
+        _transport->detach(_path);
+        return;
+    }
+
     _io_monitor->remove(_fd);
     ::close(_fd);
 }
@@ -198,7 +230,7 @@ const std::vector<uint8_t>& RawDevice::reportDescriptor() const {
     return _report_desc;
 }
 
-void RawDevice::sendReport(const std::vector<uint8_t>& report) {
+void RawDevice::sendReport(std::span<const uint8_t> report) {
     if (!_valid) {
         // We could throw an error here, but this will likely be closed soon.
         return;
@@ -211,38 +243,58 @@ void RawDevice::sendReport(const std::vector<uint8_t>& report) {
         printf("\n");
     }
 
+    /* The response may be read and traced before the write returns, so the
+     * request has to be in the trace first */
+    traceReport(_trace_id, TraceDirection::Out, report);
 
-    for (int i = 0; i < max_write_tries && write(_fd, report.data(), report.size()) == -1; ++i) {
-        auto err = errno;
-        if (err != EPIPE)
-            throw std::system_error(err, std::system_category(),
-                                    "sendReport write failed");
-    }
+    if (_transport)
+        _transport->sendReport(_path, report);
+    else if (!_io_monitor->write(_fd, report))
+        throw std::system_error(EAGAIN, std::system_category(),
+                                "sendReport queue full");
+}
+
+WriteStats RawDevice::writeStats() const {
+    if (_transport)
+        return {};
+    return _io_monitor->writeStats(_fd);
 }
 
 EventHandlerLock<RawDevice> RawDevice::addEventHandler(RawEventHandler handler) {
     return {_event_handlers, _event_handlers->add(std::forward<RawEventHandler>(handler))};
 }
 
+std::optional<uint16_t> RawDevice::eventKey(std::span<const uint8_t> report) {
+    if (report.size() < 2)
+        return {};
+    return eventKey(report[1]);
+}
+
 void RawDevice::_readReports() {
     uint8_t buf[max_data_length];
     ssize_t len;
 
     while (-1 != (len = ::read(_fd, buf, max_data_length))) {
         assert(len <= max_data_length);
-        std::vector<uint8_t> report(buf, buf + len);
+        _handleReport({buf, static_cast<std::size_t>(len)});
+    }
+}
 
-        if (logid::global_loglevel <= LogLevel::RAWREPORT) {
-            printf("[RAWREPORT] %s IN:  ", _path.c_str());
-            for (auto& i: report)
-                printf("%02x ", i);
-            printf("\n");
-        }
+void RawDevice::_handleReport(std::span<const uint8_t> report) {
+    latency_scope latency;
 
-        _handleEvent(report);
+    if (logid::global_loglevel <= LogLevel::RAWREPORT) {
+        printf("[RAWREPORT] %s IN:  ", _path.c_str());
+        for (auto& i: report)
+            printf("%02x ", i);
+        printf("\n");
     }
+
+    traceReport(_trace_id, TraceDirection::In, report);
+
+    _handleEvent(report);
 }
 
-void RawDevice::_handleEvent(const std::vector<uint8_t>& report) {
+void RawDevice::_handleEvent(std::span<const uint8_t> report) {
     _event_handlers->run_all(report);
 }
@@ -23,6 +23,7 @@
 #include <backend/EventHandlerList.h>
 #include <string>
 #include <vector>
+#include <span>
 #include <shared_mutex>
 #include <atomic>
 #include <future>
@@ -34,6 +35,10 @@ namespace logid::backend::raw {
 
     class IOMonitor;
 
+    class VirtualTransport;
+
+    struct WriteStats;
+
     template <typename T>
     class RawDeviceWrapper : public T {
     public:
@@ -90,10 +95,20 @@ namespace logid::backend::raw {
 
         [[nodiscard]] const std::vector<uint8_t>& reportDescriptor() const;
 
-        void sendReport(const std::vector<uint8_t>& report);
+        /* Never blocks, throws if too many reports are waiting to be sent */
+        void sendReport(std::span<const uint8_t> report);
+
+        [[nodiscard]] WriteStats writeStats() const;
 
         [[nodiscard]] EventHandlerLock<RawDevice> addEventHandler(RawEventHandler handler);
 
+        /* Reports are dispatched by their device index byte */
+        static std::optional<uint16_t> eventKey(std::span<const uint8_t> report);
+
+        static constexpr uint16_t eventKey(uint8_t device_index) {
+            return device_index;
+        }
+
     private:
         RawDevice(std::string path, const std::shared_ptr<DeviceMonitor>& monitor);
 
@@ -101,9 +116,15 @@ namespace logid::backend::raw {
 
         void _readReports();
 
+        void _handleReport(std::span<const uint8_t> report);
+
         std::atomic_bool _valid;
 
         const std::string _path;
+
+        /* Set if the device isn't a hidraw node */
+        const std::shared_ptr<VirtualTransport> _transport;
+
         const int _fd;
         const dev_info _dev_info;
         const std::string _name;
@@ -111,13 +132,15 @@ namespace logid::backend::raw {
 
         std::shared_ptr<IOMonitor> _io_monitor;
 
+        uint16_t _trace_id;
+
         std::weak_ptr<RawDevice> _self;
 
         bool _sub_device = false;
 
         std::shared_ptr<EventHandlerList<RawDevice>> _event_handlers;
 
-        void _handleEvent(const std::vector<uint8_t>& report);
+        void _handleEvent(std::span<const uint8_t> report);
     };
 }
 
@@ -0,0 +1,442 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <backend/raw/ReportReplay.h>
+#include <backend/hidpp/Report.h>
+#include <backend/hidpp10/Error.h>
+#include <backend/hidpp10/defs.h>
+#include <backend/hidpp20/Error.h>
+#include <util/log.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+extern "C"
+{
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+}
+
+using namespace logid;
+using namespace logid::backend;
+using namespace logid::backend::raw;
+using namespace logid::backend::hidpp;
+
+namespace {
+    constexpr std::size_t header_length = Offset::Address + 1;
+    constexpr uint8_t sw_id_mask = 0x0f;
+
+    /* HID++ 2.0 requests go to a feature index rather than a register and
+     * carry a software ID in the low nibble of the address. logid hands
+     * those out in turn, so they differ between runs. */
+    bool has_sw_id(std::span<const uint8_t> request) {
+        return request[Offset::SubID] < hidpp10::SetRegisterShort;
+    }
+
+    uint8_t address(std::span<const uint8_t> request, uint8_t address) {
+        return has_sw_id(request) ? (address & ~sw_id_mask) : address;
+    }
+
+    /* Whether in answers the request out, the same header or an error about it */
+    bool is_response(std::span<const uint8_t> in, std::span<const uint8_t> out) {
+        if (in.size() <= Offset::Parameters || out.size() < header_length)
+            return false;
+        if (in[Offset::DeviceIndex] != out[Offset::DeviceIndex])
+            return false;
+
+        // Notifications have no software ID, responses always do
+        if (in[Offset::SubID] == out[Offset::SubID] &&
+            address(out, in[Offset::Address]) == address(out, out[Offset::Address]))
+            return !has_sw_id(out) || (in[Offset::Address] & sw_id_mask);
+
+        return (in[Offset::SubID] == hidpp10::ErrorID ||
+                in[Offset::SubID] == hidpp20::ErrorID) &&
+               in[Offset::Address] == out[Offset::SubID] &&
+               address(out, in[Offset::Parameters]) == address(out, out[Offset::Address]);
+    }
+
+    /* The whole request, without its software ID */
+    std::vector<uint8_t> request_key(std::span<const uint8_t> request) {
+        std::vector<uint8_t> key(request.begin(), request.end());
+        key[Offset::Address] = address(request, key[Offset::Address]);
+        return key;
+    }
+
+    std::vector<uint8_t> header_key(std::span<const uint8_t> request) {
+        auto key = request_key(request.first(header_length));
+        return {key.begin() + Offset::DeviceIndex, key.end()};
+    }
+
+    /* Gives a recorded response the software ID of the live request */
+    std::vector<uint8_t> with_sw_id(std::vector<uint8_t> response,
+                                    std::span<const uint8_t> request) {
+        if (!has_sw_id(request) || response.size() <= Offset::Parameters)
+            return response;
+
+        const uint8_t sw_id = request[Offset::Address] & sw_id_mask;
+        auto& target = response[Offset::SubID] == hidpp20::ErrorID ?
+                       response[Offset::Parameters] : response[Offset::Address];
+        target = (target & ~sw_id_mask) | sw_id;
+        return response;
+    }
+}
+
+ReportReplay::ReportReplay(const std::string& path, double speed) :
+        _speed(std::max(speed, 0.0)) {
+    _load(path);
+
+    auto now = clock::now();
+    for (auto& device: _devices) {
+        device.second.last_request = now;
+        device.second.anchor = now;
+    }
+
+    _thread = std::thread([this]() { _run(); });
+}
+
+ReportReplay::~ReportReplay() noexcept {
+    {
+        std::lock_guard lock(_mutex);
+        _stop = true;
+    }
+    _cv.notify_all();
+    _thread.join();
+}
+
+void ReportReplay::_load(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::system_error(errno, std::system_category(), "replay open failed");
+
+    struct stat st{};
+    if (::fstat(fd, &st)) {
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::system_category(), "replay fstat failed");
+    }
+
+    const auto size = static_cast<std::size_t>(st.st_size);
+    if (size < sizeof(TraceHeader)) {
+        ::close(fd);
+        throw std::runtime_error("replay file is too short");
+    }
+
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        throw std::system_error(errno, std::system_category(), "replay mmap failed");
+
+    auto base = static_cast<const uint8_t*>(map);
+    const auto& header = *reinterpret_cast<const TraceHeader*>(base);
+    const std::size_t table_size = std::size_t(header.device_entries) * sizeof(TraceDeviceEntry);
+
+    if (std::memcmp(header.magic, trace_magic, sizeof(trace_magic)) != 0 ||
+        header.version != trace_version ||
+        header.header_size != sizeof(TraceHeader) ||
+        header.device_entry_size != sizeof(TraceDeviceEntry) ||
+        header.record_size != sizeof(TraceRecord) ||
+        size < sizeof(TraceHeader) + table_size +
+               std::size_t(header.capacity) * sizeof(TraceRecord)) {
+        ::munmap(map, size);
+        throw std::runtime_error("not a supported trace");
+    }
+
+    auto entries = reinterpret_cast<const TraceDeviceEntry*>(base + sizeof(TraceHeader));
+    std::vector<TraceRecord> records(
+            reinterpret_cast<const TraceRecord*>(base + sizeof(TraceHeader) + table_size),
+            reinterpret_cast<const TraceRecord*>(base + sizeof(TraceHeader) + table_size) +
+            header.capacity);
+
+    std::map<uint16_t, Device*> ids;
+    for (uint32_t i = 0; i < header.device_entries; ++i) {
+        const auto& entry = entries[i];
+        TraceDevice info;
+        info.path.assign(entry.path, strnlen(entry.path, sizeof(entry.path)));
+        if (info.path.empty())
+            continue;
+        info.name.assign(entry.name, strnlen(entry.name, sizeof(entry.name)));
+        info.vid = entry.vid;
+        info.pid = entry.pid;
+        info.bus = entry.bus;
+        info.sub_device = entry.flags & trace_sub_device;
+
+        /* A path may have been reused during the capture, the last device
+         * on it wins. */
+        auto& device = _devices[info.path];
+        device = Device();
+        device.info = std::move(info);
+        ids[static_cast<uint16_t>(i)] = &device;
+    }
+
+    ::munmap(map, size);
+
+    records.erase(std::remove_if(records.begin(), records.end(), [](const TraceRecord& r) {
+        return r.sequence == 0 || r.sequence == trace_slot_busy;
+    }), records.end());
+    std::sort(records.begin(), records.end(), [](const TraceRecord& a, const TraceRecord& b) {
+        return a.sequence < b.sequence;
+    });
+
+    struct Request {
+        std::size_t answer;
+        std::vector<uint8_t> report;
+    };
+
+    std::map<Device*, std::deque<Request>> unanswered;
+
+    for (auto& record: records) {
+        auto it = ids.find(record.device);
+        if (it == ids.end())
+            continue;
+
+        auto& device = *it->second;
+        std::span<const uint8_t> report(record.data, std::min<std::size_t>(
+                record.length, sizeof(record.data)));
+        if (report.empty())
+            continue;
+
+        if (report[Offset::Type] == ReportType::Short)
+            device.short_reports = true;
+        else if (report[Offset::Type] == ReportType::Long)
+            device.long_reports = true;
+
+        if (record.direction == static_cast<uint8_t>(TraceDirection::Out)) {
+            if (report.size() < header_length)
+                continue;
+
+            std::vector<uint8_t> request(report.begin(), report.end());
+            const auto index = device.answers.size();
+            device.answers.push_back({record.timestamp, {}});
+            device.queues[request_key(request)].pending.push_back(index);
+            device.queues[header_key(request)].pending.push_back(index);
+            unanswered[&device].push_back({index, std::move(request)});
+        } else {
+            auto& requests = unanswered[&device];
+            auto request = std::find_if(requests.begin(), requests.end(),
+                                        [report](const Request& r) {
+                                            return is_response(report, r.report);
+                                        });
+
+            if (request != requests.end()) {
+                auto& answer = device.answers[request->answer];
+                answer.responses.push_back({record.timestamp - answer.timestamp,
+                                            {report.begin(), report.end()}});
+                requests.erase(request);
+            } else {
+                device.events.push_back({device.answers.size(), record.timestamp,
+                                         {report.begin(), report.end()}});
+            }
+        }
+    }
+
+    for (auto& [path, device]: _devices) {
+        device.answered.resize(device.answers.size());
+
+        // Timing starts from the device's first record
+        device.anchor_timestamp = UINT64_MAX;
+        if (!device.events.empty())
+            device.anchor_timestamp = device.events.front().timestamp;
+        if (!device.answers.empty())
+            device.anchor_timestamp = std::min(device.anchor_timestamp,
+                                               device.answers.front().timestamp);
+    }
+
+    logPrintf(INFO, "Replaying %zu records for %zu devices from %s",
+              records.size(), _devices.size(), path.c_str());
+}
+
+std::vector<std::string> ReportReplay::devices() const {
+    std::vector<std::string> paths;
+    for (auto& device: _devices)
+        paths.push_back(device.first);
+    return paths;
+}
+
+TraceDevice ReportReplay::info(const std::string& path) const {
+    return _devices.at(path).info;
+}
+
+std::vector<uint8_t> ReportReplay::reportDescriptor(const std::string& path) const {
+    const auto& device = _devices.at(path);
+    uint8_t supported = 0;
+    if (device.short_reports)
+        supported |= ShortReportSupported;
+    if (device.long_reports)
+        supported |= LongReportSupported;
+    return makeReportDescriptor(supported);
+}
+
+void ReportReplay::attach(const std::string& path, Handler handler) {
+    {
+        std::lock_guard lock(_mutex);
+        auto& device = _devices.at(path);
+        device.handler = std::move(handler);
+        device.last_request = clock::now();
+        device.anchor = device.last_request;
+    }
+    _cv.notify_all();
+}
+
+void ReportReplay::detach(const std::string& path) noexcept {
+    std::lock_guard lock(_mutex);
+    auto it = _devices.find(path);
+    if (it != _devices.end())
+        it->second.handler = {};
+}
+
+void ReportReplay::sendReport(const std::string& path, std::span<const uint8_t> report) {
+    {
+        std::lock_guard lock(_mutex);
+        auto& device = _devices.at(path);
+        const auto now = clock::now();
+
+        device.requests++;
+        device.last_request = now;
+
+        auto answer = _answer(device, report);
+        if (!answer) {
+            logPrintf(DEBUG, "Replay of %s has no answer to a request", path.c_str());
+            return;
+        }
+
+        device.anchor = now;
+        device.anchor_timestamp = answer->timestamp;
+
+        for (auto& response: answer->responses)
+            _deliveries.push({now + _scale(response.delay), _delivery_order++,
+                              path, with_sw_id(response.report, report)});
+    }
+    _cv.notify_all();
+}
+
+const ReportReplay::Answer* ReportReplay::_answer(Device& device,
+                                                  std::span<const uint8_t> request) {
+    if (request.size() < header_length)
+        return nullptr;
+
+    const std::vector<uint8_t> keys[] = {request_key(request), header_key(request)};
+
+    for (auto& key: keys) {
+        auto it = device.queues.find(key);
+        if (it == device.queues.end())
+            continue;
+
+        auto& queue = it->second;
+        while (!queue.pending.empty() && device.answered[queue.pending.front()])
+            queue.pending.pop_front();
+
+        if (!queue.pending.empty()) {
+            auto index = queue.pending.front();
+            queue.pending.pop_front();
+            device.answered[index] = true;
+            queue.last = index;
+            return &device.answers[index];
+        }
+    }
+
+    /* Repeat the last answer once the recorded ones run out */
+    for (auto& key: keys) {
+        auto it = device.queues.find(key);
+        if (it != device.queues.end() && it->second.last)
+            return &device.answers[*it->second.last];
+    }
+
+    return nullptr;
+}
+
+ReportReplay::clock::duration ReportReplay::_scale(uint64_t ns) const {
+    if (_speed == 0)
+        return clock::duration::zero();
+    return std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double, std::nano>(static_cast<double>(ns) / _speed));
+}
+
+void ReportReplay::_run() {
+    std::unique_lock lock(_mutex);
+
+    while (!_stop) {
+        const auto now = clock::now();
+        auto next = clock::time_point::max();
+        std::vector<Delivery> ready;
+
+        while (!_deliveries.empty() && _deliveries.top().due <= now) {
+            ready.push_back(_deliveries.top());
+            _deliveries.pop();
+        }
+        if (!_deliveries.empty())
+            next = _deliveries.top().due;
+
+        for (auto& [path, device]: _devices) {
+            if (!device.handler)
+                continue;
+
+            while (!device.events.empty()) {
+                auto& event = device.events.front();
+
+                if (device.requests < event.after_requests) {
+                    const auto settled = device.last_request + settle_time;
+                    if (now < settled) {
+                        next = std::min(next, settled);
+                        break;
+                    }
+                }
+
+                const auto due = device.anchor + _scale(
+                        event.timestamp > device.anchor_timestamp ?
+                        event.timestamp - device.anchor_timestamp : 0);
+                if (due > now) {
+                    next = std::min(next, due);
+                    break;
+                }
+
+                ready.push_back({due, _delivery_order++, path, std::move(event.report)});
+                device.anchor = due;
+                device.anchor_timestamp = event.timestamp;
+                device.events.pop_front();
+            }
+        }
+
+        if (ready.empty()) {
+            if (next == clock::time_point::max())
+                _cv.wait(lock);
+            else
+                _cv.wait_until(lock, next);
+            continue;
+        }
+
+        std::sort(ready.begin(), ready.end(), [](const Delivery& a, const Delivery& b) {
+            return b > a;
+        });
+
+        for (auto& delivery: ready) {
+            auto it = _devices.find(delivery.path);
+            if (it == _devices.end() || !it->second.handler)
+                continue;
+
+            auto handler = it->second.handler;
+            lock.unlock();
+            handler(delivery.report);
+            lock.lock();
+
+            if (_stop)
+                break;
+        }
+    }
+}
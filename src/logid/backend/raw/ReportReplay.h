@@ -0,0 +1,148 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LOGID_BACKEND_RAW_REPORTREPLAY_H
+#define LOGID_BACKEND_RAW_REPORTREPLAY_H
+
+#include <backend/raw/VirtualTransport.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace logid::backend::raw {
+    /*
+     * Plays back a trace written by startTrace in place of the hidraw
+     * devices it recorded. Requests are answered with the responses
+     * recorded for them and everything else the devices sent is replayed
+     * as events, in the order it was recorded relative to each device's
+     * requests.
+     */
+    class ReportReplay : public VirtualTransport {
+    public:
+        /* speed scales the recorded timing, 0 replays as fast as possible */
+        explicit ReportReplay(const std::string& path, double speed = 1.0);
+
+        ReportReplay(const ReportReplay&) = delete;
+
+        ReportReplay& operator=(const ReportReplay&) = delete;
+
+        ~ReportReplay() noexcept override;
+
+        [[nodiscard]] std::vector<std::string> devices() const override;
+
+        [[nodiscard]] TraceDevice info(const std::string& path) const override;
+
+        /* Made up from the report types the device used */
+        [[nodiscard]] std::vector<uint8_t>
+        reportDescriptor(const std::string& path) const override;
+
+        void attach(const std::string& path, Handler handler) override;
+
+        void detach(const std::string& path) noexcept override;
+
+        /* Responses arrive on the replay thread */
+        void sendReport(const std::string& path, std::span<const uint8_t> report) override;
+
+        /* How long a device with outstanding events may go without sending
+         * a request before its events stop waiting for requests that the
+         * recording had but this run didn't make. */
+        static constexpr std::chrono::milliseconds settle_time{100};
+
+    private:
+        typedef std::chrono::steady_clock clock;
+
+        struct Response {
+            uint64_t delay; // ns after the request
+            std::vector<uint8_t> report;
+        };
+
+        struct Answer {
+            uint64_t timestamp;
+            std::vector<Response> responses;
+        };
+
+        struct Event {
+            uint64_t after_requests;
+            uint64_t timestamp;
+            std::vector<uint8_t> report;
+        };
+
+        /* Answers to one request, by the exact report or by its header */
+        struct AnswerQueue {
+            std::deque<std::size_t> pending;
+            std::optional<std::size_t> last;
+        };
+
+        struct Device {
+            TraceDevice info;
+            bool short_reports = false;
+            bool long_reports = false;
+
+            std::vector<Answer> answers;
+            std::vector<bool> answered;
+            std::map<std::vector<uint8_t>, AnswerQueue> queues;
+            std::deque<Event> events;
+
+            Handler handler;
+            uint64_t requests = 0;
+            clock::time_point last_request;
+            clock::time_point anchor;
+            uint64_t anchor_timestamp = 0;
+        };
+
+        struct Delivery {
+            clock::time_point due;
+            uint64_t order;
+            std::string path;
+            std::vector<uint8_t> report;
+
+            bool operator>(const Delivery& o) const {
+                return due > o.due || (due == o.due && order > o.order);
+            }
+        };
+
+        void _load(const std::string& path);
+
+        const Answer* _answer(Device& device, std::span<const uint8_t> request);
+
+        [[nodiscard]] clock::duration _scale(uint64_t ns) const;
+
+        void _run();
+
+        const double _speed;
+        std::map<std::string, Device> _devices;
+
+        mutable std::mutex _mutex;
+        std::condition_variable _cv;
+        std::priority_queue<Delivery, std::vector<Delivery>, std::greater<>> _deliveries;
+        uint64_t _delivery_order = 0;
+        bool _stop = false;
+
+        std::thread _thread;
+    };
+}
+
+#endif //LOGID_BACKEND_RAW_REPORTREPLAY_H
@@ -0,0 +1,233 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <backend/raw/ReportTrace.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+extern "C"
+{
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+}
+
+using namespace logid::backend::raw;
+
+namespace {
+    constexpr uint32_t device_entries = 256;
+    constexpr uint32_t default_records = 1 << 16;
+    constexpr uint32_t min_records = 1 << 10;
+    constexpr uint32_t max_records = 1 << 24;
+
+    uint64_t clock_ns(clockid_t clock) {
+        timespec ts{};
+        ::clock_gettime(clock, &ts);
+        return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    class Trace {
+    public:
+        Trace(const std::string& path, uint32_t capacity);
+
+        Trace(const Trace&) = delete;
+
+        Trace& operator=(const Trace&) = delete;
+
+        ~Trace() noexcept;
+
+        void setDevice(uint16_t id, const TraceDevice& device);
+
+        void record(uint16_t device, TraceDirection direction,
+                    std::span<const uint8_t> report);
+
+    private:
+        int _fd;
+        std::size_t _size;
+        void* _map;
+
+        TraceHeader* _header;
+        TraceDeviceEntry* _devices;
+        TraceRecord* _records;
+        const uint32_t _capacity;
+
+        std::atomic<uint64_t> _next = 0;
+    };
+
+    /* Guards the device IDs and starting or stopping a capture */
+    std::mutex trace_mutex;
+    std::vector<TraceDevice> devices;
+
+    /* Reporting threads count themselves in before touching the active
+     * trace so that it isn't unmapped under them. */
+    std::atomic<Trace*> active_trace = nullptr;
+    std::atomic<unsigned int> trace_users = 0;
+
+    void retire(Trace* trace) {
+        while (trace_users.load())
+            std::this_thread::yield();
+        delete trace;
+    }
+}
+
+Trace::Trace(const std::string& path, uint32_t capacity) :
+        _capacity(std::clamp(capacity ? capacity : default_records,
+                             min_records, max_records)) {
+    _size = sizeof(TraceHeader) + device_entries * sizeof(TraceDeviceEntry) +
+            _capacity * sizeof(TraceRecord);
+
+    /* The path comes over IPC and logid runs as root, so never follow a
+     * symlink or overwrite an existing file */
+    _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0640);
+    if (_fd < 0)
+        throw std::system_error(errno, std::system_category(), "trace open failed");
+
+    if (::ftruncate(_fd, static_cast<off_t>(_size))) {
+        int err = errno;
+        ::close(_fd);
+        throw std::system_error(err, std::system_category(), "trace ftruncate failed");
+    }
+
+    _map = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (_map == MAP_FAILED) {
+        int err = errno;
+        ::close(_fd);
+        throw std::system_error(err, std::system_category(), "trace mmap failed");
+    }
+
+    auto base = static_cast<uint8_t*>(_map);
+    _header = reinterpret_cast<TraceHeader*>(base);
+    _devices = reinterpret_cast<TraceDeviceEntry*>(base + sizeof(TraceHeader));
+    _records = reinterpret_cast<TraceRecord*>(
+            base + sizeof(TraceHeader) + device_entries * sizeof(TraceDeviceEntry));
+
+    std::memcpy(_header->magic, trace_magic, sizeof(trace_magic));
+    _header->version = trace_version;
+    _header->header_size = sizeof(TraceHeader);
+    _header->device_entries = device_entries;
+    _header->device_entry_size = sizeof(TraceDeviceEntry);
+    _header->record_size = sizeof(TraceRecord);
+    _header->capacity = _capacity;
+    _header->start_realtime = clock_ns(CLOCK_REALTIME);
+    _header->start_monotonic = clock_ns(CLOCK_MONOTONIC);
+}
+
+Trace::~Trace() noexcept {
+    _header->records = _next.load();
+    ::munmap(_map, _size);
+    ::close(_fd);
+}
+
+void Trace::setDevice(uint16_t id, const TraceDevice& device) {
+    if (id >= device_entries)
+        return;
+
+    // The file is zero-filled, so the strings stay NUL-terminated
+    auto& entry = _devices[id];
+    std::memcpy(entry.path, device.path.data(),
+                std::min(device.path.size(), sizeof(entry.path) - 1));
+    std::memcpy(entry.name, device.name.data(),
+                std::min(device.name.size(), sizeof(entry.name) - 1));
+    entry.vid = device.vid;
+    entry.pid = device.pid;
+    entry.bus = device.bus;
+    entry.flags = device.sub_device ? trace_sub_device : 0;
+}
+
+void Trace::record(uint16_t device, TraceDirection direction,
+                   std::span<const uint8_t> report) {
+    const uint64_t n = _next.fetch_add(1, std::memory_order_relaxed);
+    const uint64_t seq = n + 1;
+    auto& record = _records[n % _capacity];
+    std::atomic_ref<uint64_t> sequence(record.sequence);
+
+    /* Only possible if the ring laps a writer; drop the record rather
+     * than interleave two of them. */
+    uint64_t seen = sequence.load(std::memory_order_relaxed);
+    do {
+        if (seen == trace_slot_busy || seen > seq)
+            return;
+    } while (!sequence.compare_exchange_weak(seen, trace_slot_busy, std::memory_order_acquire,
+                                             std::memory_order_relaxed));
+
+    record.timestamp = clock_ns(CLOCK_MONOTONIC);
+    record.device = device;
+    record.direction = static_cast<uint8_t>(direction);
+    record.length = static_cast<uint8_t>(std::min(report.size(), sizeof(record.data)));
+    std::memcpy(record.data, report.data(), record.length);
+    sequence.store(seq, std::memory_order_release);
+}
+
+uint16_t logid::backend::raw::traceDeviceId(const TraceDevice& device) {
+    std::lock_guard lock(trace_mutex);
+
+    /* hidraw paths are reused, so a path only identifies a device along
+     * with the rest of its info. */
+    auto it = std::find(devices.begin(), devices.end(), device);
+    if (it != devices.end())
+        return static_cast<uint16_t>(it - devices.begin());
+
+    if (devices.size() >= UINT16_MAX)
+        return UINT16_MAX;
+
+    auto id = static_cast<uint16_t>(devices.size());
+    devices.push_back(device);
+
+    if (auto trace = active_trace.load())
+        trace->setDevice(id, device);
+
+    return id;
+}
+
+void logid::backend::raw::startTrace(const std::string& path, uint32_t records) {
+    std::lock_guard lock(trace_mutex);
+
+    auto trace = new Trace(path, records);
+    for (std::size_t i = 0; i < devices.size(); ++i)
+        trace->setDevice(static_cast<uint16_t>(i), devices[i]);
+
+    if (auto old = active_trace.exchange(trace))
+        retire(old);
+}
+
+void logid::backend::raw::stopTrace() {
+    std::lock_guard lock(trace_mutex);
+
+    if (auto old = active_trace.exchange(nullptr))
+        retire(old);
+}
+
+bool logid::backend::raw::tracing() {
+    return active_trace.load(std::memory_order_relaxed) != nullptr;
+}
+
+void logid::backend::raw::traceReport(uint16_t device, TraceDirection direction,
+                                      std::span<const uint8_t> report) {
+    if (!active_trace.load(std::memory_order_relaxed))
+        return;
+
+    trace_users.fetch_add(1);
+    if (auto trace = active_trace.load())
+        trace->record(device, direction, report);
+    trace_users.fetch_sub(1);
+}
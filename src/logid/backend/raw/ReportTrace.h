@@ -0,0 +1,143 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LOGID_BACKEND_RAW_REPORTTRACE_H
+#define LOGID_BACKEND_RAW_REPORTTRACE_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+/*
+ * Raw report capture. A trace file is a fixed-size, memory-mapped ring
+ * holding the most recent reports in and out of every hidraw device.
+ * Integers are in host byte order.
+ *
+ * Header, 64 bytes:
+ *    0  char[8]   magic, "LOGIDTRC"
+ *    8  u32       format version, 3
+ *   12  u32       header size, 64
+ *   16  u32       device table entries
+ *   20  u32       device table entry size, 128
+ *   24  u32       record size, 56
+ *   28  u32       record capacity
+ *   32  u64       CLOCK_REALTIME when the capture started, in ns
+ *   40  u64       CLOCK_MONOTONIC when the capture started, in ns
+ *   48  u64       records written, set when the capture stops
+ *   56  u8[8]     reserved
+ *
+ * Device table, right after the header, one entry per device ID. An
+ * entry with an empty path is unused.
+ *    0  char[48]  hidraw path, NUL-padded
+ *   48  char[64]  HID name, NUL-padded
+ *  112  u16       vendor ID
+ *  114  u16       product ID
+ *  116  u8        bus type, 0 USB, 1 Bluetooth, 2 other
+ *  117  u8        flags, bit 0 is set for hid_logitech_dj virtual nodes
+ *  118  u8[10]    reserved
+ *
+ * Records, right after the device table. Record n is in slot
+ * n % capacity, so only the last capacity records are kept.
+ *    0  u64       CLOCK_MONOTONIC timestamp, in ns
+ *    8  u64       n + 1, 0 if the slot is unused, all ones while it is
+ *                 being written
+ *   16  u16       device ID
+ *   18  u8        direction, 0 from the device, 1 to the device
+ *   19  u8        report length
+ *   20  u8[32]    report, HID++ reports have the device index in byte 1
+ *   52  u8[4]     reserved
+ *
+ * If a capture didn't stop cleanly, the record count is 0; the trace can
+ * still be read by ordering the used slots by their sequence number.
+ */
+namespace logid::backend::raw {
+    enum class TraceDirection : uint8_t {
+        In = 0,
+        Out = 1
+    };
+
+    struct TraceHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t header_size;
+        uint32_t device_entries;
+        uint32_t device_entry_size;
+        uint32_t record_size;
+        uint32_t capacity;
+        uint64_t start_realtime;
+        uint64_t start_monotonic;
+        uint64_t records;
+        uint8_t reserved[8];
+    };
+
+    struct TraceDeviceEntry {
+        char path[48];
+        char name[64];
+        uint16_t vid;
+        uint16_t pid;
+        uint8_t bus;
+        uint8_t flags;
+        uint8_t reserved[10];
+    };
+
+    struct TraceRecord {
+        uint64_t timestamp;
+        uint64_t sequence;
+        uint16_t device;
+        uint8_t direction;
+        uint8_t length;
+        uint8_t data[32];
+        uint8_t reserved[4];
+    };
+
+    static_assert(sizeof(TraceHeader) == 64);
+    static_assert(sizeof(TraceDeviceEntry) == 128);
+    static_assert(sizeof(TraceRecord) == 56);
+
+    static constexpr char trace_magic[8] = {'L', 'O', 'G', 'I', 'D', 'T', 'R', 'C'};
+    static constexpr uint32_t trace_version = 3;
+    static constexpr uint8_t trace_sub_device = 1;
+    static constexpr uint64_t trace_slot_busy = UINT64_MAX;
+
+    struct TraceDevice {
+        std::string path;
+        std::string name;
+        uint16_t vid = 0;
+        uint16_t pid = 0;
+        uint8_t bus = 0;
+        bool sub_device = false;
+
+        bool operator==(const TraceDevice&) const = default;
+    };
+
+    /* A small ID for a device, stable for the life of the process */
+    [[nodiscard]] uint16_t traceDeviceId(const TraceDevice& device);
+
+    /* Starts capturing into a new file at path, which must not exist yet.
+     * Replaces any running capture. */
+    void startTrace(const std::string& path, uint32_t records);
+
+    void stopTrace();
+
+    [[nodiscard]] bool tracing();
+
+    /* Does nothing unless a capture is running */
+    void traceReport(uint16_t device, TraceDirection direction,
+                     std::span<const uint8_t> report);
+}
+
+#endif //LOGID_BACKEND_RAW_REPORTTRACE_H
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LOGID_BACKEND_RAW_VIRTUALTRANSPORT_H
+#define LOGID_BACKEND_RAW_VIRTUALTRANSPORT_H
+
+#include <backend/raw/ReportTrace.h>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace logid::backend::raw {
+    /*
+     * Devices that RawDevice talks to in place of hidraw nodes, e.g. a
+     * replayed trace or simulated hardware. Devices are named by path
+     * like hidraw nodes are.
+     */
+    class VirtualTransport {
+    public:
+        typedef std::function<void(std::span<const uint8_t>)> Handler;
+
+        virtual ~VirtualTransport() noexcept = default;
+
+        [[nodiscard]] virtual std::vector<std::string> devices() const = 0;
+
+        [[nodiscard]] virtual TraceDevice info(const std::string& path) const = 0;
+
+        [[nodiscard]] virtual std::vector<uint8_t>
+        reportDescriptor(const std::string& path) const = 0;
+
+        /* Reports from the device at path go to handler until it detaches */
+        virtual void attach(const std::string& path, Handler handler) = 0;
+
+        virtual void detach(const std::string& path) noexcept = 0;
+
+        /* Never blocks, responses must not be delivered from this call */
+        virtual void sendReport(const std::string& path, std::span<const uint8_t> report) = 0;
+    };
+}
+
+#endif //LOGID_BACKEND_RAW_VIRTUALTRANSPORT_H
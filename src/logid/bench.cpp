@@ -0,0 +1,299 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Runs the daemon against simulated devices and reports how long it
+ * takes to set them up, to configure them again and to pass their
+ * input through. Needs write access to /dev/uinput.
+ */
+
+#include <DeviceManager.h>
+#include <InputDevice.h>
+#include <util/task.h>
+#include <util/log.h>
+#include <backend/hidpp/Simulator.h>
+#include <ipc_defs.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+extern "C"
+{
+#include <unistd.h>
+}
+
+using namespace logid;
+using namespace logid::backend;
+using namespace std::chrono;
+
+LogLevel logid::global_loglevel = WARN;
+
+/* Holding the gesture button and moving scrolls, so raw XY events go all
+ * the way through to the virtual input device */
+static constexpr auto default_config = R"(devices: (
+{
+    name: "Simulated Mouse";
+    hiresscroll: { hires: true; target: false; };
+    buttons: (
+        {
+            cid: 0xc3;
+            action = {
+                type: "Gestures";
+                gestures: (
+                    { direction: "Up"; mode: "Axis"; axis: "REL_WHEEL_HI_RES"; },
+                    { direction: "Down"; mode: "Axis"; axis: "REL_WHEEL_HI_RES";
+                      axis_multiplier: -1.0; },
+                    { direction: "Left"; mode: "OnInterval"; interval: 100;
+                      action = { type: "Keypress"; keys: ["KEY_LEFT"]; }; },
+                    { direction: "Right"; mode: "OnInterval"; interval: 100;
+                      action = { type: "Keypress"; keys: ["KEY_RIGHT"]; }; },
+                    { direction: "None"; mode: "NoPress"; }
+                );
+            };
+        }
+    );
+}
+);
+)";
+
+static constexpr uint16_t gesture_cid = 0xc3;
+
+struct BenchOptions {
+    std::string config_file;
+    unsigned int devices = 100;
+    unsigned int receivers = 0;
+    unsigned int events = 1000;
+    unsigned int latency = 1000;
+    unsigned int jitter = 0;
+    unsigned int timeout = 60;
+};
+
+static unsigned int readNumber(const int argc, char** argv, int& i) {
+    if (++i >= argc) {
+        logPrintf(ERROR, "%s needs a value.", argv[i - 1]);
+        exit(EXIT_FAILURE);
+    }
+
+    try {
+        return std::stoul(argv[i]);
+    } catch (std::exception& e) {
+        logPrintf(ERROR, "%s is not a valid number.", argv[i]);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void readBenchOptions(const int argc, char** argv, BenchOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--devices") {
+            options.devices = readNumber(argc, argv, i);
+        } else if (option == "--receivers") {
+            options.receivers = readNumber(argc, argv, i);
+        } else if (option == "--events") {
+            options.events = readNumber(argc, argv, i);
+        } else if (option == "--latency") {
+            options.latency = readNumber(argc, argv, i);
+        } else if (option == "--jitter") {
+            options.jitter = readNumber(argc, argv, i);
+        } else if (option == "--timeout") {
+            options.timeout = readNumber(argc, argv, i);
+        } else if (option == "--config") {
+            if (++i >= argc) {
+                logPrintf(ERROR, "Config file is not specified.");
+                exit(EXIT_FAILURE);
+            }
+            options.config_file = argv[i];
+        } else if (option == "-h" || option == "--help") {
+            printf(R"(Usage: %s [options]
+Possible options are:
+    --devices [count]          Simulated corded mice (default 100)
+    --receivers [count]        Simulated receivers with six paired mice each (default 0)
+    --events [count]           Raw XY events sent by each mouse (default 1000)
+    --latency [us]             Simulated response latency (default 1000)
+    --jitter [us]              Responses are delayed by latency +/- up to this (default 0)
+    --timeout [s]              Give up on a phase after this long (default 60)
+    --config [file path]       Use this configuration instead of the built-in one
+    -h,--help                  Print this message.
+)", argv[0]);
+            exit(EXIT_SUCCESS);
+        } else {
+            logPrintf(WARN, "%s is not a valid option, ignoring.", argv[i]);
+        }
+    }
+}
+
+static std::shared_ptr<Configuration> loadConfig(const BenchOptions& options) {
+    if (!options.config_file.empty())
+        return std::make_shared<Configuration>(options.config_file);
+
+    char path[] = "/tmp/logid-bench-XXXXXX";
+    int fd = ::mkstemp(path);
+    if (fd < 0)
+        throw std::system_error(errno, std::system_category(), "mkstemp failed");
+    std::string text = default_config;
+    bool written = ::write(fd, text.data(), text.size()) == (ssize_t) text.size();
+    ::close(fd);
+
+    std::shared_ptr<Configuration> config;
+    if (written)
+        config = std::make_shared<Configuration>(path);
+    ::unlink(path);
+    if (!config)
+        throw std::runtime_error("could not write the configuration");
+    return config;
+}
+
+/* Polls until done returns true, false if the timeout ran out first */
+template <typename F>
+static bool waitFor(F done, seconds timeout) {
+    auto deadline = steady_clock::now() + timeout;
+    while (!done()) {
+        if (steady_clock::now() >= deadline)
+            return false;
+        std::this_thread::sleep_for(milliseconds(1));
+    }
+    return true;
+}
+
+static uint64_t featureSamples(const std::vector<std::shared_ptr<Device>>& devices) {
+    uint64_t samples = 0;
+    for (auto& device: devices)
+        samples += std::get<3>(device->getLatency("feature"));
+    return samples;
+}
+
+static double elapsedMs(steady_clock::time_point start) {
+    return duration<double, std::milli>(steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options{};
+    readBenchOptions(argc, argv, options);
+    setbuf(stdout, nullptr);
+
+    std::shared_ptr<Configuration> config;
+    std::shared_ptr<InputDevice> virtual_input;
+    try {
+        config = loadConfig(options);
+        virtual_input = std::make_shared<InputDevice>(
+                "LogiOps Benchmark Input", InputDevice::capabilitiesOf(*config));
+    } catch (std::exception& e) {
+        logPrintf(ERROR, "%s", e.what());
+        return EXIT_FAILURE;
+    }
+
+    init_workers(config->workers.value_or(defaults::workers));
+
+    hidpp::Simulator::Config sim_config;
+    sim_config.latency = microseconds(options.latency);
+    sim_config.jitter = microseconds(options.jitter);
+    auto simulator = std::make_shared<hidpp::Simulator>(sim_config);
+
+    for (unsigned int i = 0; i < options.devices; ++i)
+        simulator->addDevice();
+    for (unsigned int i = 0; i < options.receivers; ++i) {
+        auto receiver = simulator->addReceiver();
+        for (unsigned int j = hidpp::WirelessDevice1; j <= hidpp::WirelessDevice6; ++j)
+            simulator->pair(receiver);
+    }
+    const std::size_t expected = options.devices + 6 * options.receivers;
+    const seconds timeout(options.timeout);
+
+    // The server is never started, the IPC interfaces only need to exist
+    auto server = ipcgull::make_server(SERVICE_ROOT_NAME, server_root_node,
+                                       ipcgull::IPCGULL_USER);
+    auto manager = DeviceManager::make<DeviceManager>(config, virtual_input, server,
+                                                      simulator);
+
+    printf("%zu simulated devices, %u us latency, %u us jitter\n",
+           expected, options.latency, options.jitter);
+
+    // Startup: enumeration until every device has been set up and configured
+    auto start = steady_clock::now();
+    manager->enumerate();
+    if (!waitFor([&]() { return manager->listDevices().size() >= expected; }, timeout)) {
+        logPrintf(ERROR, "Only %zu of %zu devices came up",
+                  manager->listDevices().size(), expected);
+        return EXIT_FAILURE;
+    }
+    printf("startup:    %10.2f ms\n", elapsedMs(start));
+
+    auto devices = manager->listDevices();
+
+    // Configure: every device reconfigured at once, as after a resume
+    std::atomic<std::size_t> configured = 0;
+    start = steady_clock::now();
+    for (auto& device: devices) {
+        run_task([device, &configured]() {
+            try {
+                device->reconfigure();
+            } catch (std::exception& e) {
+                logPrintf(WARN, "%s: reconfigure failed: %s", device->name().c_str(), e.what());
+            }
+            ++configured;
+        });
+    }
+    if (!waitFor([&]() { return configured.load() >= devices.size(); }, timeout)) {
+        logPrintf(ERROR, "Only %zu of %zu devices were reconfigured",
+                  configured.load(), devices.size());
+        return EXIT_FAILURE;
+    }
+    printf("configure:  %10.2f ms\n", elapsedMs(start));
+
+    // Throughput: hold the gesture button on every device and move
+    for (auto& device: devices)
+        device->resetLatency();
+
+    start = steady_clock::now();
+    for (auto& device: devices) {
+        auto path = device->hidpp20().devicePath();
+        auto index = device->hidpp20().deviceIndex();
+        if (index == hidpp::CordedDevice)
+            index = hidpp::DefaultDevice;
+
+        simulator->pressButtons(path, index, {gesture_cid});
+        for (unsigned int i = 0; i < options.events; ++i)
+            simulator->moveRawXY(path, index, (int16_t) (i % 16 < 8 ? 3 : -3),
+                                 (int16_t) (i % 32 < 16 ? 5 : -5));
+        simulator->pressButtons(path, index, {});
+    }
+
+    // Each device sends a press, its moves and a release
+    const uint64_t events = devices.size() * (options.events + 2);
+    if (!waitFor([&]() { return featureSamples(devices) >= events; }, timeout)) {
+        logPrintf(ERROR, "Only %llu of %llu events were handled",
+                  (unsigned long long) featureSamples(devices), (unsigned long long) events);
+        return EXIT_FAILURE;
+    }
+    auto elapsed = elapsedMs(start);
+    printf("events:     %10.2f ms, %llu events, %.0f events/s\n", elapsed,
+           (unsigned long long) events, (double) events / (elapsed / 1000));
+
+    double p50 = 0, p99 = 0, worst = 0;
+    for (auto& device: devices) {
+        auto [d50, d99, dmax, samples] = device->getLatency("output");
+        p50 = std::max(p50, d50);
+        p99 = std::max(p99, d99);
+        worst = std::max(worst, dmax);
+    }
+    printf("output latency, worst device: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+           p50, p99, worst);
+
+    return EXIT_SUCCESS;
+}
@@ -298,12 +298,13 @@ namespace logid::config {
         std::optional<std::variant<bool, HiresScroll>> hiresscroll;
         std::optional<ThumbWheel> thumbwheel;
         std::optional<RemapButton> buttons;
+        std::optional<int> gesture_coalesce;
 
         Profile() : group({"dpi", "smartshift", "hiresscroll",
-                           "buttons", "thumbwheel"},
+                           "buttons", "thumbwheel", "gesture_coalesce"},
                           &Profile::dpi, &Profile::smartshift,
                           &Profile::hiresscroll, &Profile::buttons,
-                          &Profile::thumbwheel) {}
+                          &Profile::thumbwheel, &Profile::gesture_coalesce) {}
     };
 
     struct Device : public group {
@@ -317,18 +318,51 @@ namespace logid::config {
         }
     };
 
+    struct RetryPolicy : public group {
+        std::optional<unsigned int> retries;
+        std::optional<double> backoff;
+
+        RetryPolicy() : group({"retries", "backoff"},
+                              &RetryPolicy::retries,
+                              &RetryPolicy::backoff) {}
+    };
+
+    struct Timeouts : public group {
+        std::optional<double> min;
+        std::optional<double> max;
+        std::optional<RetryPolicy> connect;
+        std::optional<RetryPolicy> runtime;
+
+        Timeouts() : group({"min", "max", "connect", "runtime"},
+                           &Timeouts::min,
+                           &Timeouts::max,
+                           &Timeouts::connect,
+                           &Timeouts::runtime) {}
+    };
+
     struct Config : public group {
         std::optional<map<std::string,
                 std::variant<Device, Profile>, string_literal_of<keys::name>>> devices;
         std::optional<std::set<uint16_t>> ignore;
         std::optional<double> io_timeout;
+        std::optional<Timeouts> timeouts;
         std::optional<int> workers;
+        std::optional<int> io_threads;
+        std::optional<std::list<int>> io_cpus;
+        std::optional<std::string> io_backend;
+        std::optional<std::string> virtual_input;
 
-        Config() : group({"devices", "ignore", "io_timeout", "workers"},
+        Config() : group({"devices", "ignore", "io_timeout", "timeouts", "workers",
+                          "io_threads", "io_cpus", "io_backend", "virtual_input"},
                          &Config::devices,
                          &Config::ignore,
                          &Config::io_timeout,
-                         &Config::workers) {}
+                         &Config::timeouts,
+                         &Config::workers,
+                         &Config::io_threads,
+                         &Config::io_cpus,
+                         &Config::io_backend,
+                         &Config::virtual_input) {}
     };
 }
 
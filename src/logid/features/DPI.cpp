@@ -114,6 +114,38 @@ void DPI::setDPI(uint16_t dpi, uint8_t sensor) {
     _adjustable_dpi->setSensorDPI(sensor, getClosestDPI(dpi_list, dpi));
 }
 
+logid::async_task<uint16_t> DPI::getDPIAsync(uint8_t sensor) {
+    return _adjustable_dpi->getSensorDPIAsync(sensor);
+}
+
+logid::async_task<void> DPI::setDPIAsync(uint16_t dpi, uint8_t sensor) {
+    if (dpi == 0)
+        co_return;
+    auto dpi_list = co_await _getDPIListAsync(sensor);
+    co_await _adjustable_dpi->setSensorDPIAsync(sensor, getClosestDPI(dpi_list, dpi));
+}
+
+logid::async_task<hidpp20::AdjustableDPI::SensorDPIList>
+DPI::_getDPIListAsync(uint8_t sensor) {
+    /* Locks may not be held across a co_await, the coroutine may resume
+     * on another thread. */
+    while (true) {
+        std::size_t next;
+        {
+            std::shared_lock lock(_dpi_list_mutex);
+            if (_dpi_lists.size() > sensor)
+                co_return _dpi_lists[sensor];
+            next = _dpi_lists.size();
+        }
+
+        auto dpi_list = co_await _adjustable_dpi->getSensorDPIListAsync(next);
+
+        std::unique_lock lock(_dpi_list_mutex);
+        if (_dpi_lists.size() == next)
+            _dpi_lists.push_back(std::move(dpi_list));
+    }
+}
+
 void DPI::_fillDPILists(uint8_t sensor) {
     bool needs_fill;
     {
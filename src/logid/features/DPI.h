@@ -37,12 +37,19 @@ namespace logid::features {
 
         void setDPI(uint16_t dpi, uint8_t sensor = 0);
 
+        async_task<uint16_t> getDPIAsync(uint8_t sensor = 0);
+
+        async_task<void> setDPIAsync(uint16_t dpi, uint8_t sensor = 0);
+
     protected:
         explicit DPI(Device* dev);
 
     private:
         void _fillDPILists(uint8_t sensor);
 
+        async_task<backend::hidpp20::AdjustableDPI::SensorDPIList>
+        _getDPIListAsync(uint8_t sensor);
+
         class IPC : public ipcgull::interface {
         public:
             explicit IPC(DPI* parent);
@@ -44,24 +44,34 @@ void DeviceStatus::configure() {
 void DeviceStatus::listen() {
     if (_ev_handler.empty()) {
         _ev_handler = _device->hidpp20().addEventHandler(
-                {[index = _wireless_device_status->featureIndex()](
-                        const hidpp::Report& report) -> bool {
-                    return report.feature() == index &&
-                           report.function() ==
-                           hidpp20::WirelessDeviceStatus::StatusBroadcast;
+                {.callback = [self_weak = self<DeviceStatus>()](const hidpp::Report& report) {
+                    auto event = hidpp20::WirelessDeviceStatus::statusBroadcastEvent(report);
+                    if (event.reconfNeeded) {
+                        if (auto self = self_weak.lock())
+                            self->_scheduleWakeup();
+                    }
                 },
-                 [self_weak = self<DeviceStatus>()](
-                         const hidpp::Report& report) {
-                     auto event = hidpp20::WirelessDeviceStatus::statusBroadcastEvent(report);
-                     if (event.reconfNeeded)
-                         run_task_after([self_weak]() {
-                             if (auto self = self_weak.lock())
-                                 self->_device->wakeup();
-                         }, std::chrono::milliseconds(100));
-                 }
+                 .key = hidpp::Device::eventKey(
+                         _wireless_device_status->featureIndex(),
+                         hidpp20::WirelessDeviceStatus::StatusBroadcast)
                 });
     }
 }
 
 void DeviceStatus::setProfile(config::Profile&) {
 }
+
+void DeviceStatus::_scheduleWakeup() {
+    static constexpr std::chrono::milliseconds wakeup_delay(100);
+
+    std::lock_guard lock(_wakeup_mutex);
+
+    // A burst of broadcasts shares the wakeup scheduled by the first one
+    if (_wakeup_task.pending())
+        return;
+
+    _wakeup_task = _device->strand().run_after([self_weak = self<DeviceStatus>()]() {
+        if (auto self = self_weak.lock())
+            self->_device->wakeup();
+    }, wakeup_delay);
+}
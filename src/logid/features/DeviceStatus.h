@@ -22,6 +22,7 @@
 #include <features/DeviceFeature.h>
 #include <Device.h>
 #include <backend/hidpp20/features/WirelessDeviceStatus.h>
+#include <util/task.h>
 
 namespace logid::features {
     class DeviceStatus : public DeviceFeature {
@@ -36,8 +37,13 @@ namespace logid::features {
         explicit DeviceStatus(Device* dev);
 
     private:
+        void _scheduleWakeup();
+
         EventHandlerLock<backend::hidpp::Device> _ev_handler;
         std::shared_ptr<backend::hidpp20::WirelessDeviceStatus> _wireless_device_status;
+
+        std::mutex _wakeup_mutex;
+        task_handle _wakeup_task;
     };
 }
 
@@ -19,6 +19,7 @@
 #include <actions/gesture/AxisGesture.h>
 #include <Device.h>
 #include <InputDevice.h>
+#include <util/latency.h>
 #include <ipc_defs.h>
 
 using namespace logid;
@@ -98,15 +99,12 @@ void HiresScroll::listen() {
     std::shared_lock lock(_config_mutex);
     if (_ev_handler.empty()) {
         _ev_handler = _device->hidpp20().addEventHandler(
-                {[index = _hires_scroll->featureIndex()](
-                        const hidpp::Report& report) -> bool {
-                    return (report.feature() == index) &&
-                           (report.function() == hidpp20::HiresScroll::WheelMovement);
+                {.callback = [self_weak = self<HiresScroll>()](const hidpp::Report& report) {
+                    if (auto self = self_weak.lock())
+                        self->_handleScroll(self->_hires_scroll->wheelMovementEvent(report));
                 },
-                 [self_weak = self<HiresScroll>()](const hidpp::Report& report) {
-                     if (auto self = self_weak.lock())
-                         self->_handleScroll(self->_hires_scroll->wheelMovementEvent(report));
-                 }
+                 .key = hidpp::Device::eventKey(_hires_scroll->featureIndex(),
+                                                hidpp20::HiresScroll::WheelMovement)
                 });
     }
 }
@@ -152,6 +150,7 @@ void HiresScroll::_fixGesture(const std::shared_ptr<actions::Gesture>& gesture)
 }
 
 void HiresScroll::_handleScroll(hidpp20::HiresScroll::WheelStatus event) {
+    latency_mark(latency_stage::feature);
     std::shared_lock lock(_config_mutex);
     auto now = std::chrono::system_clock::now();
     if (std::chrono::duration_cast<std::chrono::seconds>(now - _last_scroll).count() >= 1) {
@@ -19,7 +19,9 @@
 #include <actions/GestureAction.h>
 #include <Device.h>
 #include <sstream>
+#include <bit>
 #include <util/log.h>
+#include <util/latency.h>
 #include <ipc_defs.h>
 
 using namespace logid::features;
@@ -68,7 +70,7 @@ RemapButton::RemapButton(Device* dev) : DeviceFeature(dev),
 
                 report.flags |= action->reprogFlags();
             }
-            _reprog_controls->setControlReporting(info.controlID, report);
+            return _reprog_controls->setControlReportingAsync(info.controlID, report);
         };
         _buttons.emplace(control.second.controlID,
                          Button::make(control.second, (int) i,
@@ -76,6 +78,13 @@ RemapButton::RemapButton(Device* dev) : DeviceFeature(dev),
                                       config.value()[control.first]));
     }
 
+    for (const auto& button: _buttons) {
+        _button_cids.emplace(button.first, _button_index.size());
+        _button_index.push_back(button.second);
+    }
+
+    _setCoalesce(dev->activeProfile().gesture_coalesce);
+
     _ipc_interface = _device->ipcNode()->make_interface<IPC>(this);
 
     if (global_loglevel <= DEBUG) {
@@ -93,52 +102,45 @@ RemapButton::RemapButton(Device* dev) : DeviceFeature(dev),
 }
 
 void RemapButton::configure() {
+    // Diverting one control does not depend on another, send them all at once
+    std::vector<async_task<void>> tasks;
+    tasks.reserve(_buttons.size());
     for (const auto& button: _buttons)
-        button.second->configure();
+        tasks.push_back(button.second->configure());
+    get_all(tasks);
 }
 
 void RemapButton::listen() {
     if (_ev_handler.empty()) {
         _ev_handler = _device->hidpp20().addEventHandler(
-                {[index = _reprog_controls->featureIndex()](
-                        const hidpp::Report& report) -> bool {
-                    if (report.feature() == index) {
-                        switch (report.function()) {
-                            case hidpp20::ReprogControls::DivertedButtonEvent:
-                            case hidpp20::ReprogControls::DivertedRawXYEvent:
-                                return true;
-                            default:
-                                return false;
-                        }
-                    }
-                    return false;
+                {.callback = [self_weak = self<RemapButton>()](const hidpp::Report& report) {
+                    if (auto self = self_weak.lock())
+                        self->_buttonEvent(self->_reprog_controls->divertedButtonEvent(report));
                 },
-                 [self_weak = self<RemapButton>()](const hidpp::Report& report) -> void {
+                 .key = hidpp::Device::eventKey(_reprog_controls->featureIndex(),
+                                                hidpp20::ReprogControls::DivertedButtonEvent)
+                });
+    }
+
+    if (_raw_xy_handler.empty()) {
+        _raw_xy_handler = _device->hidpp20().addEventHandler(
+                {.callback = [self_weak = self<RemapButton>()](const hidpp::Report& report) {
                     auto self = self_weak.lock();
                     if (!self)
                         return;
 
-                     switch (report.function()) {
-                         case hidpp20::ReprogControls::DivertedButtonEvent:
-                             self->_buttonEvent(
-                                     self->_reprog_controls->divertedButtonEvent(report));
-                             break;
-                         case hidpp20::ReprogControls::DivertedRawXYEvent: {
-                             auto divertedXY = self->_reprog_controls->divertedRawXYEvent(report);
-                             for (const auto& button: self->_buttons)
-                                 if (button.second->pressed())
-                                     button.second->move(divertedXY.x, divertedXY.y);
-                             break;
-                         }
-                         default:
-                             break;
-                     }
-                 }
+                    latency_mark(latency_stage::feature);
+                    self->_rawXYEvent(self->_reprog_controls->divertedRawXYEvent(report));
+                },
+                 .key = hidpp::Device::eventKey(_reprog_controls->featureIndex(),
+                                                hidpp20::ReprogControls::DivertedRawXYEvent)
                 });
     }
 }
 
 void RemapButton::setProfile(config::Profile& profile) {
+    _setCoalesce(profile.gesture_coalesce);
+
     std::lock_guard<std::mutex> lock(_button_lock);
 
     _config = profile.buttons;
@@ -150,32 +152,104 @@ void RemapButton::setProfile(config::Profile& profile) {
         button.second->setProfile(config[button.first]);
 }
 
-void RemapButton::_buttonEvent(const std::set<uint16_t>& new_state) {
+void RemapButton::_buttonEvent(const hidpp20::ReprogControls::DivertedButtons& cids) {
+    latency_mark(latency_stage::feature);
+
+    ButtonMask new_state{};
+    for (auto cid: cids) {
+        if (!cid)
+            break;
+        auto index = _button_cids.find(cid);
+        if (index != _button_cids.end())
+            new_state[index->second / 64] |= uint64_t(1) << (index->second % 64);
+    }
+
+    // Movement from before the buttons changed goes to the old state
+    std::lock_guard<std::mutex> raw_xy_lock(_raw_xy_lock);
+    _flushRawXY();
+
     // Ensure I/O doesn't occur while updating button state
     std::lock_guard<std::mutex> lock(_button_lock);
 
     // Press all added buttons
-    for (const auto& i: new_state) {
-        auto old_i = _pressed_buttons.find(i);
-        if (old_i != _pressed_buttons.end()) {
-            _pressed_buttons.erase(old_i);
-        } else {
-            auto action = _buttons.find(i);
-            if (action != _buttons.end())
-                action->second->press();
+    for (std::size_t i = 0; i < new_state.size(); ++i) {
+        for (auto added = new_state[i] & ~_pressed_buttons[i]; added; added &= added - 1) {
+            _button_index[i * 64 + std::countr_zero(added)]->press();
+            _raw_xy_pressed = true;
         }
     }
 
     // Release all removed buttons
-    for (auto& i: _pressed_buttons) {
-        auto action = _buttons.find(i);
-        if (action != _buttons.end())
-            action->second->release();
+    for (std::size_t i = 0; i < new_state.size(); ++i) {
+        for (auto removed = _pressed_buttons[i] & ~new_state[i]; removed; removed &= removed - 1)
+            _button_index[i * 64 + std::countr_zero(removed)]->release();
     }
 
     _pressed_buttons = new_state;
 }
 
+void RemapButton::_rawXYEvent(const hidpp20::ReprogControls::Move& move) {
+    std::unique_lock lock(_raw_xy_lock);
+
+    /* Buttons drop the first movement after a press, so it can't be merged
+     * with anything that follows */
+    if (!_raw_xy_window || _raw_xy_pressed) {
+        _raw_xy_pressed = false;
+        _moveButtons(move.x, move.y);
+        return;
+    }
+
+    /* Gestures track direction changes and thresholds as they happen, keep
+     * turnarounds exact by only merging movement in the same direction */
+    auto turns = [](int32_t pending, int16_t delta) {
+        return (pending < 0 && delta > 0) || (pending > 0 && delta < 0);
+    };
+    auto overflows = [](int32_t pending, int16_t delta) {
+        return pending + delta > INT16_MAX || pending + delta < INT16_MIN;
+    };
+
+    if (turns(_raw_x, move.x) || turns(_raw_y, move.y) ||
+        overflows(_raw_x, move.x) || overflows(_raw_y, move.y))
+        _flushRawXY();
+
+    _raw_x += move.x;
+    _raw_y += move.y;
+
+    if (!_raw_xy_scheduled) {
+        _raw_xy_scheduled = true;
+        _device->strand().run_after([self_weak = self<RemapButton>()]() {
+            if (auto self = self_weak.lock()) {
+                std::lock_guard<std::mutex> flush_lock(self->_raw_xy_lock);
+                self->_raw_xy_scheduled = false;
+                self->_flushRawXY();
+            }
+        }, *_raw_xy_window);
+    }
+}
+
+void RemapButton::_moveButtons(int16_t x, int16_t y) {
+    for (const auto& button: _buttons)
+        if (button.second->pressed())
+            button.second->move(x, y);
+}
+
+void RemapButton::_flushRawXY() {
+    if (_raw_x || _raw_y)
+        _moveButtons((int16_t) _raw_x, (int16_t) _raw_y);
+    _raw_x = 0;
+    _raw_y = 0;
+}
+
+void RemapButton::_setCoalesce(const std::optional<int>& window) {
+    std::lock_guard<std::mutex> lock(_raw_xy_lock);
+    _flushRawXY();
+
+    if (window.has_value() && window.value() >= 0)
+        _raw_xy_window = std::chrono::milliseconds(window.value());
+    else
+        _raw_xy_window.reset();
+}
+
 namespace logid::features {
     class ButtonWrapper : public Button {
     public:
@@ -248,9 +322,9 @@ bool Button::pressed() const {
     return false;
 }
 
-void Button::configure() const {
+logid::async_task<void> Button::configure() const {
     std::shared_lock lock(_action_lock);
-    _conf_func(_action);
+    return _conf_func(_action);
 }
 
 void Button::setProfile(config::Button& config) {
@@ -298,7 +372,7 @@ void Button::IPC::setAction(const std::string& type) {
                 _button._device, type,
                 _button._config.get().action, _button._node);
     }
-    _button.configure();
+    _button.configure().get();
 }
 
 RemapButton::IPC::IPC(RemapButton* parent) :
@@ -22,6 +22,9 @@
 #include <actions/Action.h>
 #include <backend/hidpp20/features/ReprogControls.h>
 #include <backend/hidpp/Device.h>
+#include <util/task.h>
+#include <chrono>
+#include <unordered_map>
 
 namespace logid::features {
     class RemapButton;
@@ -29,7 +32,7 @@ namespace logid::features {
     class Button : public ipcgull::object {
     public:
         typedef backend::hidpp20::ReprogControls::ControlInfo Info;
-        typedef std::function<void(std::shared_ptr<actions::Action>)>
+        typedef std::function<async_task<void>(std::shared_ptr<actions::Action>)>
                 ConfigFunction;
 
         static std::shared_ptr<Button> make(
@@ -46,7 +49,8 @@ namespace logid::features {
 
         [[nodiscard]] std::shared_ptr<ipcgull::node> node() const;
 
-        void configure() const;
+        /* The exchange only starts once the task is awaited */
+        async_task<void> configure() const;
 
         bool pressed() const;
 
@@ -101,12 +105,39 @@ namespace logid::features {
         explicit RemapButton(Device* dev);
 
     private:
-        void _buttonEvent(const std::set<uint16_t>& new_state);
+        void _buttonEvent(const backend::hidpp20::ReprogControls::DivertedButtons& cids);
+
+        void _rawXYEvent(const backend::hidpp20::ReprogControls::Move& move);
+
+        void _moveButtons(int16_t x, int16_t y);
+
+        /* Must hold _raw_xy_lock */
+        void _flushRawXY();
+
+        void _setCoalesce(const std::optional<int>& window);
 
         std::shared_ptr<backend::hidpp20::ReprogControls> _reprog_controls;
-        std::set<uint16_t> _pressed_buttons;
+        /* Buttons get dense indices so that pressed state fits in a bitmask,
+         * the control count is a single byte */
+        static constexpr std::size_t max_buttons = 256;
+        typedef std::array<uint64_t, max_buttons / 64> ButtonMask;
+
+        std::vector<std::shared_ptr<Button>> _button_index;
+        std::unordered_map<uint16_t, uint8_t> _button_cids;
+        ButtonMask _pressed_buttons{};
         std::mutex _button_lock;
 
+        /*
+         * Raw XY movement that hasn't been passed on to gestures yet. Unset
+         * windows disable coalescing, a zero window merges whatever movement
+         * queues up before the device's strand gets to it.
+         */
+        std::mutex _raw_xy_lock;
+        std::optional<std::chrono::milliseconds> _raw_xy_window;
+        int32_t _raw_x = 0, _raw_y = 0;
+        bool _raw_xy_scheduled = false;
+        bool _raw_xy_pressed = false;
+
         std::reference_wrapper<std::optional<config::RemapButton>> _config;
         std::map<uint16_t, std::shared_ptr<Button>> _buttons;
 
@@ -123,6 +154,7 @@ namespace logid::features {
         };
 
         EventHandlerLock<backend::hidpp::Device> _ev_handler;
+        EventHandlerLock<backend::hidpp::Device> _raw_xy_handler;
 
         std::shared_ptr<IPC> _ipc_interface;
     };
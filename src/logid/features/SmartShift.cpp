@@ -89,10 +89,18 @@ SmartShift::Status SmartShift::getStatus() const {
     return _smartshift->getStatus();
 }
 
+logid::async_task<SmartShift::Status> SmartShift::getStatusAsync() const {
+    return _smartshift->getStatusAsync();
+}
+
 void SmartShift::setStatus(Status status) {
     _smartshift->setStatus(status);
 }
 
+logid::async_task<void> SmartShift::setStatusAsync(Status status) {
+    return _smartshift->setStatusAsync(status);
+}
+
 const hidpp20::SmartShift::Defaults& SmartShift::getDefaults() const {
     return _defaults;
 }
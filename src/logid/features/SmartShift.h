@@ -37,8 +37,12 @@ namespace logid::features {
 
         [[nodiscard]] Status getStatus() const;
 
+        async_task<Status> getStatusAsync() const;
+
         void setStatus(Status status);
 
+        async_task<void> setStatusAsync(Status status);
+
         [[nodiscard]] const backend::hidpp20::SmartShift::Defaults& getDefaults() const;
 
         [[nodiscard]] bool supportsTorque() const;
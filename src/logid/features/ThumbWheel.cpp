@@ -20,6 +20,7 @@
 #include <actions/gesture/AxisGesture.h>
 #include <Device.h>
 #include <util/log.h>
+#include <util/latency.h>
 #include <ipc_defs.h>
 
 using namespace logid::features;
@@ -126,15 +127,12 @@ void ThumbWheel::configure() {
 void ThumbWheel::listen() {
     if (_ev_handler.empty()) {
         _ev_handler = _device->hidpp20().addEventHandler(
-                {[index = _thumb_wheel->featureIndex()]
-                         (const hidpp::Report& report) -> bool {
-                    return (report.feature() == index) &&
-                           (report.function() == hidpp20::ThumbWheel::Event);
-                },
-                 [self_weak = self<ThumbWheel>()](const hidpp::Report& report) -> void {
-                     if (auto self = self_weak.lock())
+                {.callback = [self_weak = self<ThumbWheel>()](const hidpp::Report& report) {
+                    if (auto self = self_weak.lock())
                         self->_handleEvent(self->_thumb_wheel->thumbwheelEvent(report));
-                 }
+                },
+                 .key = hidpp::Device::eventKey(_thumb_wheel->featureIndex(),
+                                                hidpp20::ThumbWheel::Event)
                 });
     }
 }
@@ -151,6 +149,7 @@ void ThumbWheel::setProfile(config::Profile& profile) {
 }
 
 void ThumbWheel::_handleEvent(hidpp20::ThumbWheel::ThumbwheelEvent event) {
+    latency_mark(latency_stage::feature);
     std::shared_lock lock(_config_mutex);
     if (event.flags & hidpp20::ThumbWheel::SingleTap) {
         auto action = _tap_action;
@@ -0,0 +1,195 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Times GestureAction::move() against the std::map lookups it used to do,
+ * using the same gestures and the same stream of raw XY events.
+ */
+
+#include <actions/GestureAction.h>
+#include <config/schema.h>
+#include <util/log.h>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace logid;
+using namespace logid::actions;
+using namespace std::chrono;
+
+LogLevel logid::global_loglevel = WARN;
+
+static constexpr std::size_t default_events = 10000000;
+
+/* Moves start from the origin again after this many events */
+static constexpr std::size_t events_per_press = 64;
+
+namespace {
+    class BenchGestureAction : public GestureAction {
+    public:
+        BenchGestureAction(config::GestureAction& config,
+                           const std::shared_ptr<ipcgull::node>& parent) :
+                GestureAction(nullptr, config, parent) {
+            for (std::size_t i = 0; i < direction_count; ++i) {
+                if (_gestures[i])
+                    _map.emplace((Direction) i, _gestures[i]);
+            }
+        }
+
+        /* move() as it was when gestures were kept in a std::map */
+        void mapMove(int16_t x, int16_t y) {
+            std::shared_lock lock(_config_mutex);
+
+            int32_t new_x = _map_x + x, new_y = _map_y + y;
+
+            if (abs(x) > 0) {
+                if (_map_x < 0 && new_x >= 0) { // Left -> Origin/Right
+                    auto left = _map.find(Left);
+                    if (left != _map.end() && left->second)
+                        left->second->move((int16_t) _map_x);
+                    if (new_x) { // Ignore to origin
+                        auto right = _map.find(Right);
+                        if (right != _map.end() && right->second)
+                            right->second->move((int16_t) new_x);
+                    }
+                } else if (_map_x > 0 && new_x <= 0) { // Right -> Origin/Left
+                    auto right = _map.find(Right);
+                    if (right != _map.end() && right->second)
+                        right->second->move((int16_t) -_map_x);
+                    if (new_x) { // Ignore to origin
+                        auto left = _map.find(Left);
+                        if (left != _map.end() && left->second)
+                            left->second->move((int16_t) -new_x);
+                    }
+                } else if (new_x < 0) { // Origin/Left to Left
+                    auto left = _map.find(Left);
+                    if (left != _map.end() && left->second)
+                        left->second->move((int16_t) -x);
+                } else if (new_x > 0) { // Origin/Right to Right
+                    auto right = _map.find(Right);
+                    if (right != _map.end() && right->second)
+                        right->second->move(x);
+                }
+            }
+
+            if (abs(y) > 0) {
+                if (_map_y > 0 && new_y <= 0) { // Up -> Origin/Down
+                    auto up = _map.find(Up);
+                    if (up != _map.end() && up->second)
+                        up->second->move((int16_t) _map_y);
+                    if (new_y) { // Ignore to origin
+                        auto down = _map.find(Down);
+                        if (down != _map.end() && down->second)
+                            down->second->move((int16_t) new_y);
+                    }
+                } else if (_map_y < 0 && new_y >= 0) { // Down -> Origin/Up
+                    auto down = _map.find(Down);
+                    if (down != _map.end() && down->second)
+                        down->second->move((int16_t) -_map_y);
+                    if (new_y) { // Ignore to origin
+                        auto up = _map.find(Up);
+                        if (up != _map.end() && up->second)
+                            up->second->move((int16_t) -new_y);
+                    }
+                } else if (new_y < 0) { // Origin/Up to Up
+                    auto up = _map.find(Up);
+                    if (up != _map.end() && up->second)
+                        up->second->move((int16_t) -y);
+                } else if (new_y > 0) {// Origin/Down to Down
+                    auto down = _map.find(Down);
+                    if (down != _map.end() && down->second)
+                        down->second->move(y);
+                }
+            }
+
+            _map_x = new_x;
+            _map_y = new_y;
+        }
+
+        void mapPress() {
+            _map_x = 0, _map_y = 0;
+            for (auto& gesture: _map)
+                gesture.second->press(false);
+        }
+
+    private:
+        std::map<Direction, std::shared_ptr<Gesture>> _map;
+        int32_t _map_x{}, _map_y{};
+    };
+
+    template <typename Press, typename Move>
+    double nsPerEvent(const std::vector<std::pair<int16_t, int16_t>>& events,
+                      Press&& press, Move&& move) {
+        auto start = steady_clock::now();
+        for (std::size_t i = 0; i < events.size(); ++i) {
+            if (i % events_per_press == 0)
+                press();
+            move(events[i].first, events[i].second);
+        }
+        auto elapsed = duration<double, std::nano>(steady_clock::now() - start);
+        return elapsed.count() / (double) events.size();
+    }
+}
+
+int main(int argc, char** argv) {
+    std::size_t event_count = default_events;
+    if (argc > 1) {
+        try {
+            event_count = std::stoul(argv[1]);
+        } catch (std::exception& e) {
+            fprintf(stderr, "Usage: %s [events]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    config::GestureAction config;
+    config.gestures.emplace();
+    for (auto direction: {"up", "down", "left", "right", "none"})
+        config.gestures.value()[direction] = config::NoGesture();
+
+    auto node = ipcgull::node::make_root("bench");
+    auto action = node->make_interface<BenchGestureAction>(config, node);
+
+    // Small deltas, so the axes cross the origin about as often as they would
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> delta(-20, 20);
+    std::vector<std::pair<int16_t, int16_t>> events(event_count);
+    for (auto& event: events)
+        event = {(int16_t) delta(rng), (int16_t) delta(rng)};
+
+    // Once each to warm up, then the measured runs
+    for (int i = 0; i < 2; ++i) {
+        double before = nsPerEvent(events, [&action]() { action->mapPress(); },
+                                   [&action](int16_t x, int16_t y) {
+                                       action->mapMove(x, y);
+                                   });
+        double after = nsPerEvent(events, [&action]() { action->press(); },
+                                  [&action](int16_t x, int16_t y) {
+                                      action->move(x, y);
+                                  });
+        if (i > 0) {
+            printf("%zu events\n", events.size());
+            printf("before (std::map): %.2f ns/event\n", before);
+            printf("after (array):     %.2f ns/event\n", after);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
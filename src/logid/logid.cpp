@@ -20,6 +20,9 @@
 #include <InputDevice.h>
 #include <util/task.h>
 #include <util/log.h>
+#include <backend/hidpp/IOTiming.h>
+#include <backend/raw/ReportReplay.h>
+#include <backend/hidpp/Simulator.h>
 #include <algorithm>
 #include <ipc_defs.h>
 
@@ -35,6 +38,10 @@ using namespace logid;
 
 struct CmdlineOptions {
     std::string config_file = default_config;
+    std::string replay_file;
+    double replay_speed = 1.0;
+    unsigned int simulated_devices = 0;
+    unsigned int simulated_receivers = 0;
 };
 
 LogLevel logid::global_loglevel = INFO;
@@ -44,9 +51,26 @@ enum class Option {
     Verbose,
     Config,
     Help,
-    Version
+    Version,
+    Replay,
+    ReplaySpeed,
+    Simulate,
+    SimulateReceivers
 };
 
+static unsigned int readCount(const int argc, char** argv, int& i) {
+    // The count is optional, default to one
+    if (i + 1 >= argc || argv[i + 1][0] == '-')
+        return 1;
+
+    try {
+        return std::stoul(argv[++i]);
+    } catch (std::exception& e) {
+        logPrintf(ERROR, "%s is not a valid count.", argv[i]);
+        exit(EXIT_FAILURE);
+    }
+}
+
 void readCliOptions(const int argc, char** argv, CmdlineOptions& options) {
     for (int i = 1; i < argc; i++) {
         Option option = Option::None;
@@ -60,6 +84,10 @@ void readCliOptions(const int argc, char** argv, CmdlineOptions& options) {
                     if (op_str == "--config") option = Option::Config;
                     if (op_str == "--help") option = Option::Help;
                     if (op_str == "--version") option = Option::Version;
+                    if (op_str == "--replay") option = Option::Replay;
+                    if (op_str == "--replay-speed") option = Option::ReplaySpeed;
+                    if (op_str == "--simulate") option = Option::Simulate;
+                    if (op_str == "--simulate-receivers") option = Option::SimulateReceivers;
                     break;
                 }
                 case 'v': // Verbosity
@@ -74,6 +102,9 @@ void readCliOptions(const int argc, char** argv, CmdlineOptions& options) {
                 case 'h': // Help
                     option = Option::Help;
                     break;
+                case 'r': // Replay trace path
+                    option = Option::Replay;
+                    break;
                 default:
                     logPrintf(WARN, "%s is not a valid option, ignoring.",
                               argv[i]);
@@ -109,6 +140,33 @@ void readCliOptions(const int argc, char** argv, CmdlineOptions& options) {
                     options.config_file = argv[i];
                     break;
                 }
+                case Option::Replay: {
+                    if (++i >= argc) {
+                        logPrintf(ERROR, "Replay file is not specified.");
+                        exit(EXIT_FAILURE);
+                    }
+                    options.replay_file = argv[i];
+                    break;
+                }
+                case Option::ReplaySpeed: {
+                    if (++i >= argc) {
+                        logPrintf(ERROR, "Replay speed is not specified.");
+                        exit(EXIT_FAILURE);
+                    }
+                    try {
+                        options.replay_speed = std::stod(argv[i]);
+                    } catch (std::exception& e) {
+                        logPrintf(ERROR, "%s is not a valid replay speed.", argv[i]);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+                }
+                case Option::Simulate:
+                    options.simulated_devices = readCount(argc, argv, i);
+                    break;
+                case Option::SimulateReceivers:
+                    options.simulated_receivers = readCount(argc, argv, i);
+                    break;
                 case Option::Help:
                     printf(R"(logid version %s
 Usage: %s [options]
@@ -116,6 +174,11 @@ Possible options are:
     -v,--verbose [level]       Set log level to debug/info/warn/error (leave blank for debug)
     -V,--version               Print version number
     -c,--config [file path]    Change config file from default at %s
+    -r,--replay [file path]    Play back the devices in a raw report trace instead of hidraw
+    --replay-speed [factor]    Scale the replay's recorded timing, 0 for as fast as possible
+    --simulate [count]         Add simulated corded HID++ 2.0 mice (default 1)
+    --simulate-receivers [count]
+                               Add simulated receivers with six paired mice each (default 1)
     -h,--help                  Print this message.
 )", LOGIOPS_VERSION, argv[0], default_config);
                     exit(EXIT_SUCCESS);
@@ -129,6 +192,44 @@ Possible options are:
     }
 }
 
+static backend::hidpp::RetryPolicy readRetryPolicy(
+        const std::optional<config::RetryPolicy>& config,
+        backend::hidpp::RetryPolicy policy) {
+    if (config.has_value()) {
+        policy.retries = config->retries.value_or(policy.retries);
+        policy.backoff = config->backoff.value_or(policy.backoff);
+    }
+    return policy;
+}
+
+static void configureTimeouts(const Configuration& config) {
+    using namespace backend::hidpp;
+    using ms = std::chrono::duration<double, std::milli>;
+    const auto timeouts = config.timeouts.value_or(config::Timeouts());
+
+    auto limits = backend::hidpp::default_timeout_limits;
+    if (timeouts.min.has_value())
+        limits.min = std::chrono::duration_cast<std::chrono::milliseconds>(
+                ms(timeouts.min.value()));
+    if (timeouts.max.has_value())
+        limits.max = std::chrono::duration_cast<std::chrono::milliseconds>(
+                ms(timeouts.max.value()));
+
+    if (limits.min > limits.max) {
+        logPrintf(WARN, "timeouts: min (%lld ms) is above max (%lld ms), swapping them.",
+                  (long long) limits.min.count(), (long long) limits.max.count());
+        std::swap(limits.min, limits.max);
+    }
+
+    setTimeoutLimits(limits);
+    setRetryPolicy(Transaction::Connect,
+                   readRetryPolicy(timeouts.connect,
+                                   backend::hidpp::default_connect_policy));
+    setRetryPolicy(Transaction::Runtime,
+                   readRetryPolicy(timeouts.runtime,
+                                   backend::hidpp::default_runtime_policy));
+}
+
 int main(int argc, char** argv) {
     CmdlineOptions options{};
     readCliOptions(argc, argv, options);
@@ -150,6 +251,7 @@ int main(int argc, char** argv) {
     }
 
     init_workers(config->workers.value_or(defaults::workers));
+    configureTimeouts(*config);
 
 #ifdef USE_USER_BUS
     auto server_bus = ipcgull::IPCGULL_USER;
@@ -161,14 +263,45 @@ int main(int argc, char** argv) {
 
     //Create a virtual input device
     try {
-        virtual_input = std::make_unique<InputDevice>(virtual_input_name);
+        virtual_input = std::make_unique<InputDevice>(
+                virtual_input_name, InputDevice::capabilitiesOf(*config));
     } catch (std::system_error& e) {
         logPrintf(ERROR, "Could not create input device: %s", e.what());
         return EXIT_FAILURE;
     }
 
+    const bool simulate = options.simulated_devices || options.simulated_receivers;
+    if (simulate && !options.replay_file.empty()) {
+        logPrintf(ERROR, "Simulated devices can't be used with a replay.");
+        return EXIT_FAILURE;
+    }
+
+    std::shared_ptr<backend::raw::VirtualTransport> transport;
+    if (!options.replay_file.empty()) {
+        try {
+            transport = std::make_shared<backend::raw::ReportReplay>(
+                    options.replay_file, options.replay_speed);
+        } catch (std::exception& e) {
+            logPrintf(ERROR, "Could not load replay %s: %s",
+                      options.replay_file.c_str(), e.what());
+            return EXIT_FAILURE;
+        }
+    } else if (simulate) {
+        auto simulator = std::make_shared<backend::hidpp::Simulator>();
+        for (unsigned int i = 0; i < options.simulated_devices; ++i)
+            simulator->addDevice();
+        for (unsigned int i = 0; i < options.simulated_receivers; ++i) {
+            auto receiver = simulator->addReceiver();
+            for (unsigned int j = backend::hidpp::WirelessDevice1;
+                 j <= backend::hidpp::WirelessDevice6; ++j)
+                simulator->pair(receiver);
+        }
+        transport = simulator;
+    }
+
     // Device manager runs on its own I/O thread asynchronously
-    auto device_manager = DeviceManager::make<DeviceManager>(config, virtual_input, server);
+    auto device_manager = DeviceManager::make<DeviceManager>(config, virtual_input, server,
+                                                             transport);
 
     device_manager->enumerate();
 
@@ -0,0 +1,344 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Measures the throughput and wake-up latency of util/task against a copy
+ * of the scheduler it replaced, a single priority queue under one mutex.
+ */
+
+#include <Configuration.h>
+#include <util/task.h>
+#include <util/log.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace logid;
+using namespace std::chrono;
+
+LogLevel logid::global_loglevel = WARN;
+
+static constexpr std::size_t default_tasks = 1000000;
+static constexpr int producers = 4;
+static constexpr std::size_t chain_length = 1000;
+static constexpr std::size_t wakeups = 200;
+static constexpr std::size_t delayed_tasks = 1000;
+
+/* Delayed tasks are all queued before the first one is due */
+static constexpr milliseconds min_delay(10);
+static constexpr milliseconds delay_spread(50);
+
+namespace {
+    namespace baseline {
+        /* util/task.cpp as it was, except that workers are joined instead
+         * of detached so that it can be stopped before util/task starts */
+        class Scheduler {
+        public:
+            explicit Scheduler(int worker_count) {
+                for (int i = 0; i < worker_count; ++i)
+                    _workers.emplace_back(&Scheduler::_worker, this);
+            }
+
+            ~Scheduler() {
+                {
+                    std::lock_guard lock(_task_mutex);
+                    _workers_run = false;
+                }
+                _task_cv.notify_all();
+                for (auto& worker: _workers)
+                    worker.join();
+            }
+
+            void runTask(std::function<void()> function) {
+                runTaskAfter(std::move(function), milliseconds::zero());
+            }
+
+            void runTaskAfter(std::function<void()> function, milliseconds delay) {
+                std::lock_guard lock(_task_mutex);
+                _tasks.push({std::move(function), system_clock::now() + delay});
+                _task_cv.notify_one();
+            }
+
+        private:
+            struct task {
+                std::function<void()> function;
+                system_clock::time_point time;
+            };
+
+            struct task_less {
+                bool operator()(const task& a, const task& b) const {
+                    return a.time > b.time;
+                }
+            };
+
+            void _worker() {
+                std::unique_lock lock(_task_mutex);
+                while (_workers_run) {
+                    _task_cv.wait(lock, [this]() { return !_tasks.empty() || !_workers_run; });
+
+                    if (!_workers_run)
+                        break;
+
+                    /* top task is in the future, wait */
+                    if (_tasks.top().time >= system_clock::now()) {
+                        auto wait = _tasks.top().time - system_clock::now();
+                        _task_cv.wait_for(lock, wait, [this]() {
+                            return (!_tasks.empty() &&
+                                    (_tasks.top().time < system_clock::now())) ||
+                                   !_workers_run;
+                        });
+
+                        if (!_workers_run)
+                            break;
+                    }
+
+                    if (!_tasks.empty()) {
+                        /* May have timed out and is no longer empty */
+                        auto f = _tasks.top().function;
+                        _tasks.pop();
+
+                        lock.unlock();
+                        f();
+                        lock.lock();
+                    }
+                }
+            }
+
+            std::priority_queue<task, std::vector<task>, task_less> _tasks;
+            std::mutex _task_mutex;
+            std::condition_variable _task_cv;
+            bool _workers_run = true;
+            std::vector<std::thread> _workers;
+        };
+    }
+
+    /* Set once by the last task, waited on by the main thread */
+    class Latch {
+    public:
+        void open() {
+            {
+                std::lock_guard lock(_mutex);
+                _open = true;
+            }
+            _cv.notify_all();
+        }
+
+        void wait() {
+            std::unique_lock lock(_mutex);
+            _cv.wait(lock, [this]() { return _open; });
+        }
+
+    private:
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        bool _open = false;
+    };
+
+    double elapsedSeconds(steady_clock::time_point start) {
+        return duration<double>(steady_clock::now() - start).count();
+    }
+
+    struct Throughput {
+        double tasks_per_second;
+        /* The longest any one task waited to start */
+        double longest_wait_ms;
+    };
+
+    /* Tasks queued by several threads at once, as with a burst of udev events */
+    template <typename Run>
+    Throughput external(std::size_t count, Run&& run) {
+        std::atomic<std::size_t> done = 0;
+        std::atomic<steady_clock::rep> longest_wait = 0;
+        Latch finished;
+        const std::size_t total = count / producers * producers;
+
+        auto start = steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int p = 0; p < producers; ++p) {
+            threads.emplace_back([&]() {
+                for (std::size_t i = 0; i < total / producers; ++i) {
+                    run([&, queued = steady_clock::now()]() {
+                        auto wait = (steady_clock::now() - queued).count();
+                        auto longest = longest_wait.load();
+                        while (wait > longest && !longest_wait.compare_exchange_weak(longest, wait));
+
+                        if (++done == total)
+                            finished.open();
+                    });
+                }
+            });
+        }
+        for (auto& thread: threads)
+            thread.join();
+        finished.wait();
+
+        return {(double) total / elapsedSeconds(start),
+                duration<double, std::milli>(steady_clock::duration(longest_wait)).count()};
+    }
+
+    /* Tasks queued by tasks, as coroutines continuing on the workers do */
+    template <typename Run>
+    double nested(std::size_t count, Run&& run) {
+        const std::size_t chains = std::max<std::size_t>(count / chain_length, 1);
+        std::atomic<std::size_t> done = 0;
+        Latch finished;
+
+        std::function<void(std::size_t)> step = [&](std::size_t left) {
+            if (left == 0) {
+                if (++done == chains)
+                    finished.open();
+                return;
+            }
+            run([&step, left]() { step(left - 1); });
+        };
+
+        auto start = steady_clock::now();
+        for (std::size_t i = 0; i < chains; ++i)
+            step(chain_length);
+        finished.wait();
+
+        return (double) (chains * chain_length) / elapsedSeconds(start);
+    }
+
+    struct Latency {
+        double mean_us;
+        double p99_us;
+    };
+
+    Latency summarize(std::vector<steady_clock::duration>& samples) {
+        std::sort(samples.begin(), samples.end());
+        duration<double, std::micro> total{};
+        for (auto& sample: samples)
+            total += sample;
+        auto p99 = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+        return {total.count() / (double) samples.size(),
+                duration<double, std::micro>(p99).count()};
+    }
+
+    /* From queueing a task on idle workers to the task starting */
+    template <typename Run>
+    Latency wakeup(Run&& run) {
+        std::vector<steady_clock::duration> samples;
+        samples.reserve(wakeups);
+        for (std::size_t i = 0; i < wakeups; ++i) {
+            // Let the workers go back to sleep
+            std::this_thread::sleep_for(milliseconds(1));
+
+            Latch started;
+            steady_clock::duration sample{};
+            auto queued = steady_clock::now();
+            run([&]() {
+                sample = steady_clock::now() - queued;
+                started.open();
+            });
+            started.wait();
+            samples.push_back(sample);
+        }
+
+        return summarize(samples);
+    }
+
+    /* How late delayed tasks start, negative if early */
+    template <typename RunAfter>
+    Latency lateness(RunAfter&& run_after) {
+        std::vector<steady_clock::duration> samples(delayed_tasks);
+        std::atomic<std::size_t> done = 0;
+        Latch finished;
+
+        for (std::size_t i = 0; i < delayed_tasks; ++i) {
+            auto delay = min_delay + milliseconds(i % delay_spread.count());
+            auto due = steady_clock::now() + delay;
+            run_after([&samples, &done, &finished, i, due]() {
+                samples[i] = steady_clock::now() - due;
+                if (++done == delayed_tasks)
+                    finished.open();
+            }, delay);
+        }
+        finished.wait();
+
+        return summarize(samples);
+    }
+
+    struct Results {
+        Throughput external;
+        double nested;
+        Latency wakeup;
+        Latency lateness;
+    };
+
+    template <typename Run, typename RunAfter>
+    Results measure(std::size_t count, Run&& run, RunAfter&& run_after) {
+        // Once to warm up, then the measured run
+        external(count, run);
+        return {external(count, run), nested(count, run), wakeup(run),
+                lateness(run_after)};
+    }
+
+    void print(const char* name, const Results& results) {
+        printf("%s\n", name);
+        printf("    queued by %d threads: %10.0f tasks/s, longest wait %.1f ms\n",
+               producers, results.external.tasks_per_second,
+               results.external.longest_wait_ms);
+        printf("    queued by tasks:      %10.0f tasks/s\n", results.nested);
+        printf("    wake-up:              %8.1f us mean, %8.1f us p99\n",
+               results.wakeup.mean_us, results.wakeup.p99_us);
+        printf("    delayed task late by: %8.1f us mean, %8.1f us p99\n",
+               results.lateness.mean_us, results.lateness.p99_us);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::size_t task_count = default_tasks;
+    if (argc > 1) {
+        try {
+            task_count = std::stoul(argv[1]);
+        } catch (std::exception& e) {
+            fprintf(stderr, "Usage: %s [tasks]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    const int workers = defaults::workers;
+    printf("%zu tasks, %d workers\n", task_count, workers);
+
+    Results before{};
+    {
+        baseline::Scheduler scheduler(workers);
+        before = measure(task_count, [&scheduler](std::function<void()> f) {
+            scheduler.runTask(std::move(f));
+        }, [&scheduler](std::function<void()> f, milliseconds delay) {
+            scheduler.runTaskAfter(std::move(f), delay);
+        });
+    }
+    print("before (priority queue):", before);
+
+    init_workers(workers);
+    auto after = measure(task_count, [](std::function<void()> f) {
+        run_task(std::move(f));
+    }, [](std::function<void()> f, milliseconds delay) {
+        run_task_after(std::move(f), delay);
+    });
+    print("after (work stealing):", after);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,336 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LOGID_ASYNC_TASK_H
+#define LOGID_ASYNC_TASK_H
+
+#include <util/ExceptionHandler.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace logid {
+    template <typename T = void>
+    class async_task;
+
+    /* Far longer than any HID++ exchange with all of its retries */
+    static constexpr std::chrono::seconds async_get_timeout(30);
+
+    namespace detail {
+        struct async_promise_base {
+            std::coroutine_handle<> continuation;
+            std::exception_ptr exception;
+            /* Set by whichever of the coroutine and its awaiter arrives last */
+            std::atomic_flag ready;
+            bool started = false;
+
+            struct final_awaiter {
+                [[nodiscard]] bool await_ready() const noexcept { return false; }
+
+                template <typename Promise>
+                std::coroutine_handle<> await_suspend(
+                        std::coroutine_handle<Promise> handle) noexcept {
+                    auto& promise = handle.promise();
+                    if (promise.ready.test_and_set(std::memory_order_acq_rel))
+                        return promise.continuation;
+                    return std::noop_coroutine();
+                }
+
+                void await_resume() const noexcept { }
+            };
+
+            std::suspend_always initial_suspend() const noexcept { return {}; }
+
+            final_awaiter final_suspend() const noexcept { return {}; }
+
+            void unhandled_exception() noexcept {
+                exception = std::current_exception();
+            }
+        };
+
+        template <typename T>
+        struct async_promise : public async_promise_base {
+            std::optional<T> value;
+
+            async_task<T> get_return_object() noexcept;
+
+            void return_value(T v) {
+                value.emplace(std::move(v));
+            }
+
+            T result() {
+                if (exception)
+                    std::rethrow_exception(exception);
+                return std::move(value.value());
+            }
+        };
+
+        template <>
+        struct async_promise<void> : public async_promise_base {
+            async_task<void> get_return_object() noexcept;
+
+            void return_void() const noexcept { }
+
+            void result() const {
+                if (exception)
+                    std::rethrow_exception(exception);
+            }
+        };
+
+        /* Fire-and-forget coroutine that owns nothing but its own frame */
+        struct detached_task {
+            struct promise_type {
+                detached_task get_return_object() const noexcept { return {}; }
+
+                std::suspend_never initial_suspend() const noexcept { return {}; }
+
+                std::suspend_never final_suspend() const noexcept { return {}; }
+
+                void return_void() const noexcept { }
+
+                void unhandled_exception() const noexcept { std::terminate(); }
+            };
+        };
+    }
+
+    /*
+     * Lazily started coroutine returning a T.
+     *
+     * A task starts running when it is co_awaited, or when start() is called
+     * so that several tasks can be in flight at once and awaited later.
+     * Coroutines resume on whichever thread completed the operation they
+     * were waiting on: the I/O thread for HID++ responses, the timer thread
+     * for their timeouts. They must therefore never block; every exchange
+     * with a device should be co_awaited rather than called synchronously.
+     */
+    template <typename T>
+    class async_task {
+    public:
+        typedef detail::async_promise<T> promise_type;
+        typedef std::coroutine_handle<promise_type> handle_t;
+
+        async_task() = default;
+
+        explicit async_task(handle_t handle) noexcept : _handle(handle) { }
+
+        async_task(const async_task&) = delete;
+
+        async_task(async_task&& o) noexcept : _handle(std::exchange(o._handle, {})) { }
+
+        async_task& operator=(const async_task&) = delete;
+
+        async_task& operator=(async_task&& o) noexcept {
+            if (this != &o) {
+                if (_handle)
+                    _handle.destroy();
+                _handle = std::exchange(o._handle, {});
+            }
+            return *this;
+        }
+
+        ~async_task() {
+            if (_handle)
+                _handle.destroy();
+        }
+
+        /* Begin running the task without waiting for its result. */
+        void start() {
+            auto& promise = _handle.promise();
+            if (!promise.started) {
+                promise.started = true;
+                _handle.resume();
+            }
+        }
+
+        /*
+         * Block the calling thread until the task completes, throwing
+         * std::errc::timed_out once the timeout passes. A task that is given
+         * up on keeps running and frees itself once it completes.
+         */
+        T get(std::chrono::milliseconds timeout = async_get_timeout) {
+            return get_until(std::chrono::steady_clock::now() + timeout);
+        }
+
+        T get_until(std::chrono::steady_clock::time_point deadline) {
+            auto waiter = std::make_shared<_waiter>();
+            _notify(_handle, waiter);
+
+            std::unique_lock lock(waiter->mutex);
+            if (!waiter->cv.wait_until(lock, deadline,
+                                       [&waiter]() { return waiter->done; })) {
+                waiter->abandoned = true;
+                _handle = {};
+                throw std::system_error(std::make_error_code(std::errc::timed_out),
+                                        "async_task::get");
+            }
+            lock.unlock();
+
+            return _handle.promise().result();
+        }
+
+        auto operator co_await() noexcept {
+            struct awaiter : public ready_awaiter {
+                T await_resume() {
+                    return this->handle.promise().result();
+                }
+            };
+
+            return awaiter{{_handle}};
+        }
+
+    private:
+        struct ready_awaiter {
+            handle_t handle;
+
+            /* done() cannot be asked while the task may be running on
+             * another thread, await_suspend settles that race instead */
+            [[nodiscard]] bool await_ready() const noexcept {
+                return !handle;
+            }
+
+            std::coroutine_handle<> await_suspend(
+                    std::coroutine_handle<> awaiting) noexcept {
+                auto& promise = handle.promise();
+                promise.continuation = awaiting;
+                if (!promise.started) {
+                    promise.started = true;
+                    promise.ready.test_and_set(std::memory_order_acq_rel);
+                    return handle;
+                }
+
+                /* The task may have finished between start() and now */
+                if (promise.ready.test_and_set(std::memory_order_acq_rel))
+                    return awaiting;
+                return std::noop_coroutine();
+            }
+
+            void await_resume() const noexcept { }
+        };
+
+        struct _waiter {
+            std::mutex mutex;
+            std::condition_variable cv;
+            bool done = false;
+            bool abandoned = false;
+        };
+
+        static detail::detached_task _notify(handle_t handle,
+                                             std::shared_ptr<_waiter> waiter) {
+            co_await ready_awaiter{handle};
+
+            std::unique_lock lock(waiter->mutex);
+            if (waiter->abandoned) {
+                lock.unlock();
+                handle.destroy();
+                co_return;
+            }
+            waiter->done = true;
+            lock.unlock();
+            waiter->cv.notify_all();
+        }
+
+        handle_t _handle;
+    };
+
+    namespace detail {
+        template <typename T>
+        async_task<T> async_promise<T>::get_return_object() noexcept {
+            return async_task<T>(
+                    std::coroutine_handle<async_promise<T>>::from_promise(*this));
+        }
+
+        inline async_task<void> async_promise<void>::get_return_object() noexcept {
+            return async_task<void>(
+                    std::coroutine_handle<async_promise<void>>::from_promise(*this));
+        }
+
+        template <typename T>
+        detached_task spawn_detached(async_task<T> task) {
+            try {
+                co_await task;
+            } catch (std::exception& e) {
+                ExceptionHandler::Default(e);
+            }
+        }
+    }
+
+    /* Run a task to completion in the background, logging any error. */
+    template <typename T>
+    void spawn(async_task<T> task) {
+        detail::spawn_detached(std::move(task));
+    }
+
+    /*
+     * Start every task, then block until all of them complete or the timeout
+     * passes. The first error is rethrown only once no task is left to wait
+     * on.
+     */
+    template <typename T>
+    std::vector<T> get_all(std::vector<async_task<T>>& tasks,
+                           std::chrono::milliseconds timeout = async_get_timeout) {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        for (auto& task: tasks)
+            task.start();
+
+        std::vector<T> results;
+        results.reserve(tasks.size());
+        std::exception_ptr error;
+        for (auto& task: tasks) {
+            try {
+                results.push_back(task.get_until(deadline));
+            } catch (std::exception& e) {
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+
+        if (error)
+            std::rethrow_exception(error);
+
+        return results;
+    }
+
+    inline void get_all(std::vector<async_task<void>>& tasks,
+                        std::chrono::milliseconds timeout = async_get_timeout) {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        for (auto& task: tasks)
+            task.start();
+
+        std::exception_ptr error;
+        for (auto& task: tasks) {
+            try {
+                task.get_until(deadline);
+            } catch (std::exception& e) {
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+#endif //LOGID_ASYNC_TASK_H
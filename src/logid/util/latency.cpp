@@ -0,0 +1,135 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <util/latency.h>
+#include <algorithm>
+#include <bit>
+
+using namespace logid;
+using namespace std::chrono;
+
+thread_local latency_scope::context* latency_scope::_current = nullptr;
+
+std::size_t latency_histogram::_bucket(uint64_t ns) noexcept {
+    constexpr uint64_t sub_buckets = 1 << sub_bucket_bits;
+    if (ns < sub_buckets)
+        return ns;
+
+    /* The exponent picks a group of sub-buckets, the bits after the
+     * leading one pick the sub-bucket within it. */
+    const unsigned int msb = std::bit_width(ns) - 1;
+    const std::size_t bucket = ((msb - sub_bucket_bits + 1) << sub_bucket_bits) |
+                               ((ns >> (msb - sub_bucket_bits)) & (sub_buckets - 1));
+    return std::min(bucket, bucket_count - 1);
+}
+
+uint64_t latency_histogram::_upperBound(std::size_t bucket) noexcept {
+    constexpr uint64_t sub_buckets = 1 << sub_bucket_bits;
+    if (bucket < sub_buckets)
+        return bucket;
+
+    const unsigned int msb = (bucket >> sub_bucket_bits) + sub_bucket_bits - 1;
+    const uint64_t mantissa = sub_buckets | (bucket & (sub_buckets - 1));
+    return ((mantissa + 1) << (msb - sub_bucket_bits)) - 1;
+}
+
+void latency_histogram::record(nanoseconds latency) noexcept {
+    const auto ns = static_cast<uint64_t>(std::max<int64_t>(latency.count(), 0));
+
+    _buckets[_bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+
+    auto max = _max.load(std::memory_order_relaxed);
+    while (ns > max && !_max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) { }
+}
+
+latency_histogram::stats latency_histogram::summary() const {
+    std::array<uint64_t, bucket_count> counts{};
+    uint64_t total = 0;
+    for (std::size_t i = 0; i < bucket_count; ++i) {
+        counts[i] = _buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+
+    const uint64_t max = _max.load(std::memory_order_relaxed);
+
+    auto percentile = [&](double p) -> uint64_t {
+        if (total == 0)
+            return 0;
+
+        const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(p * (double)total));
+        uint64_t seen = 0;
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            seen += counts[i];
+            if (seen >= rank)
+                return std::min(_upperBound(i), max);
+        }
+        return max;
+    };
+
+    return {nanoseconds(percentile(0.5)), nanoseconds(percentile(0.99)),
+            nanoseconds(max), total};
+}
+
+void latency_histogram::reset() noexcept {
+    for (auto& bucket: _buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+}
+
+void latency_tracker::record(latency_stage stage, nanoseconds latency) noexcept {
+    _stages[static_cast<std::size_t>(stage)].record(latency);
+}
+
+latency_histogram::stats latency_tracker::summary(latency_stage stage) const {
+    return _stages[static_cast<std::size_t>(stage)].summary();
+}
+
+void latency_tracker::reset() noexcept {
+    for (auto& stage: _stages)
+        stage.reset();
+}
+
+latency_scope::latency_scope() noexcept : _context{steady_clock::now()}, _previous(_current) {
+    _current = &_context;
+}
+
+latency_scope::~latency_scope() noexcept {
+    _current = _previous;
+}
+
+void logid::latency_attach(latency_tracker& tracker) noexcept {
+    auto context = latency_scope::_current;
+    if (!context)
+        return;
+
+    context->tracker = &tracker;
+    context->marked = 0;
+    latency_mark(latency_stage::dispatch);
+}
+
+void logid::latency_mark(latency_stage stage) noexcept {
+    auto context = latency_scope::_current;
+    if (!context || !context->tracker)
+        return;
+
+    const uint8_t bit = 1 << static_cast<unsigned int>(stage);
+    if (context->marked & bit)
+        return;
+    context->marked |= bit;
+
+    context->tracker->record(stage, steady_clock::now() - context->read);
+}
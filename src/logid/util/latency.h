@@ -0,0 +1,120 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LOGID_UTIL_LATENCY_H
+#define LOGID_UTIL_LATENCY_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace logid {
+    /* Where an input report has got to, measured from when it was read */
+    enum class latency_stage {
+        dispatch, /* Reached its hidpp::Device */
+        feature,  /* Reached the feature that handles it */
+        output,   /* Wrote its first uinput event */
+    };
+
+    constexpr std::size_t latency_stage_count = 3;
+
+    /*
+     * Log-linear histogram with eight buckets per power of two, so
+     * percentiles are within ~12% of the true value. Recording is
+     * lock-free and may race with reset().
+     */
+    class latency_histogram {
+    public:
+        struct stats {
+            std::chrono::nanoseconds p50;
+            std::chrono::nanoseconds p99;
+            std::chrono::nanoseconds max;
+            uint64_t samples;
+        };
+
+        void record(std::chrono::nanoseconds latency) noexcept;
+
+        [[nodiscard]] stats summary() const;
+
+        void reset() noexcept;
+
+    private:
+        static constexpr unsigned int sub_bucket_bits = 3;
+        // Anything over 2^40ns (~18 minutes) goes in the last bucket
+        static constexpr std::size_t bucket_count = 38 << sub_bucket_bits;
+
+        static std::size_t _bucket(uint64_t ns) noexcept;
+
+        static uint64_t _upperBound(std::size_t bucket) noexcept;
+
+        std::array<std::atomic<uint64_t>, bucket_count> _buckets{};
+        std::atomic<uint64_t> _max = 0;
+    };
+
+    class latency_tracker {
+    public:
+        void record(latency_stage stage, std::chrono::nanoseconds latency) noexcept;
+
+        [[nodiscard]] latency_histogram::stats summary(latency_stage stage) const;
+
+        void reset() noexcept;
+
+    private:
+        std::array<latency_histogram, latency_stage_count> _stages;
+    };
+
+    /*
+     * Timestamps the report read on this thread for as long as it
+     * lives. Stages reached while handling it synchronously are recorded
+     * once each, in the tracker attached by latency_attach. Work deferred
+     * to other threads is not measured.
+     */
+    class latency_scope {
+    public:
+        latency_scope() noexcept;
+
+        ~latency_scope() noexcept;
+
+        latency_scope(const latency_scope&) = delete;
+
+        latency_scope& operator=(const latency_scope&) = delete;
+
+    private:
+        struct context {
+            std::chrono::steady_clock::time_point read;
+            latency_tracker* tracker = nullptr;
+            uint8_t marked = 0;
+        };
+
+        friend void latency_attach(latency_tracker& tracker) noexcept;
+
+        friend void latency_mark(latency_stage stage) noexcept;
+
+        static thread_local context* _current;
+
+        context _context;
+        context* const _previous;
+    };
+
+    /* Assigns the current report to a device, reaching the dispatch stage */
+    void latency_attach(latency_tracker& tracker) noexcept;
+
+    void latency_mark(latency_stage stage) noexcept;
+}
+
+#endif //LOGID_UTIL_LATENCY_H
@@ -16,115 +16,356 @@
  *
  */
 #include <util/task.h>
-#include <queue>
-#include <optional>
+#include <util/timer_wheel.h>
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
 
 using namespace logid;
 using namespace std::chrono;
 
-struct task_less {
-private:
-    std::greater<> greater;
-public:
-    bool operator()(const task& a, const task& b) const {
-        return greater(a.time, b.time);
-    }
-};
+/*
+ * Every worker owns a deque. Tasks queued from a worker go to its own deque
+ * and are run newest first; tasks queued from anywhere else are spread over
+ * the workers. Idle workers steal the oldest task from another deque
+ * before going to sleep. Delayed tasks wait in a timer wheel served by its
+ * own thread, which hands them to the workers once due. Timer callbacks
+ * run on that thread directly.
+ */
+namespace {
+    struct worker_queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<worker_queue>> queues;
+    std::atomic_size_t next_queue = 0;
+    thread_local std::optional<std::size_t> current_worker;
 
-static std::priority_queue<task, std::vector<task>, task_less> tasks {};
-static std::mutex task_mutex {};
-static std::condition_variable task_cv {};
-static std::atomic_bool workers_init = false;
-static std::atomic_bool workers_run = false;
+    /* Tasks queued but not yet taken, and workers waiting for one */
+    std::atomic_size_t queued = 0;
+    std::atomic_size_t sleepers = 0;
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
 
-void stop_workers() {
-    std::unique_lock lock(task_mutex);
-    if (workers_init) {
+    std::mutex timer_mutex;
+    std::condition_variable timer_cv;
+    std::optional<timer_wheel> timers;
+
+    std::atomic_bool workers_init = false;
+    std::atomic_bool workers_run = false;
+}
+
+static void submit(std::function<void()> function);
+
+static void stop_workers() {
+    {
+        std::lock_guard lock(sleep_mutex);
         workers_run = false;
-        lock.unlock();
-        task_cv.notify_all();
+    }
+    sleep_cv.notify_all();
 
-        /* Wait for all workers to end */
-        lock.lock();
+    {
+        std::lock_guard lock(timer_mutex);
     }
+    timer_cv.notify_all();
 }
 
-void worker() {
-    std::unique_lock lock(task_mutex);
-    while (workers_run) {
-        task_cv.wait(lock, []() { return !tasks.empty() || !workers_run; });
+static std::optional<std::function<void()>> take_task(std::size_t self) {
+    {
+        auto& own = *queues[self];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            auto f = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            --queued;
+            return f;
+        }
+    }
+
+    for (std::size_t i = 1; i < queues.size(); ++i) {
+        auto& victim = *queues[(self + i) % queues.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            auto f = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --queued;
+            return f;
+        }
+    }
 
-        if (!workers_run)
-            break;
+    return {};
+}
 
-        /* top task is in the future, wait */
-        if (tasks.top().time >= system_clock::now()) {
-            auto wait = tasks.top().time - system_clock::now();
-            task_cv.wait_for(lock, wait, []() {
-                return (!tasks.empty() && (tasks.top().time < system_clock::now())) ||
-                    !workers_run;
-            });
+static void worker(std::size_t self) {
+    current_worker = self;
 
-            if (!workers_run)
-                break;
+    while (workers_run) {
+        if (auto f = take_task(self)) {
+            try {
+                (*f)();
+            } catch (std::exception& e) {
+                ExceptionHandler::Default(e);
+            }
+            continue;
         }
 
-        if (!tasks.empty()) {
-            /* May have timed out and is no longer empty */
-            auto f = tasks.top().function;
-            tasks.pop();
+        std::unique_lock lock(sleep_mutex);
+        ++sleepers;
+        sleep_cv.wait(lock, []() { return queued > 0 || !workers_run; });
+        --sleepers;
+    }
+}
+
+static void timer_thread() {
+    std::vector<std::function<void()>> expired;
+    std::unique_lock lock(timer_mutex);
+
+    while (workers_run) {
+        timers->advance(steady_clock::now(), expired);
 
+        if (!expired.empty()) {
             lock.unlock();
-            try {
-                f();
-            } catch(std::exception& e) {
-                ExceptionHandler::Default(e);
+            for (auto& f: expired) {
+                try {
+                    f();
+                } catch (std::exception& e) {
+                    ExceptionHandler::Default(e);
+                }
             }
+            expired.clear();
             lock.lock();
+            continue;
         }
+
+        if (auto wakeup = timers->nextWakeup())
+            timer_cv.wait_until(lock, wakeup.value());
+        else
+            timer_cv.wait(lock);
     }
 }
 
 void logid::init_workers(int worker_count) {
-    std::lock_guard lock(task_mutex);
     assert(!workers_init);
+    assert(worker_count > 0);
 
     for (int i = 0; i < worker_count; ++i)
-        std::thread(&worker).detach();
+        queues.push_back(std::make_unique<worker_queue>());
+    timers.emplace();
 
     workers_init = true;
     workers_run = true;
 
+    for (int i = 0; i < worker_count; ++i)
+        std::thread(&worker, i).detach();
+    std::thread(&timer_thread).detach();
+
     atexit(&stop_workers);
 }
 
-void logid::run_task(std::function<void()> function) {
-    task t{
-            .function = std::move(function),
-            .time = std::chrono::system_clock::now()
-    };
+static void submit(std::function<void()> function) {
+    if (!workers_init) {
+        throw std::runtime_error("tasks queued before work queue ready");
+    }
+
+    const std::size_t index = current_worker.has_value() ? current_worker.value() :
+                              next_queue.fetch_add(1) % queues.size();
+    {
+        auto& queue = *queues[index];
+        std::lock_guard lock(queue.mutex);
+        queue.tasks.push_back(std::move(function));
+        ++queued;
+    }
 
-    run_task(t);
+    if (sleepers > 0) {
+        /* Taking the lock orders this against a worker about to sleep */
+        { std::lock_guard lock(sleep_mutex); }
+        sleep_cv.notify_one();
+    }
 }
 
-void logid::run_task_after(std::function<void()> function, std::chrono::milliseconds delay) {
-    task t{
-            .function = std::move(function),
-            .time = system_clock::now() + delay
-    };
+/* Runs function on the timer thread once delay has passed */
+static void add_timer(std::function<void()> function, milliseconds delay) {
+    if (!workers_init) {
+        throw std::runtime_error("tasks queued before work queue ready");
+    }
+
+    std::unique_lock lock(timer_mutex);
+    auto wakeup = timers->nextWakeup();
+    timers->add(steady_clock::now() + delay, std::move(function));
+
+    // Only wake the timer thread if it would otherwise sleep past this task
+    if (!wakeup || timers->nextWakeup() < wakeup) {
+        lock.unlock();
+        timer_cv.notify_one();
+    }
+}
+
+static void submit_after(std::function<void()> function, milliseconds delay) {
+    if (delay <= milliseconds::zero()) {
+        submit(std::move(function));
+        return;
+    }
 
-    run_task(t);
+    add_timer([function = std::move(function)]() mutable {
+        submit(std::move(function));
+    }, delay);
 }
 
-void logid::run_task(task t) {
-    std::lock_guard lock(task_mutex);
+void logid::run_timer_after(std::function<void()> function, milliseconds delay) {
+    add_timer(std::move(function), delay);
+}
 
-    if (!workers_init) {
-        throw std::runtime_error("tasks queued before work queue ready");
+task_handle logid::run_task(std::function<void()> function) {
+    return task_handle::_start(std::move(function), &submit_after, milliseconds::zero());
+}
+
+task_handle logid::run_task_after(std::function<void()> function,
+                                  std::chrono::milliseconds delay) {
+    return task_handle::_start(std::move(function), &submit_after, delay);
+}
+
+task_handle logid::run_task(task t) {
+    return run_task_after(std::move(t.function),
+                          ceil<milliseconds>(t.time - steady_clock::now()));
+}
+
+task_handle::task_handle(std::shared_ptr<state> s) : _state(std::move(s)) {
+}
+
+bool task_handle::cancel() {
+    if (!_state)
+        return false;
+
+    std::lock_guard lock(_state->mutex);
+    if (!_state->pending)
+        return false;
+
+    _state->pending = false;
+    ++_state->generation;
+    _state->function = nullptr;
+    _state->schedule = nullptr;
+    return true;
+}
+
+bool task_handle::reschedule(std::chrono::milliseconds delay) {
+    if (!_state)
+        return false;
+
+    {
+        std::lock_guard lock(_state->mutex);
+        if (!_state->pending)
+            return false;
+    }
+
+    _arm(_state, delay);
+    return true;
+}
+
+bool task_handle::pending() const {
+    if (!_state)
+        return false;
+
+    std::lock_guard lock(_state->mutex);
+    return _state->pending;
+}
+
+task_handle task_handle::_start(std::function<void()> function, scheduler schedule,
+                                std::chrono::milliseconds delay) {
+    auto s = std::make_shared<state>();
+    s->function = std::move(function);
+    s->schedule = std::move(schedule);
+    _arm(s, delay);
+    return task_handle(s);
+}
+
+void task_handle::_arm(const std::shared_ptr<state>& s, std::chrono::milliseconds delay) {
+    uint64_t generation;
+    scheduler schedule;
+    {
+        std::lock_guard lock(s->mutex);
+        if (!s->pending)
+            return;
+        generation = ++s->generation;
+        schedule = s->schedule;
+    }
+
+    /* Earlier arms of the same task are left queued but will do nothing */
+    schedule([s, generation]() {
+        std::function<void()> function;
+        {
+            std::lock_guard lock(s->mutex);
+            if (!s->pending || s->generation != generation)
+                return;
+            s->pending = false;
+            function = std::move(s->function);
+            s->schedule = nullptr;
+        }
+
+        function();
+    }, delay);
+}
+
+strand::strand() : _state(std::make_shared<state>()) {
+}
+
+task_handle strand::run(std::function<void()> function) {
+    return run_after(std::move(function), milliseconds::zero());
+}
+
+task_handle strand::run_after(std::function<void()> function,
+                              std::chrono::milliseconds delay) {
+    return task_handle::_start(
+            std::move(function),
+            [s = _state](std::function<void()> f, milliseconds d) {
+                if (d <= milliseconds::zero())
+                    _post(s, std::move(f));
+                else
+                    submit_after([s, f = std::move(f)]() mutable {
+                        _post(s, std::move(f));
+                    }, d);
+            }, delay);
+}
+
+void strand::_post(const std::shared_ptr<state>& s, std::function<void()> function) {
+    {
+        std::lock_guard lock(s->mutex);
+        s->tasks.push_back(std::move(function));
+        if (s->scheduled)
+            return;
+        s->scheduled = true;
+    }
+
+    submit([s]() { _drain(s); });
+}
+
+void strand::_drain(const std::shared_ptr<state>& s) {
+    /* Give the worker back now and then so a busy strand can't hog it */
+    constexpr int batch_size = 16;
+
+    for (int i = 0; i < batch_size; ++i) {
+        std::function<void()> function;
+        {
+            std::lock_guard lock(s->mutex);
+            if (s->tasks.empty()) {
+                s->scheduled = false;
+                return;
+            }
+            function = std::move(s->tasks.front());
+            s->tasks.pop_front();
+        }
+
+        try {
+            function();
+        } catch (std::exception& e) {
+            ExceptionHandler::Default(e);
+        }
     }
 
-    tasks.emplace(std::move(t));
-    // TODO: only need to wake up at top
-    task_cv.notify_one();
+    submit([s]() { _drain(s); });
 }
@@ -19,21 +19,136 @@
 #define LOGID_TASK_H
 
 #include <util/ExceptionHandler.h>
+#include <deque>
 #include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <future>
 
 namespace logid {
     struct task {
         std::function<void()> function;
-        std::chrono::time_point<std::chrono::system_clock> time;
+        std::chrono::time_point<std::chrono::steady_clock> time;
+    };
+
+    class strand;
+
+    /* Refers to a queued task, which may be cancelled or moved until it starts */
+    class task_handle {
+    public:
+        task_handle() = default;
+
+        /* Returns false if the task already started or was cancelled */
+        bool cancel();
+
+        /* Runs the task after delay instead, counting from now */
+        bool reschedule(std::chrono::milliseconds delay);
+
+        [[nodiscard]] bool pending() const;
+
+    private:
+        typedef std::function<void(std::function<void()>,
+                                   std::chrono::milliseconds)> scheduler;
+
+        struct state {
+            mutable std::mutex mutex;
+            std::function<void()> function;
+            scheduler schedule;
+            uint64_t generation = 0;
+            bool pending = true;
+        };
+
+        explicit task_handle(std::shared_ptr<state> s);
+
+        static task_handle _start(std::function<void()> function, scheduler schedule,
+                                  std::chrono::milliseconds delay);
+
+        static void _arm(const std::shared_ptr<state>& s, std::chrono::milliseconds delay);
+
+        std::shared_ptr<state> _state;
+
+        friend task_handle run_task(std::function<void()> function);
+
+        friend task_handle run_task_after(std::function<void()> function,
+                                          std::chrono::milliseconds delay);
+
+        friend class strand;
     };
 
     void init_workers(int worker_count);
 
-    void run_task(std::function<void()> function);
-    void run_task_after(std::function<void()> function, std::chrono::milliseconds delay);
-    void run_task(task t);
+    task_handle run_task(std::function<void()> function);
+    task_handle run_task_after(std::function<void()> function, std::chrono::milliseconds delay);
+    task_handle run_task(task t);
+
+    /* Runs function on the timer thread itself, so it still runs when every
+     * worker is busy or blocked. It must be short and must never block. */
+    void run_timer_after(std::function<void()> function, std::chrono::milliseconds delay);
+
+    /* Keeps at most one pending task per key, later tasks replace earlier ones */
+    template <typename Key>
+    class keyed_tasks {
+    public:
+        void replace(const Key& key, task_handle handle) {
+            std::lock_guard lock(_mutex);
+            std::erase_if(_tasks, [](const auto& t) { return !t.second.pending(); });
+
+            auto [it, inserted] = _tasks.try_emplace(key, handle);
+            if (!inserted) {
+                it->second.cancel();
+                it->second = std::move(handle);
+            }
+        }
+
+        void cancel(const Key& key) {
+            std::lock_guard lock(_mutex);
+            auto it = _tasks.find(key);
+            if (it != _tasks.end()) {
+                it->second.cancel();
+                _tasks.erase(it);
+            }
+        }
+
+        void cancelAll() {
+            std::lock_guard lock(_mutex);
+            for (auto& t: _tasks)
+                t.second.cancel();
+            _tasks.clear();
+        }
+
+    private:
+        std::mutex _mutex;
+        std::map<Key, task_handle> _tasks;
+    };
+
+    /*
+     * Runs its tasks in order, one at a time, on the shared workers. Work
+     * on different strands runs in parallel while a strand never occupies
+     * more than one worker.
+     */
+    class strand {
+    public:
+        strand();
+
+        task_handle run(std::function<void()> function);
+
+        task_handle run_after(std::function<void()> function, std::chrono::milliseconds delay);
+
+    private:
+        struct state {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+            bool scheduled = false;
+        };
+
+        static void _post(const std::shared_ptr<state>& s, std::function<void()> function);
+
+        static void _drain(const std::shared_ptr<state>& s);
+
+        /* Shared with queued work so that it may outlive its owner */
+        std::shared_ptr<state> _state;
+    };
 }
 
 #endif //LOGID_TASK_H
@@ -0,0 +1,146 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <util/timer_wheel.h>
+#include <algorithm>
+
+using namespace logid;
+using namespace std::chrono;
+
+timer_wheel::timer_wheel(clock::time_point start) : _start(start) {
+}
+
+void timer_wheel::add(clock::time_point when, callback function) {
+    /* Nothing is waiting on the ticks that passed while empty, skip them */
+    if (_size == 0)
+        _tick = std::max(_tick, (uint64_t) duration_cast<milliseconds>(
+                std::max(clock::now() - _start, clock::duration::zero())).count());
+
+    // Never fire early, and never in the tick that has already been handled
+    entry e{std::max(_tickOf(when), _tick + 1), std::move(function)};
+    std::vector<callback> unused;
+    ++_size;
+    _place(std::move(e), unused);
+}
+
+void timer_wheel::advance(clock::time_point now, std::vector<callback>& expired) {
+    const auto target = (uint64_t) duration_cast<milliseconds>(
+            std::max(now - _start, clock::duration::zero())).count();
+
+    while (_tick < target) {
+        if (_size == 0) {
+            _tick = target;
+            break;
+        }
+
+        ++_tick;
+
+        /* Pull the next slot of every level whose boundary was reached */
+        for (unsigned int level = level_count - 1; level > 0; --level) {
+            if ((_tick & ((1ull << (slot_bits * level)) - 1)) == 0)
+                _cascade(level, expired);
+        }
+
+        if (!_overflow.empty() &&
+            (_tick & ((1ull << (slot_bits * (level_count - 1))) - 1)) == 0) {
+            auto overflow = std::move(_overflow);
+            _overflow.clear();
+            for (auto& e: overflow)
+                _place(std::move(e), expired);
+        }
+
+        auto& due = _levels[0][_tick & (slot_count - 1)];
+        for (auto& e: due) {
+            expired.push_back(std::move(e.function));
+            --_size;
+        }
+        due.clear();
+    }
+}
+
+std::optional<timer_wheel::clock::time_point> timer_wheel::nextWakeup() const {
+    if (_size == 0)
+        return {};
+
+    std::optional<uint64_t> next;
+    auto consider = [&next](uint64_t tick) {
+        if (!next || tick < next.value())
+            next = tick;
+    };
+
+    for (unsigned int i = 1; i <= slot_count; ++i) {
+        if (!_levels[0][(_tick + i) & (slot_count - 1)].empty()) {
+            consider(_tick + i);
+            break;
+        }
+    }
+
+    for (unsigned int level = 1; level < level_count; ++level) {
+        const unsigned int shift = slot_bits * level;
+        for (unsigned int i = 1; i <= slot_count; ++i) {
+            const uint64_t boundary = ((_tick >> shift) + i) << shift;
+            if (!_levels[level][(boundary >> shift) & (slot_count - 1)].empty()) {
+                consider(boundary);
+                break;
+            }
+        }
+    }
+
+    if (!_overflow.empty()) {
+        const unsigned int shift = slot_bits * (level_count - 1);
+        consider(((_tick >> shift) + 1) << shift);
+    }
+
+    return _start + milliseconds(next.value());
+}
+
+bool timer_wheel::empty() const {
+    return _size == 0;
+}
+
+uint64_t timer_wheel::_tickOf(clock::time_point time) const {
+    if (time <= _start)
+        return 0;
+    return ceil<milliseconds>(time - _start).count();
+}
+
+void timer_wheel::_place(entry e, std::vector<callback>& expired) {
+    if (e.tick <= _tick) {
+        expired.push_back(std::move(e.function));
+        --_size;
+        return;
+    }
+
+    const uint64_t delta = e.tick - _tick;
+    for (unsigned int level = 0; level < level_count; ++level) {
+        if (delta < (1ull << (slot_bits * (level + 1)))) {
+            auto index = (e.tick >> (slot_bits * level)) & (slot_count - 1);
+            _levels[level][index].push_back(std::move(e));
+            return;
+        }
+    }
+
+    _overflow.push_back(std::move(e));
+}
+
+void timer_wheel::_cascade(unsigned int level, std::vector<callback>& expired) {
+    auto& current = _levels[level][(_tick >> (slot_bits * level)) & (slot_count - 1)];
+    auto entries = std::move(current);
+    current.clear();
+    for (auto& e: entries)
+        _place(std::move(e), expired);
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2019-2023 PixlOne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LOGID_TIMER_WHEEL_H
+#define LOGID_TIMER_WHEEL_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+namespace logid {
+    /*
+     * Hierarchical timing wheel with a resolution of one millisecond.
+     * Each level has 64 slots, so the levels cover 64ms, ~4s, ~4min and
+     * ~4.6h respectively; anything further out waits in an overflow list.
+     * Not thread-safe, callers must serialize access.
+     */
+    class timer_wheel {
+    public:
+        typedef std::chrono::steady_clock clock;
+        typedef std::function<void()> callback;
+
+        explicit timer_wheel(clock::time_point start = clock::now());
+
+        void add(clock::time_point when, callback function);
+
+        /* Advance to now, appending the callbacks that are due to expired */
+        void advance(clock::time_point now, std::vector<callback>& expired);
+
+        /* When advance() next has something to do, if ever */
+        [[nodiscard]] std::optional<clock::time_point> nextWakeup() const;
+
+        [[nodiscard]] bool empty() const;
+
+    private:
+        static constexpr unsigned int slot_bits = 6;
+        static constexpr unsigned int slot_count = 1 << slot_bits;
+        static constexpr unsigned int level_count = 4;
+
+        struct entry {
+            uint64_t tick;
+            callback function;
+        };
+
+        typedef std::vector<entry> slot;
+
+        [[nodiscard]] uint64_t _tickOf(clock::time_point time) const;
+
+        void _place(entry e, std::vector<callback>& expired);
+
+        void _cascade(unsigned int level, std::vector<callback>& expired);
+
+        const clock::time_point _start;
+        uint64_t _tick = 0;
+        std::size_t _size = 0;
+
+        std::array<std::array<slot, slot_count>, level_count> _levels;
+        slot _overflow;
+    };
+}
+
+#endif //LOGID_TIMER_WHEEL_H